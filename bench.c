@@ -0,0 +1,175 @@
+//  throughput checks for the hot paths, build optimized, e.g.
+//      clang -O2 -march=native -I. -o bench bench.c
+//  `./bench` runs everything, `./bench utf8 ...` only the named benchmarks
+#include "core.h"
+
+#include <time.h>
+
+static f64 bench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+//  keeps the optimizer from dropping the measured work
+static volatile size_t bench_sink;
+
+static void bench_utf8(void) {
+    //  mostly ascii with two byte sequences mixed in, like latin text
+    const size_t len = CORE_MB(64);
+    char *text = malloc(len);
+    for(size_t i = 0; i < len;) {
+        if(i % 7 == 0 && i + 2 <= len) {
+            text[i++] = (char)0xC3;
+            text[i++] = (char)0xA9;
+        }else {
+            text[i] = 'a' + (char)(i % 26);
+            i++;
+        }
+    }
+    StringView view = { .len = len, .data = text };
+    const size_t rounds = 16;
+
+    f64 start = bench_now();
+    for(size_t i = 0; i < rounds; i++) {
+        bench_sink += utf8_validate(view);
+    }
+    f64 validate = bench_now() - start;
+
+    start = bench_now();
+    for(size_t i = 0; i < rounds; i++) {
+        bench_sink += _utf8_validate_scalar(view.data, view.len);
+    }
+    f64 scalar = bench_now() - start;
+
+    start = bench_now();
+    for(size_t i = 0; i < rounds; i++) {
+        Vec(u16) wide = utf8_to_utf16(view);
+        bench_sink += vec_len(wide);
+        vec_destroy(wide);
+    }
+    f64 utf16 = bench_now() - start;
+
+    f64 bytes = (f64)(len * rounds);
+    println("utf8_validate:        %6.2f GB/s", bytes / validate / 1e9);
+    println("utf8_validate scalar: %6.2f GB/s", bytes / scalar / 1e9);
+    println("utf8_to_utf16:        %6.2f GB/s", bytes / utf16 / 1e9);
+    free(text);
+}
+
+static u64 bench_sum_lines(StringView text) {
+    u64 sum = 0, value = 0;
+    for(size_t i = 0; i < text.len; i++) {
+        char c = text.data[i];
+        if(c == '\n') {
+            sum += value;
+            value = 0;
+        }else {
+            value = value * 10 + (u64)(c - '0');
+        }
+    }
+    return sum + value;
+}
+
+static void *bench_chunks_process(StringView chunk, Arena *scratch, void *user_data) {
+    CORE_UNUSED(user_data);
+    u64 *sum = arena_alloc(scratch, sizeof(u64));
+    *sum = bench_sum_lines(chunk);
+    return sum;
+}
+
+static void bench_chunks_merge(void *result, size_t index, void *user_data) {
+    CORE_UNUSED(index);
+    *(u64 *)user_data += *(u64 *)result;
+}
+
+static void bench_chunks(void) {
+    //  ~110 MB of decimal lines, summed once through a copy and once mapped in chunks
+    const char *path = "bench_chunks.txt";
+    FILE *out = fopen(path, "wb");
+    u64 expected = 0;
+    for(u64 i = 0; i < 12000000; i++) {
+        u64 value = (i * 2654435761u) % 100000000;
+        expected += value;
+        fprintf(out, "%llu\n", (unsigned long long)value);
+    }
+    fclose(out);
+
+    f64 start = bench_now();
+    String text = file_read_to_string(path);
+    u64 sum = bench_sum_lines(string_into_view(&text));
+    f64 read = bench_now() - start;
+    bool ok = sum == expected;
+    size_t bytes = string_len(&text);
+    string_destroy(&text);
+
+    start = bench_now();
+    FileHandle file = file_open(path, FILE_READ | FILE_BIN);
+    sum = 0;
+    file_process_chunks(file, bench_chunks_process, bench_chunks_merge, &sum);
+    file_close(file);
+    f64 chunks = bench_now() - start;
+    ok &= sum == expected;
+    bench_sink += sum;
+
+    println("%zu MB, %u cpus%s", bytes / CORE_MB(1), _core_cpu_count(), ok ? "" : ", wrong sums");
+    println("file_read + scan:    %.3fs", read);
+    println("file_process_chunks: %.3fs", chunks);
+    remove(path);
+}
+
+static void bench_log(void) {
+    //  producer side cost per call: bursts that fit into the queue, flushed outside the timing,
+    //  so the writer thread formatting into /dev/null is not counted
+    const size_t bursts = 20, calls = 50000;
+    FileHandle sink = file_open("/dev/null", FILE_WRITE);
+    log_async_start(.file = sink, .overflow = LOG_OVERFLOW_BLOCK, .queue_size = CORE_MB(8));
+
+    f64 slow = 0, fast = 0;
+    for(size_t burst = 0; burst < bursts; burst++) {
+        f64 start = bench_now();
+        for(size_t i = 0; i < calls; i++) {
+            core_log(CORE_INFO, "loop %d %f %s", (int)i, (f64)i * 0.5, "text");
+        }
+        slow += bench_now() - start;
+        log_async_flush();
+
+        start = bench_now();
+        for(size_t i = 0; i < calls; i++) {
+            log_fast(CORE_INFO, "loop %d %f %s", (int)i, (f64)i * 0.5, "text");
+        }
+        fast += bench_now() - start;
+        log_async_flush();
+    }
+    u64 dropped = log_async_dropped();
+    log_async_stop();
+    file_close(sink);
+
+    f64 total = (f64)(bursts * calls);
+    println("core_log: %6.1f ns/call", slow / total * 1e9);
+    println("log_fast: %6.1f ns/call", fast / total * 1e9);
+    println("dropped:  %llu", (unsigned long long)dropped);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} benches[] = {
+    { "utf8", bench_utf8 },
+    { "chunks", bench_chunks },
+    { "log", bench_log },
+};
+
+int main(int argc, char **argv) {
+    for(size_t i = 0; i < CORE_ARRLEN(benches); i++) {
+        bool selected = argc < 2;
+        for(int arg = 1; arg < argc; arg++) {
+            selected |= strcmp(argv[arg], benches[i].name) == 0;
+        }
+        if(selected) {
+            println("[%s]", benches[i].name);
+            benches[i].run();
+        }
+    }
+    return 0;
+}
@@ -7,6 +7,13 @@ extern "C" {
 
 #define CORE_IMPLEMENTATION
 
+//  splice, memfd_create, getdents64, ... need _GNU_SOURCE, which only takes effect if
+//  it is set before the first system header, so either include core.h first or
+//  build with -D_GNU_SOURCE
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -17,6 +24,19 @@ extern "C" {
 #include <assert.h>
 #include <threads.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+#if defined(__AVX2__)
+    #define CORE_AVX2
+    #include <immintrin.h>
+#endif
+
+#if defined(__SSE4_2__)
+    #define CORE_SSE42
+    #include <nmmintrin.h>
+#endif
 
 #ifdef  _WIN32
     #define  PLATFORM_WIN32
@@ -24,6 +44,57 @@ extern "C" {
     #define PLATFORM_POSIX
 #endif
 
+#ifdef PLATFORM_WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <dirent.h>
+    #include <sys/ioctl.h>
+    #include <poll.h>
+    #include <time.h>
+#endif
+
+#ifdef __linux__
+    #include <sys/sendfile.h>
+    #include <sys/inotify.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define CORE_IO_URING
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+#if defined(PLATFORM_POSIX) && ((!defined(__x86_64__) && !defined(__aarch64__)) || defined(CORE_FIBER_UCONTEXT))
+    #ifndef CORE_FIBER_UCONTEXT
+    #define CORE_FIBER_UCONTEXT
+    #endif
+    #include <ucontext.h>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+    #define CORE_ASAN
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #define CORE_ASAN
+    #endif
+#endif
+#ifdef CORE_ASAN
+    #include <sanitizer/common_interface_defs.h>
+#endif
+
 #ifndef STRING_GROW_FACTOR
 #define STRING_GROW_FACTOR 1.5
 #endif
@@ -31,7 +102,7 @@ extern "C" {
 #ifdef CORE_DEBUG_ASSERT
 #define CORE_ASSERT(e) assert(e)
 #else
-#define CORE_ASSERT(e)
+#define CORE_ASSERT(e) ((void)0)
 #endif
 
 //float types
@@ -57,6 +128,7 @@ typedef uintptr_t           ptr_t;
 #define KB 1024
 #define CORE_KB(x) ((x) * KB)
 #define CORE_MB(x) (CORE_KB(x) * 1000)
+#define CORE_CACHE_LINE 64
 
 #define CORE_BIT(x) 1 << (x)
 #define FLAG_SET(v, flag) ((v) |= (flag))
@@ -78,7 +150,7 @@ typedef uintptr_t           ptr_t;
 #define SHORT_STRING_LENGTH 24
 #define ARENA_DEFAULT_ALLOC_SIZE CORE_KB(4)
 #ifndef RINGBUFFER_SIZE
-#define RINGBUFFER_SIZE CORE_KB(4)
+#define RINGBUFFER_SIZE CORE_KB(64)
 #endif
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -183,6 +255,9 @@ String string_from_impl(const char *ptr, OptAllocArg arg);
 #define string_from(ptr, ...) string_from_impl((ptr), (OptAllocArg){__VA_ARGS__})
 String string_from_parts_impl(const char *ptr, size_t len, size_t cap, OptAllocArg arg);
 #define string_from_parts(ptr, len, cap, ...) string_from_parts_impl((ptr), (len), (cap), (OptAllocArg){__VA_ARGS__})
+//  takes ownership of `ptr` (null terminated, allocated with `arg.allocator`) instead of copying it
+String string_adopt_impl(char *ptr, size_t len, size_t cap, OptAllocArg arg);
+#define string_adopt(ptr, len, cap, ...) string_adopt_impl((ptr), (len), (cap), (OptAllocArg){__VA_ARGS__})
 String string_format(const char *format, ...);
 String string_format_opt(OptAllocArg arg, const char *format, ...);
 String string_vformat(const char *fmt, va_list args);
@@ -232,19 +307,36 @@ void *allocator_realloc(Allocator *self, void *mem, size_t size);
 void allocator_free(Allocator *self, void *_block);
 #endif
 
+//  allocations stay valid until the ring wrapped around once, every allocation
+//  carries a small header with its size and position used by `ringbuffer_is_live`
 typedef struct RingBuffer {
     void *base;
+    //  set before the first allocation to size a lazily initialised ring
     size_t size;
     size_t write_pos;
+    //  times the ring wrapped around
+    u64 lap;
+    //  allocations above a quarter of the ring go to the heap, freed two laps later
+    void **large[2];
+    size_t large_bytes;
     Allocator alloc;
 }RingBuffer, ScratchBuffer;
 
-RingBuffer ringbuffer_init_impl(OptAllocArg args);
-#define ringbuffer_init(...) ringbuffer_init_impl((OptAllocArg){__VA_ARGS__})
+typedef struct OptRingBufferArg {
+    Allocator allocator;
+    //  defaults to `RINGBUFFER_SIZE`
+    size_t size;
+}OptRingBufferArg;
+
+RingBuffer ringbuffer_init_impl(OptRingBufferArg args);
+#define ringbuffer_init(...) ringbuffer_init_impl((OptRingBufferArg){__VA_ARGS__})
 void ringbuffer_deinit(RingBuffer *self);
 #define scratch_init ringbuffer_init
 void *ringbuffer_alloc(RingBuffer *self, size_t size);
 #define scratch_alloc ringbuffer_alloc
+//  false once the memory behind `ptr` may have been handed out again, meant for
+//  debug assertions, a pointer whose exact spot was reused reads as live
+bool ringbuffer_is_live(RingBuffer const *self, const void *ptr);
 
 Allocator ringbuffer_allocator(RingBuffer *self);
 #define scratch_allocator ringbuffer_allocator
@@ -261,6 +353,8 @@ typedef enum FileMode {
     FILE_APPEND     = CORE_BIT(2),
     FILE_PLUS       = CORE_BIT(3),
     FILE_BIN        = CORE_BIT(4),
+    //  with `FILE_READ | FILE_WRITE` the file is opened "r+" unless this is set
+    FILE_TRUNCATE   = CORE_BIT(5),
 }FileMode;
 typedef struct File {
     String path;
@@ -280,11 +374,46 @@ char *file_read_binary_impl(FileHandle self, OptAllocArg arg);
 bool file_write_raw(FileHandle self, const char *data, size_t len);
 bool file_write(FileHandle self, const StringView data);
 bool file_exists(const StringView path);
+//  copies without going through user space where the OS allows it
+//  (reflink, `copy_file_range`, `sendfile`, `splice`), returns the amount of bytes copied or -1
+i64 file_copy_range(FileHandle dst, u64 dst_offset, FileHandle src, u64 src_offset, u64 len);
+//  copies the rest of `src` to the current position of `dst`, both positions are advanced,
+//  pipes, terminals and sockets are copied until `src` reaches eof
+i64 file_copy(FileHandle dst, FileHandle src);
+bool file_copy_path(const char *dst, const char *src);
 
 String file_read_to_string_impl(const char *path, OptAllocArg arg);
-#define file_read_to_string(path, ...) file_read_to_string((path), (OptAllocArg){__VA_ARGS__})
+#define file_read_to_string(path, ...) file_read_to_string_impl((path), (OptAllocArg){__VA_ARGS__})
 char *file_read_to_vec_impl(const char *path, OptAllocArg arg);
-#define file_read_to_vec(path, ...) file_read_to_vec((path), (OptAllocArg){__VA_ARGS__})
+#define file_read_to_vec(path, ...) file_read_to_vec_impl((path), (OptAllocArg){__VA_ARGS__})
+
+typedef enum FileMapAdvice {
+    FILE_MAP_SEQUENTIAL,
+    FILE_MAP_RANDOM,
+    FILE_MAP_NORMAL,
+}FileMapAdvice;
+
+typedef struct OptFileMapArg {
+    FileMapAdvice advice;
+    //  prefault all pages up front
+    bool populate;
+}OptFileMapArg;
+
+//  read-only view of a whole file, `data` is NULL if the mapping failed
+typedef struct FileMapping {
+    void *data;
+    size_t size;
+#ifdef PLATFORM_WIN32
+    HANDLE handle;
+#endif
+}FileMapping;
+
+FileMapping file_map_impl(FileHandle self, OptFileMapArg arg);
+#define file_map(self, ...) file_map_impl((self), (OptFileMapArg){__VA_ARGS__})
+FileMapping file_map_path_impl(const char *path, OptFileMapArg arg);
+#define file_map_path(path, ...) file_map_path_impl((path), (OptFileMapArg){__VA_ARGS__})
+void file_unmap(FileMapping *self);
+StringView file_mapping_view(FileMapping const *self);
 
 FileHandle stdio_get(void);
 FileHandle stderr_get(void);
@@ -301,8 +430,10 @@ typedef struct ArrayHeader {
     Allocator alloc;
 } ArrayHeader;
 
-void *core_vec_create_internal_impl(size_t capacity, size_t elem_size, OptAllocArg arg);
+void *core_vec_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg);
 void *core_vec_maygrow_internal(void *arr, size_t elem_size);
+//  grows the capacity to at least `count` elements
+void *core_vec_reserve_internal(void *arr, size_t count, size_t elem_size);
 void core_vec_destroy_internal(void *arr);
 void *core_vec_create_empty_internal(OptAllocArg arg);
 void *core_vec_copy(void *arr, size_t elem_size, OptAllocArg arg);
@@ -317,20 +448,22 @@ bool core_vec_remove(void *vec, size_t elem_size, size_t index);
 #define vec_cap(v) (vec_header((v))->cap)
 
 #define Vec(type) type *
+//  with the default allocator this allocates nothing, the first push does
 #define vec_new(...) core_vec_create_empty_internal((OptAllocArg){__VA_ARGS__})
 #define vec_new_with(items, ...) core_vec_create_from_parts_internal(items, CORE_ARRLEN(items), sizeof(items[0]), (OptAllocArg){__VA_ARGS__})
-#define vec_clear(v) (vec_header((v))->len = 0)
+//  an empty vec may share its header, so it is never written to
+#define vec_clear(v) (vec_len((v)) ? (void)(vec_header((v))->len = 0) : (void)0)
 #define vec_with_size(ty, size, ...) core_vec_create_internal((size), sizeof(ty), (OptAllocArg){__VA_ARGS__})
 #define vec_from_parts(ty, ptr, size, ...) core_vec_create_from_parts_internal((ptr), (size), sizeof(ty), (OptAllocArg){__VA_ARGS__})
 #define vec_destroy(arr) (core_vec_destroy_internal(vec_header(arr)), arr = NULL)
 #define vec_push(arr, value) ((arr) = core_vec_maygrow_internal((arr), sizeof(*(arr))), (arr)[vec_header((arr))->len++] = (value))
-#define vec_pop(arr) (vec_header((arr))->len--, (arr)[vec_len((arr))])
+//  popping an empty vec is a bug, it asserts and leaves the vec untouched
+#define vec_pop(arr) (CORE_ASSERT(vec_len((arr)) > 0), (arr)[vec_len((arr)) ? --vec_header((arr))->len : 0])
 #define vec_put(arr, index, value) do{\
-    if(!arr) arr = core_vec_maygrow_internal((arr), (size_t)sizeof(*(arr)));\
+    (arr) = core_vec_reserve_internal((arr), (size_t)(index) + 1, (size_t)sizeof(*(arr)));\
     if((index) >= vec_len((arr))) {\
-        vec_len(arr) = index + 1;\
+        vec_len(arr) = (index) + 1;\
     }\
-    (arr) = core_vec_maygrow_internal((arr), (size_t)sizeof(*(arr)));\
     (arr)[(index)] = (value);\
 }while(0)
 #define vec_remove(vec, idx) core_vec_remove((vec), sizeof(*(vec)), (idx))
@@ -344,6 +477,239 @@ bool core_vec_remove(void *vec, size_t elem_size, size_t index);
 
 void vec_dump(void *vec);
 
+//  ----------------------------------- //
+//              small-vec               //
+//  ----------------------------------- //
+//  the first `n` elements live inside the struct, only growing past that allocates,
+//  zero initialised it uses the default allocator, the macros take a pointer to it
+typedef struct SmallVecHeader {
+    size_t len;
+    //  capacity of `heap`, unused while the elements are inline
+    size_t cap;
+    void *heap;
+    Allocator alloc;
+}SmallVecHeader;
+
+void core_small_vec_init_internal(SmallVecHeader *header, OptAllocArg arg);
+bool core_small_vec_maygrow_internal(SmallVecHeader *header, void *inline_data, size_t inline_cap, size_t elem_size);
+void core_small_vec_destroy_internal(SmallVecHeader *header);
+
+#define SmallVec(type, n) struct { SmallVecHeader header; type inline_data[n]; }
+//  every `SmallVec(type, n)` is a distinct anonymous type, a named one can be passed
+//  to functions and stored in other structs
+#define SMALL_VEC_DEFINE(name, type, n) typedef struct name { SmallVecHeader header; type inline_data[n]; } name;
+#define small_vec_init(v, ...) core_small_vec_init_internal(&(v)->header, (OptAllocArg){__VA_ARGS__})
+#define small_vec_destroy(v) core_small_vec_destroy_internal(&(v)->header)
+#define small_vec_data(v) ((__typeof__(&(v)->inline_data[0]))((v)->header.heap ? (v)->header.heap : (void *)(v)->inline_data))
+#define small_vec_len(v) ((v)->header.len)
+#define small_vec_cap(v) ((v)->header.heap ? (v)->header.cap : CORE_ARRLEN((v)->inline_data))
+#define small_vec_is_inline(v) ((v)->header.heap == NULL)
+#define small_vec_clear(v) ((v)->header.len = 0)
+//  false if growing failed, the element is dropped and the vector left as it was
+#define small_vec_push(v, value) (\
+    core_small_vec_maygrow_internal(&(v)->header, (v)->inline_data, CORE_ARRLEN((v)->inline_data), sizeof((v)->inline_data[0]))\
+    ? (small_vec_data(v)[(v)->header.len++] = (value), true) : false)
+#define small_vec_pop(v) (CORE_ASSERT(small_vec_len(v) > 0), (v)->header.len--, small_vec_data(v)[(v)->header.len])
+#define small_vec_at(v, index) (CORE_ASSERT((index) < small_vec_len(v)), small_vec_data(v)[(index)])
+#define small_vec_iter(v, iter) for(size_t (iter) = 0; (iter) < small_vec_len(v); (iter)++)
+#define small_vec_foreach(v, item) for(__typeof__(&(v)->inline_data[0]) item = small_vec_data(v); item != small_vec_data(v) + small_vec_len(v); item++)
+#define small_vec_slice(v) (_Slice){ .data = small_vec_data(v), .len = small_vec_len(v) }
+
+//  ----------------------------------- //
+//                 sync                 //
+//  ----------------------------------- //
+#ifndef SYNC_SPIN_COUNT
+#define SYNC_SPIN_COUNT 100
+#endif
+
+//  typed wrappers, loads acquire, stores release and read-modify-writes are acq_rel,
+//  the `_relaxed` versions are for counters and flags that order nothing
+#define CORE_ATOMIC_DEFINE(name, prefix, type) \
+    typedef struct name { _Atomic type value; } name; \
+    static inline type prefix##_load(name *self) { return atomic_load_explicit(&self->value, memory_order_acquire); } \
+    static inline type prefix##_load_relaxed(name *self) { return atomic_load_explicit(&self->value, memory_order_relaxed); } \
+    static inline void prefix##_store(name *self, type value) { atomic_store_explicit(&self->value, value, memory_order_release); } \
+    static inline void prefix##_store_relaxed(name *self, type value) { atomic_store_explicit(&self->value, value, memory_order_relaxed); } \
+    static inline type prefix##_exchange(name *self, type value) { return atomic_exchange_explicit(&self->value, value, memory_order_acq_rel); } \
+    static inline bool prefix##_cas(name *self, type *expected, type desired) { \
+        return atomic_compare_exchange_strong_explicit(&self->value, expected, desired, memory_order_acq_rel, memory_order_acquire); \
+    }
+//  integers also get arithmetic, returning the previous value
+#define CORE_ATOMIC_DEFINE_INT(name, prefix, type) \
+    CORE_ATOMIC_DEFINE(name, prefix, type) \
+    static inline type prefix##_add(name *self, type value) { return atomic_fetch_add_explicit(&self->value, value, memory_order_acq_rel); } \
+    static inline type prefix##_sub(name *self, type value) { return atomic_fetch_sub_explicit(&self->value, value, memory_order_acq_rel); } \
+    static inline type prefix##_add_relaxed(name *self, type value) { return atomic_fetch_add_explicit(&self->value, value, memory_order_relaxed); } \
+    static inline type prefix##_or(name *self, type value) { return atomic_fetch_or_explicit(&self->value, value, memory_order_acq_rel); } \
+    static inline type prefix##_and(name *self, type value) { return atomic_fetch_and_explicit(&self->value, value, memory_order_acq_rel); }
+
+CORE_ATOMIC_DEFINE(AtomicBool, atomic_bool, bool)
+CORE_ATOMIC_DEFINE(AtomicPtr, atomic_ptr, void *)
+CORE_ATOMIC_DEFINE_INT(AtomicU32, atomic_u32, u32)
+CORE_ATOMIC_DEFINE_INT(AtomicU64, atomic_u64, u64)
+CORE_ATOMIC_DEFINE_INT(AtomicI32, atomic_i32, i32)
+CORE_ATOMIC_DEFINE_INT(AtomicI64, atomic_i64, i64)
+CORE_ATOMIC_DEFINE_INT(AtomicSize, atomic_size, size_t)
+
+//  hint for busy wait loops
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#elif defined(_MSC_VER)
+    YieldProcessor();
+#endif
+}
+
+//  sleeps while `*addr == expected`, may return spuriously
+void futex_wait(_Atomic u32 *addr, u32 expected);
+void futex_wake_one(_Atomic u32 *addr);
+void futex_wake_all(_Atomic u32 *addr);
+
+//  all primitives below are zero initialised and need no destruction
+typedef struct SpinLock {
+    _Atomic bool locked;
+}SpinLock;
+
+void spin_lock(SpinLock *self);
+bool spin_try_lock(SpinLock *self);
+void spin_unlock(SpinLock *self);
+
+//  spins for `SYNC_SPIN_COUNT` rounds before sleeping on a futex
+typedef struct Mutex {
+    //  0 unlocked, 1 locked, 2 locked with sleepers
+    _Atomic u32 state;
+}Mutex;
+
+void mutex_lock(Mutex *self);
+bool mutex_try_lock(Mutex *self);
+void mutex_unlock(Mutex *self);
+
+#define RWLOCK_WRITER 0x7FFFFFFFu
+
+//  prefers readers, a steady stream of them can starve writers
+typedef struct RwLock {
+    //  reader count, `RWLOCK_WRITER` while write locked, the top bit marks sleepers
+    _Atomic u32 state;
+}RwLock;
+
+void rwlock_read_lock(RwLock *self);
+bool rwlock_try_read_lock(RwLock *self);
+void rwlock_read_unlock(RwLock *self);
+void rwlock_write_lock(RwLock *self);
+bool rwlock_try_write_lock(RwLock *self);
+void rwlock_write_unlock(RwLock *self);
+
+//  manual reset event
+typedef struct Event {
+    _Atomic u32 set;
+}Event;
+
+void event_set(Event *self);
+void event_reset(Event *self);
+bool event_is_set(Event *self);
+void event_wait(Event *self);
+
+typedef struct Semaphore {
+    _Atomic u32 count;
+    _Atomic u32 sleepers;
+}Semaphore;
+
+void semaphore_post(Semaphore *self, u32 count);
+void semaphore_wait(Semaphore *self);
+bool semaphore_try_wait(Semaphore *self);
+
+//  `threads` has to be set before use, the barrier can be reused right away
+typedef struct Barrier {
+    u32 threads;
+    _Atomic u32 arrived;
+    _Atomic u32 generation;
+}Barrier;
+
+#define barrier_new(count) ((Barrier){ .threads = (count) })
+//  returns true on exactly one thread per round
+bool barrier_wait(Barrier *self);
+
+typedef struct Once {
+    _Atomic u32 state;
+}Once;
+
+//  runs `fn` on the first call, concurrent callers wait until it returned
+void once_call(Once *self, void (*fn)(void *arg), void *arg);
+
+typedef struct SyncStats {
+    u64 acquires;
+    //  acquisitions that found the primitive taken
+    u64 contended;
+    //  times a thread went to sleep on a futex
+    u64 sleeps;
+}SyncStats;
+
+//  process wide totals, only counted when compiled with `CORE_SYNC_STATS`
+SyncStats sync_stats(void);
+void sync_stats_reset(void);
+
+//  ----------------------------------- //
+//                queue                 //
+//  ----------------------------------- //
+//  bounded lock-free queues laid out like `Vec`, a header in front of the
+//  elements, capacities are rounded up to a power of two
+typedef struct SpscQueueHeader {
+    //  written by the producer
+    union { struct { _Atomic size_t head; size_t cached_tail; }; char _line0[CORE_CACHE_LINE]; };
+    //  written by the consumer
+    union { struct { _Atomic size_t tail; size_t cached_head; }; char _line1[CORE_CACHE_LINE]; };
+    union { struct { size_t cap; Allocator alloc; }; char _line2[CORE_CACHE_LINE]; };
+}SpscQueueHeader;
+
+//  Vyukov's bounded queue, every slot carries a sequence number in `sequence`
+typedef struct MpmcQueueHeader {
+    union { _Atomic size_t enqueue_pos; char _line0[CORE_CACHE_LINE]; };
+    union { _Atomic size_t dequeue_pos; char _line1[CORE_CACHE_LINE]; };
+    union { struct { size_t cap; _Atomic size_t *sequence; Allocator alloc; }; char _line2[CORE_CACHE_LINE]; };
+}MpmcQueueHeader;
+
+void *core_spsc_queue_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg);
+size_t core_spsc_queue_push_internal(void *queue, const void *items, size_t count, size_t elem_size);
+size_t core_spsc_queue_pop_internal(void *queue, void *out, size_t count, size_t elem_size);
+size_t core_spsc_queue_len_internal(void *queue);
+void *core_mpmc_queue_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg);
+size_t core_mpmc_queue_push_internal(void *queue, const void *items, size_t count, size_t elem_size);
+size_t core_mpmc_queue_pop_internal(void *queue, void *out, size_t count, size_t elem_size);
+size_t core_mpmc_queue_len_internal(void *queue);
+void core_queue_destroy_internal(void *header, Allocator alloc);
+
+#define spsc_queue_header(q) ((SpscQueueHeader *)(q) - 1)
+#define mpmc_queue_header(q) ((MpmcQueueHeader *)(q) - 1)
+
+//  exactly one thread pushes and one thread pops
+#define SpscQueue(type) type *
+#define spsc_queue_new(ty, capacity, ...) ((ty *)core_spsc_queue_create_internal((capacity), sizeof(ty), (OptAllocArg){__VA_ARGS__}))
+#define spsc_queue_destroy(q) (core_queue_destroy_internal(spsc_queue_header((q)), spsc_queue_header((q))->alloc), (q) = NULL)
+//  false if the queue is full
+#define spsc_queue_push(q, value) (core_spsc_queue_push_internal((q), (__typeof__(*(q))[1]){(value)}, 1, sizeof(*(q))) == 1)
+//  false if the queue is empty
+#define spsc_queue_pop(q, out) (core_spsc_queue_pop_internal((q), (out), 1, sizeof(*(q))) == 1)
+//  push/pop as many as fit, return how many were moved
+#define spsc_queue_push_batch(q, items, count) core_spsc_queue_push_internal((q), (items), (count), sizeof(*(q)))
+#define spsc_queue_pop_batch(q, out, count) core_spsc_queue_pop_internal((q), (out), (count), sizeof(*(q)))
+//  exact for the producer/consumer, a snapshot for anyone else
+#define spsc_queue_len(q) core_spsc_queue_len_internal((q))
+#define spsc_queue_cap(q) (spsc_queue_header((q))->cap)
+
+//  any number of threads push and pop
+#define MpmcQueue(type) type *
+#define mpmc_queue_new(ty, capacity, ...) ((ty *)core_mpmc_queue_create_internal((capacity), sizeof(ty), (OptAllocArg){__VA_ARGS__}))
+#define mpmc_queue_destroy(q) (core_queue_destroy_internal(mpmc_queue_header((q)), mpmc_queue_header((q))->alloc), (q) = NULL)
+#define mpmc_queue_push(q, value) (core_mpmc_queue_push_internal((q), (__typeof__(*(q))[1]){(value)}, 1, sizeof(*(q))) == 1)
+#define mpmc_queue_pop(q, out) (core_mpmc_queue_pop_internal((q), (out), 1, sizeof(*(q))) == 1)
+//  claims whole runs of slots with a single CAS
+#define mpmc_queue_push_batch(q, items, count) core_mpmc_queue_push_internal((q), (items), (count), sizeof(*(q)))
+#define mpmc_queue_pop_batch(q, out, count) core_mpmc_queue_pop_internal((q), (out), (count), sizeof(*(q)))
+#define mpmc_queue_len(q) core_mpmc_queue_len_internal((q))
+#define mpmc_queue_cap(q) (mpmc_queue_header((q))->cap)
+
 //  ----------------------------------- //
 //                slice                 //
 //  ----------------------------------- //
@@ -357,6 +723,313 @@ typedef struct _Slice {
 #define slice_from_vec(vec) (_Slice){ .data = vec, .len = vec_len(vec) }
 #define slice_to_vec(slice, ...) core_vec_create_from_parts_internal((slice).data, (slice).len, sizeof(*(slice).data), (OptAllocArg){__VA_ARGS__})
 
+Slice(char) file_mapping_slice(FileMapping const *self);
+
+//  ----------------------------------- //
+//                 soa                  //
+//  ----------------------------------- //
+//  struct of arrays, one column per field in a single allocation, e.g.
+//      #define PARTICLE_FIELDS(X) X(f32, x) X(f32, y) X(u32, id)
+//      SOA_DEFINE(Particles, particles, PARTICLE_FIELDS)
+//  generates `ParticlesRow`, `Particles` with the columns `x`, `y`, `id` and
+//  `particles_push`, `particles_remove`, ... the table is zero initialised or
+//  created with `soa_new(Particles, .allocator = ...)`
+#define SOA_COLUMN_ALIGN CORE_CACHE_LINE
+
+#define soa_new(ty, ...) ((ty){ .alloc = ALLOC_ARG_OR_DEF(((OptAllocArg){__VA_ARGS__})) })
+#define soa_len(self) ((self)->len)
+//  the column of `field` as a `Slice`, aligned to `SOA_COLUMN_ALIGN`
+#define soa_column(self, field) (_Slice){ .data = (self)->field, .len = (self)->len }
+
+#define _SOA_ALIGN_UP(x) (((x) + SOA_COLUMN_ALIGN - 1) & ~(size_t)(SOA_COLUMN_ALIGN - 1))
+#define _SOA_ROW_FIELD(type, field) type field;
+#define _SOA_COLUMN(type, field) type *field;
+#define _SOA_SIZE(type, field) _size = _SOA_ALIGN_UP(_size) + _cap * sizeof(type);
+#define _SOA_MOVE(type, field) \
+    _size = _SOA_ALIGN_UP(_size); \
+    if(self->len) memcpy(_base + _size, self->field, self->len * sizeof(type)); \
+    self->field = (type *)(_base + _size); \
+    _size += _cap * sizeof(type);
+#define _SOA_PUSH(type, field) self->field[self->len] = row.field;
+#define _SOA_GET(type, field) row.field = self->field[index];
+#define _SOA_SET(type, field) self->field[index] = row.field;
+#define _SOA_REMOVE(type, field) memmove(self->field + index, self->field + index + 1, (self->len - index - 1) * sizeof(type));
+#define _SOA_SWAP_REMOVE(type, field) self->field[index] = self->field[self->len - 1];
+
+#define SOA_DEFINE(name, prefix, FIELDS) \
+    typedef struct name##Row { FIELDS(_SOA_ROW_FIELD) } name##Row; \
+    typedef struct name { \
+        size_t len; \
+        size_t cap; \
+        Allocator alloc; \
+        void *block; \
+        FIELDS(_SOA_COLUMN) \
+    } name; \
+    static inline bool prefix##_reserve(name *self, size_t count) { \
+        if(count <= self->cap) return true; \
+        size_t _cap = self->cap ? self->cap : DEFAULT_INITIAL_VECTOR_SIZE; \
+        while(_cap < count) _cap *= 2; \
+        size_t _size = 0; \
+        FIELDS(_SOA_SIZE) \
+        if(!self->alloc.alloc) self->alloc = default_allocator; \
+        void *block = allocator_alloc(&self->alloc, _size + SOA_COLUMN_ALIGN); \
+        if(!block) return false; \
+        char *_base = (char *)_SOA_ALIGN_UP((ptr_t)block); \
+        _size = 0; \
+        FIELDS(_SOA_MOVE) \
+        if(self->block) allocator_free(&self->alloc, self->block); \
+        self->block = block; \
+        self->cap = _cap; \
+        return true; \
+    } \
+    static inline size_t prefix##_push(name *self, name##Row row) { \
+        if(self->len == self->cap && !prefix##_reserve(self, self->len + 1)) return (size_t)-1; \
+        FIELDS(_SOA_PUSH) \
+        return self->len++; \
+    } \
+    static inline name##Row prefix##_get(name *self, size_t index) { \
+        CORE_ASSERT(index < self->len); \
+        name##Row row; \
+        FIELDS(_SOA_GET) \
+        return row; \
+    } \
+    static inline void prefix##_set(name *self, size_t index, name##Row row) { \
+        CORE_ASSERT(index < self->len); \
+        FIELDS(_SOA_SET) \
+    } \
+    static inline bool prefix##_remove(name *self, size_t index) { \
+        if(index >= self->len) return false; \
+        FIELDS(_SOA_REMOVE) \
+        self->len--; \
+        return true; \
+    } \
+    static inline bool prefix##_swap_remove(name *self, size_t index) { \
+        if(index >= self->len) return false; \
+        FIELDS(_SOA_SWAP_REMOVE) \
+        self->len--; \
+        return true; \
+    } \
+    static inline void prefix##_clear(name *self) { \
+        self->len = 0; \
+    } \
+    static inline void prefix##_destroy(name *self) { \
+        if(self->block) allocator_free(&self->alloc, self->block); \
+        *self = (name){ .alloc = self->alloc }; \
+    }
+
+//  ----------------------------------- //
+//              file-reader             //
+//  ----------------------------------- //
+#ifndef FILE_READER_DEFAULT_SIZE
+#define FILE_READER_DEFAULT_SIZE CORE_KB(1024)
+#endif
+
+typedef struct OptFileReaderArg {
+    Allocator allocator;
+    size_t buffer_size;
+}OptFileReaderArg;
+
+//  reads with `read(2)` from the current position of `file`, the stdio
+//  buffer of `file` must not be used while the reader is alive
+typedef struct FileReader {
+    i32 fd;
+    char *buffer;
+    size_t cap;
+    size_t pos;
+    size_t len;
+    size_t scan;
+    bool eof;
+    bool error;
+    Allocator alloc;
+}FileReader;
+
+FileReader file_reader_new_impl(FileHandle file, OptFileReaderArg arg);
+#define file_reader_new(file, ...) file_reader_new_impl((file), (OptFileReaderArg){__VA_ARGS__})
+void file_reader_deinit(FileReader *self);
+//  the returned views are only valid until the next call on the reader
+bool file_reader_next_line(FileReader *self, StringView *line);
+bool file_reader_next_chunk(FileReader *self, size_t size, Slice(char) *chunk);
+
+//  ----------------------------------- //
+//              file-writer             //
+//  ----------------------------------- //
+#ifndef FILE_WRITER_DEFAULT_SIZE
+#define FILE_WRITER_DEFAULT_SIZE CORE_KB(1024)
+#endif
+
+typedef struct OptFileWriterArg {
+    Allocator allocator;
+    size_t buffer_size;
+}OptFileWriterArg;
+
+//  writes with `write(2)`/`writev(2)` at the current position of `file`
+typedef struct FileWriter {
+    i32 fd;
+    char *buffer;
+    size_t cap;
+    size_t len;
+    u64 written;
+    bool error;
+    Allocator alloc;
+}FileWriter;
+
+FileWriter file_writer_new_impl(FileHandle file, OptFileWriterArg arg);
+#define file_writer_new(file, ...) file_writer_new_impl((file), (OptFileWriterArg){__VA_ARGS__})
+//  flushes the remaining data, `file` stays open
+bool file_writer_deinit(FileWriter *self);
+//  all writes return the amount of bytes accepted or -1 once the writer hit an error
+i64 file_writer_write_raw(FileWriter *self, const void *data, size_t len);
+i64 file_writer_write(FileWriter *self, StringView data);
+i64 file_writer_printf(FileWriter *self, const char *fmt, ...) CORE_PRINTF_FORMAT(2, 3);
+i64 file_writer_vprintf(FileWriter *self, const char *fmt, va_list args);
+bool file_writer_flush(FileWriter *self);
+//  flush and `fdatasync` the data to disk
+bool file_writer_sync(FileWriter *self);
+
+//  ----------------------------------- //
+//               async-io               //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#define ASYNC_IO_DEFAULT_DEPTH 256
+#define ASYNC_IO_DEFAULT_WORKERS 4
+//  read/write at the current file position instead of `offset`
+#define ASYNC_OFFSET_CURRENT ((u64)-1)
+
+typedef enum AsyncOpKind {
+    ASYNC_OP_OPEN,
+    ASYNC_OP_READ,
+    ASYNC_OP_WRITE,
+    ASYNC_OP_CLOSE,
+}AsyncOpKind;
+
+struct AsyncRequest;
+typedef struct AsyncCompletion {
+    struct AsyncRequest *request;
+    //  fd for `ASYNC_OP_OPEN`, byte count for read/write, `-errno` on failure
+    i64 result;
+    void *user_data;
+}AsyncCompletion;
+
+typedef void (*AsyncCallback)(AsyncCompletion *completion);
+
+//  requests (and `path`/`buffer`) have to stay alive until they completed
+typedef struct AsyncRequest {
+    AsyncOpKind kind;
+    i32 fd;
+    const char *path;
+    i32 flags;
+    u32 mode;
+    void *buffer;
+    size_t len;
+    u64 offset;
+    //  completions without a callback are returned from `async_io_poll`/`async_io_wait`
+    AsyncCallback callback;
+    void *user_data;
+}AsyncRequest;
+
+typedef struct OptAsyncIOArg {
+    Allocator allocator;
+    u32 queue_depth;
+    u32 workers;
+    //  skip io_uring and always use the worker threads
+    bool no_uring;
+}OptAsyncIOArg;
+
+typedef struct AsyncIO AsyncIO;
+
+AsyncIO *async_io_new_impl(OptAsyncIOArg arg);
+#define async_io_new(...) async_io_new_impl((OptAsyncIOArg){__VA_ARGS__})
+//  waits for all requests in flight
+void async_io_destroy(AsyncIO *self);
+bool async_io_is_uring(AsyncIO const *self);
+u32 async_io_in_flight(AsyncIO const *self);
+//  returns the amount of requests queued, which is less then `count` if the queue is full
+size_t async_io_submit(AsyncIO *self, AsyncRequest *requests, size_t count);
+//  reaps finished requests without blocking, runs callbacks on the calling thread,
+//  returns the amount of completions stored in `out`
+size_t async_io_poll(AsyncIO *self, AsyncCompletion *out, size_t max);
+//  blocks until at least `min` requests finished (or none are left in flight),
+//  `min` counts requests with callbacks too, the return value only those in `out`
+size_t async_io_wait(AsyncIO *self, AsyncCompletion *out, size_t max, size_t min);
+#endif
+
+//  ----------------------------------- //
+//                fiber                 //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#define FIBER_DEFAULT_STACK_SIZE CORE_KB(256)
+//  finished stacks kept around for reuse
+#define FIBER_STACK_POOL_SIZE 256
+
+typedef void (*FiberFn)(void *arg);
+
+typedef struct OptFiberSchedulerArg {
+    Allocator allocator;
+    //  defaults to the number of cpus
+    u32 threads;
+    //  rounded up to whole pages, a guard page sits below every stack
+    size_t stack_size;
+    //  used by `fiber_await_io`, the scheduler creates its own if NULL
+    AsyncIO *io;
+}OptFiberSchedulerArg;
+
+typedef struct Fiber Fiber;
+typedef struct FiberScheduler FiberScheduler;
+
+//  stackful fibers multiplexed onto `threads` threads, fibers may resume on any of them
+FiberScheduler *fiber_scheduler_new_impl(OptFiberSchedulerArg arg);
+#define fiber_scheduler_new(...) fiber_scheduler_new_impl((OptFiberSchedulerArg){__VA_ARGS__})
+//  waits for every fiber to finish
+void fiber_scheduler_destroy(FiberScheduler *self);
+//  blocks until no fiber is left
+void fiber_scheduler_wait(FiberScheduler *self);
+bool fiber_spawn(FiberScheduler *self, FiberFn fn, void *arg);
+//  NULL outside of a fiber
+Fiber *fiber_current(void);
+void fiber_yield(void);
+//  suspends the current fiber until `fiber_wake`, may return early so wait on a condition in a loop
+void fiber_park(void);
+void fiber_wake(Fiber *fiber);
+//  submits `request` and suspends the current fiber until it completed, returns the
+//  completion result, `callback`/`user_data` of the request are overwritten
+i64 fiber_await_io(AsyncRequest *request);
+#endif
+
+//  ----------------------------------- //
+//                utf8                  //
+//  ----------------------------------- //
+#define UTF8_INVALID 0xFFFFFFFF
+#define UTF8_REPLACEMENT_CHAR 0xFFFD
+
+bool utf8_validate(StringView str);
+size_t utf8_count(StringView str);
+//  decodes one codepoint from `data`, returns `UTF8_INVALID` on malformed input (`advance` is then 1)
+u32 utf8_decode(const char *data, size_t len, size_t *advance);
+size_t utf8_encode(u32 cp, char out[4]);
+
+typedef struct Utf8Iter {
+    StringView str;
+    size_t index;
+}Utf8Iter;
+
+Utf8Iter utf8_iter(StringView str);
+//  malformed sequences are yielded as `UTF8_REPLACEMENT_CHAR`
+bool utf8_next(Utf8Iter *self, u32 *cp);
+
+//  the resulting vecs are not null terminated, but have space for one after `vec_len`
+Vec(u16) utf8_to_utf16_impl(StringView str, OptAllocArg arg);
+#define utf8_to_utf16(str, ...) utf8_to_utf16_impl((str), (OptAllocArg){__VA_ARGS__})
+Vec(u32) utf8_to_utf32_impl(StringView str, OptAllocArg arg);
+#define utf8_to_utf32(str, ...) utf8_to_utf32_impl((str), (OptAllocArg){__VA_ARGS__})
+Vec(wchar) utf8_to_wchar_impl(StringView str, OptAllocArg arg);
+#define utf8_to_wchar(str, ...) utf8_to_wchar_impl((str), (OptAllocArg){__VA_ARGS__})
+Vec(char) utf16_to_utf8_impl(const u16 *data, size_t len, OptAllocArg arg);
+#define utf16_to_utf8(data, len, ...) utf16_to_utf8_impl((data), (len), (OptAllocArg){__VA_ARGS__})
+Vec(char) utf32_to_utf8_impl(const u32 *data, size_t len, OptAllocArg arg);
+#define utf32_to_utf8(data, len, ...) utf32_to_utf8_impl((data), (len), (OptAllocArg){__VA_ARGS__})
+Vec(char) wchar_to_utf8_impl(const wchar *data, size_t len, OptAllocArg arg);
+#define wchar_to_utf8(data, len, ...) wchar_to_utf8_impl((data), (len), (OptAllocArg){__VA_ARGS__})
+
 //  ----------------------------------- //
 //                arena                 //
 //  ----------------------------------- //
@@ -399,13 +1072,283 @@ Allocator static_arena_allocator(StaticArena *self);
 
 void static_arena_print_stats(StaticArena *self);
 
+//  ----------------------------------- //
+//                 dir                  //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#define DIR_ITER_BUFFER_SIZE CORE_KB(32)
+
+typedef enum DirEntryKind {
+    DIR_ENTRY_UNKNOWN,
+    DIR_ENTRY_FILE,
+    DIR_ENTRY_DIR,
+    DIR_ENTRY_SYMLINK,
+    DIR_ENTRY_OTHER,
+}DirEntryKind;
+
+typedef struct DirEntry {
+    //  both point into the arena passed to the iterator/walker
+    StringView name;
+    StringView path;
+    DirEntryKind kind;
+    //  only filled by `dir_iter_stat` or `.stat = true`
+    u64 size;
+    i64 mtime;
+}DirEntry;
+
+typedef struct DirIter {
+    i32 fd;
+    StringView path;
+    Arena *arena;
+    size_t pos;
+    size_t len;
+    bool done;
+#ifndef __linux__
+    DIR *dir;
+#endif
+    _Alignas(8) char buffer[DIR_ITER_BUFFER_SIZE];
+}DirIter;
+
+bool dir_iter_open(DirIter *self, const char *path, Arena *arena);
+//  skips `.` and `..`
+bool dir_iter_next(DirIter *self, DirEntry *entry);
+bool dir_iter_stat(DirIter *self, DirEntry *entry);
+void dir_iter_close(DirIter *self);
+
+//  supports `*`, `?` and `[a-z]`/`[!a-z]` classes
+bool glob_match(StringView pattern, StringView str);
+
+typedef struct OptDirWalkArg {
+    Allocator allocator;
+    u32 threads;
+    //  glob matched against the file name
+    const char *pattern;
+    //  e.g. ".json"
+    const char *extension;
+    bool stat;
+    bool include_dirs;
+    //  0 means unlimited
+    u32 max_depth;
+}OptDirWalkArg;
+
+//  entries are unordered, their strings live in `arenas`
+//  both are empty if the walk could not be set up
+typedef struct DirWalk {
+    Vec(DirEntry) entries;
+    Vec(Arena) arenas;
+}DirWalk;
+
+DirWalk dir_walk_impl(const char *root, OptDirWalkArg arg);
+#define dir_walk(root, ...) dir_walk_impl((root), (OptDirWalkArg){__VA_ARGS__})
+void dir_walk_free(DirWalk *self);
+#endif
+
+//  ----------------------------------- //
+//              file-chunks             //
+//  ----------------------------------- //
+//  runs on a worker thread, `scratch` belongs to that worker and stays alive
+//  until every result has been merged
+typedef void *(*ChunkProcessFn)(StringView chunk, Arena *scratch, void *user_data);
+//  runs on the calling thread once per chunk, in file order
+typedef void (*ChunkMergeFn)(void *result, size_t index, void *user_data);
+
+typedef struct OptChunksArg {
+    Allocator allocator;
+    //  defaults to the number of cpus
+    u32 threads;
+    //  defaults to 4 per thread so uneven chunks still balance out
+    size_t chunks;
+    //  record separator, defaults to '\n'
+    char delimiter;
+}OptChunksArg;
+
+//  every chunk but the last ends right after a delimiter, empty chunks are dropped
+Vec(StringView) string_view_split_chunks_impl(StringView self, size_t count, char delimiter, OptAllocArg arg);
+#define string_view_split_chunks(self, count, delimiter, ...) string_view_split_chunks_impl((self), (count), (delimiter), (OptAllocArg){__VA_ARGS__})
+//  returns false if the bookkeeping could not be allocated, nothing is processed then
+bool string_view_process_chunks_impl(StringView self, ChunkProcessFn process, ChunkMergeFn merge, void *user_data, OptChunksArg arg);
+#define string_view_process_chunks(self, process, merge, user_data, ...) string_view_process_chunks_impl((self), (process), (merge), (user_data), (OptChunksArg){__VA_ARGS__})
+//  maps the file, returns false if that fails
+bool file_process_chunks_impl(FileHandle self, ChunkProcessFn process, ChunkMergeFn merge, void *user_data, OptChunksArg arg);
+#define file_process_chunks(self, process, merge, user_data, ...) file_process_chunks_impl((self), (process), (merge), (user_data), (OptChunksArg){__VA_ARGS__})
+
+//  ----------------------------------- //
+//             file-watcher             //
+//  ----------------------------------- //
+#ifdef __linux__
+typedef enum FileWatchKind {
+    FILE_WATCH_CREATED = 1 << 0,
+    FILE_WATCH_MODIFIED = 1 << 1,
+    FILE_WATCH_DELETED = 1 << 2,
+    FILE_WATCH_ATTRIB = 1 << 3,
+    //  the kernel queue overflowed and events were lost, rescan everything
+    FILE_WATCH_OVERFLOW = 1 << 4,
+}FileWatchKind;
+
+typedef struct FileWatchEvent {
+    //  id returned by `file_watcher_add`, -1 for `FILE_WATCH_OVERFLOW`
+    i32 watch;
+    //  watched path joined with `name`, both valid until the next batch
+    StringView path;
+    //  empty if the event is about the watched path itself
+    StringView name;
+    //  every `FileWatchKind` seen for this path during the batch
+    u32 kinds;
+}FileWatchEvent;
+
+typedef void (*FileWatchCallback)(FileWatchEvent const *events, size_t count, void *user_data);
+
+typedef struct OptFileWatcherArg {
+    Allocator allocator;
+    //  events for the same path within this window after the first one are merged
+    u32 coalesce_ms;
+    //  without a callback the last batch is left in `events`
+    FileWatchCallback callback;
+    void *user_data;
+}OptFileWatcherArg;
+
+typedef struct _FileWatch {
+    i32 wd;
+    char *path;
+    size_t len;
+}_FileWatch;
+
+typedef struct FileWatcher {
+    i32 fd;
+    FileWatchCallback callback;
+    void *user_data;
+    u32 coalesce_ms;
+    i64 batch_start;
+    Vec(FileWatchEvent) pending;
+    Vec(FileWatchEvent) events;
+    Vec(_FileWatch) watches;
+    //  strings of `pending` and `events`, swapped on every delivery
+    Arena arenas[2];
+    Allocator alloc;
+}FileWatcher;
+
+FileWatcher file_watcher_new_impl(OptFileWatcherArg arg);
+#define file_watcher_new(...) file_watcher_new_impl((OptFileWatcherArg){__VA_ARGS__})
+void file_watcher_deinit(FileWatcher *self);
+//  watches a file or the direct children of a directory, returns -1 on error
+i32 file_watcher_add(FileWatcher *self, const char *path);
+bool file_watcher_remove(FileWatcher *self, i32 watch);
+//  blocks until the coalesce window of a batch closes and delivers it like
+//  `file_watcher_poll_events`, returns false on error
+bool file_watcher_wait_events(FileWatcher *self);
+//  never blocks, returns true if a batch was delivered
+bool file_watcher_poll_events(FileWatcher *self);
+#endif
+
+//  ----------------------------------- //
+//             mapped-file              //
+//  ----------------------------------- //
+//  crc32c (castagnoli), start with 0 and feed the previous result to continue
+u32 crc32c(u32 crc, const void *data, size_t len);
+
+#ifdef PLATFORM_POSIX
+#define MAPPED_FILE_MIN_SIZE CORE_KB(64)
+
+//  shared read-write mapping of a whole file, `data` is NULL if opening failed
+typedef struct MappedFile {
+    i32 fd;
+    char *data;
+    //  bytes in use, the file is truncated back to this on close
+    size_t len;
+    //  size of the file and the mapping
+    size_t cap;
+    //  everything before this offset has been written back
+    size_t synced;
+}MappedFile;
+
+//  creates the file if needed, existing content is kept and counted in `len`
+MappedFile mapped_file_open(const char *path);
+void mapped_file_close(MappedFile *self);
+//  grows the file by doubling until `size` bytes fit, this may move `data`
+bool mapped_file_reserve(MappedFile *self, size_t size);
+//  returns room for `size` more bytes, only valid until the next grow
+void *mapped_file_append(MappedFile *self, size_t size);
+//  msync of everything appended since the last sync
+bool mapped_file_sync(MappedFile *self);
+
+typedef struct OptAppendLogArg {
+    //  sync once this many bytes are pending, 0 leaves it to `append_log_sync`
+    size_t sync_bytes;
+}OptAppendLogArg;
+
+//  8 byte magic followed by records of `u32 len, u32 crc32c(len, payload), payload`
+//  padded to 8 bytes, a torn tail is dropped when the log is opened again
+typedef struct AppendLog {
+    MappedFile file;
+    size_t sync_bytes;
+    u64 count;
+}AppendLog;
+
+typedef struct AppendLogIter {
+    const char *data;
+    size_t len;
+    size_t pos;
+}AppendLogIter;
+
+AppendLog append_log_open_impl(const char *path, OptAppendLogArg arg);
+#define append_log_open(path, ...) append_log_open_impl((path), (OptAppendLogArg){__VA_ARGS__})
+void append_log_close(AppendLog *self);
+bool append_log_append(AppendLog *self, const void *data, u32 len);
+bool append_log_sync(AppendLog *self);
+AppendLogIter append_log_iter(AppendLog const *self);
+//  for logs opened read-only with `file_map`
+AppendLogIter append_log_iter_mapping(FileMapping const *mapping);
+//  `record` points into the mapping, stops at the end or the first corrupt record
+bool append_log_next(AppendLogIter *iter, Slice(char) *record);
+#endif
+
+//  ----------------------------------- //
+//              magic-ring              //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+//  byte queue for one producer and one consumer, the storage is mapped twice back
+//  to back so every readable or writable region is contiguous across the wrap
+typedef struct MagicRing {
+    //  free running cursors, the offset into `data` is `cursor % cap`
+    union { _Atomic size_t head; char _line0[CORE_CACHE_LINE]; };
+    union { _Atomic size_t tail; char _line1[CORE_CACHE_LINE]; };
+    char *data;
+    //  a multiple of the page size, `data` spans twice that
+    size_t cap;
+}MagicRing;
+
+//  `capacity` is rounded up to whole pages, `data` is NULL if mapping failed
+MagicRing magic_ring_new(size_t capacity);
+void magic_ring_destroy(MagicRing *self);
+size_t magic_ring_len(MagicRing *self);
+size_t magic_ring_space(MagicRing *self);
+//  producer side, the free region to write into, made visible by `magic_ring_commit`
+Slice(char) magic_ring_write_slice(MagicRing *self);
+void magic_ring_commit(MagicRing *self, size_t len);
+//  consumer side, the readable region, released by `magic_ring_consume`
+Slice(char) magic_ring_read_slice(MagicRing *self);
+void magic_ring_consume(MagicRing *self, size_t len);
+//  copying versions, return how many bytes fit or were available
+size_t magic_ring_write(MagicRing *self, const void *data, size_t len);
+size_t magic_ring_read(MagicRing *self, void *out, size_t len);
+#endif
+
 //  ----------------------------------- //
 //                 print                //
 //  ----------------------------------- //
+#ifndef PRINT_BUFFER_SIZE
+#define PRINT_BUFFER_SIZE CORE_KB(64)
+#endif
+
+//  print/println/fprint/fprintln format stdout/stderr output into a per-thread buffer
+//  that is written once it fills up, after every line on a tty, after every call on
+//  stderr, at thread exit and at exit; call `print_flush` before writing to the same
+//  stream through stdio directly, other streams go through their stdio buffer
 i32 print(const char *fmt, ...) CORE_PRINTF_FORMAT(1, 2);
 i32 println(const char *fmt, ...) CORE_PRINTF_FORMAT(1, 2);
 i32 fprint(FileHandle stream, const char *fmt, ...) CORE_PRINTF_FORMAT(2, 3);
 i32 fprintln(FileHandle stream, const char *fmt, ...) CORE_PRINTF_FORMAT(2, 3);
+void print_flush(void);
 
 typedef enum LogLevel {
     CORE_TRACE,
@@ -415,10 +1358,130 @@ typedef enum LogLevel {
     CORE_ERROR,
 } LogLevel;
 
+//  calls below this level are compiled out together with their arguments
+#ifndef CORE_LOG_MIN_LEVEL
+#define CORE_LOG_MIN_LEVEL CORE_TRACE
+#endif
+
+//  runtime threshold for every file without a module override
+void log_level_set(LogLevel level);
+LogLevel log_level_get(void);
+//  `module` matches a `__FILE__` at path boundaries, e.g. "net/", "net/socket.c"
+//  or "socket", the longest matching module wins
+void log_level_set_module(const char *module, LogLevel level);
+void log_level_clear_module(const char *module);
+
+//  bumped whenever a threshold changes
+extern _Atomic u32 core_log_generation;
+//  per call site, holds `generation << 8 | level` of the last lookup for its file
+typedef _Atomic u64 LogLevelCache;
+bool core_log_resolve(LogLevelCache *cache, const char *file, LogLevel level);
+
+static inline bool core_log_enabled(LogLevelCache *cache, const char *file, LogLevel level) {
+    u64 cached = atomic_load_explicit(cache, memory_order_relaxed);
+    if((u32)(cached >> 8) != atomic_load_explicit(&core_log_generation, memory_order_relaxed)) {
+        return core_log_resolve(cache, file, level);
+    }
+    return (u32)level >= (u32)(cached & 0xFF);
+}
+//  same check through a small per-thread cache keyed by the `__FILE__` pointer,
+//  for callers that have to stay an expression and cannot own a cache
+bool core_log_enabled_file(const char *file, LogLevel level);
+
+//  `core_log`/`__core_log_file` themselves do not filter, the macros check the
+//  level before any argument is evaluated
 void core_log(LogLevel level, const char *fmt, ...) CORE_PRINTF_FORMAT(2, 3);
 void __core_log_file(LogLevel level, const char *file, const char *fmt, ...) CORE_PRINTF_FORMAT(3, 4);
-#define log core_log
-#define log_file(level, fmt, ...) __core_log_file(level, __FILE__, fmt, __VA_ARGS__)
+#define _CORE_LOG_FILTERED(level, call) do { \
+        if((i32)(level) >= (i32)CORE_LOG_MIN_LEVEL) { \
+            static LogLevelCache _core_log_cache = 0; \
+            if(core_log_enabled(&_core_log_cache, __FILE__, (level))) { \
+                call; \
+            } \
+        } \
+    } while(0)
+//  `log`/`log_file` stay expressions like the functions they used to expand to
+#define _CORE_LOG_CHECK(level) ((i32)(level) >= (i32)CORE_LOG_MIN_LEVEL && core_log_enabled_file(__FILE__, (level)))
+#define log(level, ...) (_CORE_LOG_CHECK(level) ? core_log((level), __VA_ARGS__) : (void)0)
+#define log_file(level, fmt, ...) (_CORE_LOG_CHECK(level) ? __core_log_file((level), __FILE__, (fmt), __VA_ARGS__) : (void)0)
+
+//  ----------------------------------- //
+//              log-async               //
+//  ----------------------------------- //
+#define LOG_ASYNC_DEFAULT_QUEUE_SIZE CORE_KB(64)
+#define LOG_ASYNC_DEFAULT_FLUSH_MS 20
+
+typedef enum LogOverflow {
+    //  the record is dropped and counted in `log_async_dropped`
+    LOG_OVERFLOW_DROP,
+    //  the logging thread waits for the writer to catch up
+    LOG_OVERFLOW_BLOCK,
+}LogOverflow;
+
+typedef struct OptLogAsyncArg {
+    //  defaults to stderr
+    FileHandle file;
+    //  per thread, rounded up to a power of two, records above a quarter of it are truncated
+    size_t queue_size;
+    LogOverflow overflow;
+    //  how long the writer batches records before writing them out
+    u32 flush_ms;
+    //  install SIGSEGV/SIGABRT/... handlers that drain the queues before chaining to the
+    //  previous handlers, off by default so handlers set up by the application stay untouched
+    bool signal_handlers;
+}OptLogAsyncArg;
+
+//  routes `core_log`/`log_file` through per-thread queues to a writer thread,
+//  the queues are drained at exit (and on crash signals with `signal_handlers`),
+//  threads that cannot allocate a queue log synchronously
+bool log_async_start_impl(OptLogAsyncArg arg);
+#define log_async_start(...) log_async_start_impl((OptLogAsyncArg){__VA_ARGS__})
+void log_async_stop(void);
+//  returns once everything logged before the call has been written
+void log_async_flush(void);
+u64 log_async_dropped(void);
+
+typedef enum LogArgKind {
+    LOG_ARG_NONE,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_INTMAX,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STRING,
+    LOG_ARG_INVALID,
+}LogArgKind;
+
+typedef struct LogSegment {
+    //  literal text followed by at most one conversion
+    char *fmt;
+    LogArgKind kind;
+    //  `*` width/precision ints in front of the value
+    u8 stars;
+    //  the precision comes from the last `*` int
+    bool precision_star;
+    //  literal precision, -1 without one
+    i32 precision;
+}LogSegment;
+
+//  per call site state of `log_fast`, the format is parsed on first use and
+//  records only carry the site pointer plus the raw arguments
+typedef struct LogSite {
+    _Atomic u32 state;
+    Vec(LogSegment) segments;
+}LogSite;
+
+//  formatting happens on the writer thread, strings are copied, without the async
+//  backend (or for `%n`, `%ls`, `%lc`) it formats in place like `core_log`
+void core_log_deferred(LogSite *site, LogLevel level, const char *fmt, ...) CORE_PRINTF_FORMAT(3, 4);
+#define log_fast(level, ...) _CORE_LOG_FILTERED((level), { \
+        static LogSite _core_log_site = {0}; \
+        core_log_deferred(&_core_log_site, (level), __VA_ARGS__); \
+    })
 /*
 //  ----------------------------------- //
 //                flags                 //
@@ -446,24 +1509,36 @@ typedef struct Allocation {
 
 void allocation_print(Allocation *self);
 
+//  one list for the whole process so blocks freed on another thread are matched,
+//  hold `lock` while walking `allocations` if other threads may still allocate
 typedef struct MemoryStats {
+    Mutex lock;
     Vec(Allocation) allocations;
 }MemoryStats;
+
+extern MemoryStats core_memory_stats;
 #endif
 
 typedef struct Context {
     Arena temp_arena;
     RingBuffer ring_buffer;
     //FlagContext *flag_context;
-    #ifdef CORE_MEM_DEBUG
-    MemoryStats memory_stats;
-    #endif
+    bool initialized;
 }Context;
 
-extern thread_local Context core_context;
+extern thread_local Context _core_context;
+Context *_core_context_init_thread(void);
+//  every thread gets its own context on first use, it is torn down when the thread exits
+static inline Context *context_get(void) {
+    return _core_context.initialized ? &_core_context : _core_context_init_thread();
+}
+#define core_context (*context_get())
 String tmp_printf(const char *fmt, ...) CORE_PRINTF_FORMAT(1, 2);
 StringView tmp_copy(StringView self);
 StringView tmp_copy_str(String *self);
+//  initialising is optional, tearing down early frees the scratch memory before the thread exits
+void context_thread_init(void);
+void context_thread_deinit(void);
 
 typedef struct Bitmap {
     char *data;
@@ -481,6 +1556,108 @@ Bitmap bitmap_from_impl(const char *data, size_t width, size_t height, size_t st
 const void *bitmap_at(Bitmap *self, size_t x, size_t y);
 void bitmap_put(Bitmap *self, size_t x, size_t y, void *data);
 
+//  ----------------------------------- //
+//             thread-pool              //
+//  ----------------------------------- //
+#define THREAD_POOL_DEFAULT_DEQUE_SIZE 4096
+
+typedef void (*TaskFn)(void *arg);
+
+//  counts the unfinished tasks spawned into it, zero initialise before use
+typedef struct TaskGroup {
+    _Atomic size_t pending;
+}TaskGroup;
+
+typedef struct OptThreadPoolArg {
+    Allocator allocator;
+    //  defaults to the number of cpus
+    u32 threads;
+    //  per worker, spawning into a full deque runs the task inline
+    size_t deque_size;
+}OptThreadPoolArg;
+
+typedef struct ThreadPool ThreadPool;
+
+//  every worker owns a Chase-Lev deque, idle workers steal from the others and
+//  go to sleep once there is nothing left
+//  NULL if not a single worker could be started
+ThreadPool *thread_pool_new_impl(OptThreadPoolArg arg);
+#define thread_pool_new(...) thread_pool_new_impl((OptThreadPoolArg){__VA_ARGS__})
+//  runs whatever is still queued, must not be called from one of its workers
+void thread_pool_destroy(ThreadPool *self);
+//  created on first use, used wherever a NULL pool is passed, NULL if it could not
+//  be started, spawned tasks and parallel loops then run on the calling thread
+ThreadPool *thread_pool_global(void);
+//  0 if there is no pool to run on
+u32 thread_pool_threads(ThreadPool *self);
+//  `group` may be NULL, tasks spawned on a worker go to its own deque
+void thread_pool_spawn(ThreadPool *self, TaskGroup *group, TaskFn fn, void *arg);
+//  runs queued tasks on the calling thread until every task of `group` is done
+void thread_pool_wait(ThreadPool *self, TaskGroup *group);
+
+typedef struct OptParallelArg {
+    //  smallest range handed to one task, 0 picks one based on the pool size
+    size_t grain;
+}OptParallelArg;
+
+typedef void (*ParallelForFn)(size_t begin, size_t end, void *user_data);
+typedef void (*ParallelEachFn)(void *item, size_t index, void *user_data);
+//  folds [begin, end) into `acc`, which starts out as a copy of `*result`
+typedef void (*ParallelReduceFn)(size_t begin, size_t end, void *acc, void *user_data);
+//  folds `other` into `acc`, the partial results are combined in index order
+typedef void (*ParallelCombineFn)(void *acc, const void *other, void *user_data);
+
+//  the range is split in halves until it is below the grain size, the calling
+//  thread works on it as well, without a pool or memory for the splits it runs serially
+void parallel_for_impl(ThreadPool *pool, size_t begin, size_t end, ParallelForFn fn, void *user_data, OptParallelArg arg);
+#define parallel_for(pool, begin, end, fn, user_data, ...) parallel_for_impl((pool), (begin), (end), (fn), (user_data), (OptParallelArg){__VA_ARGS__})
+void parallel_for_each_impl(ThreadPool *pool, void *data, size_t len, size_t elem_size, ParallelEachFn fn, void *user_data, OptParallelArg arg);
+#define parallel_for_vec(pool, vec, fn, user_data, ...) parallel_for_each_impl((pool), (vec), vec_len((vec)), sizeof(*(vec)), (fn), (user_data), (OptParallelArg){__VA_ARGS__})
+#define parallel_for_slice(pool, ty, slice, fn, user_data, ...) parallel_for_each_impl((pool), (slice).data, (slice).len, sizeof(ty), (fn), (user_data), (OptParallelArg){__VA_ARGS__})
+//  `*result` holds the identity on entry and the combined value on return
+void parallel_reduce_impl(ThreadPool *pool, size_t begin, size_t end, void *result, size_t result_size, ParallelReduceFn fn, ParallelCombineFn combine, void *user_data, OptParallelArg arg);
+#define parallel_reduce(pool, begin, end, result, fn, combine, user_data, ...) parallel_reduce_impl((pool), (begin), (end), (result), sizeof(*(result)), (fn), (combine), (user_data), (OptParallelArg){__VA_ARGS__})
+
+//  ----------------------------------- //
+//                 job                  //
+//  ----------------------------------- //
+//  `deps` holds the results of the jobs this one depends on, in the order they were added
+typedef void *(*JobFn)(void **deps, size_t count, void *user_data);
+
+typedef enum JobFlags {
+    //  blocking work, runs on the io pool so it overlaps with cpu jobs
+    JOB_IO = 1 << 0,
+}JobFlags;
+
+typedef struct OptJobArg {
+    Allocator allocator;
+    //  defaults to the global pool, or the global io pool for `JOB_IO`
+    ThreadPool *pool;
+    JobFlags flags;
+}OptJobArg;
+
+typedef struct Job Job;
+
+//  a job with a NULL `fn` only joins its dependencies and results in NULL,
+//  returns NULL if the job cannot be allocated
+Job *job_new_impl(JobFn fn, void *user_data, OptJobArg arg);
+#define job_new(fn, user_data, ...) job_new_impl((fn), (user_data), (OptJobArg){__VA_ARGS__})
+//  must be called before `self` is submitted, returns false and leaves both jobs
+//  untouched if the edge cannot be allocated
+bool job_depends_on(Job *self, Job *dep);
+//  `self` runs as soon as all of its dependencies finished
+void job_submit(Job *self);
+//  creates and submits a job depending only on `self`, NULL if that fails
+Job *job_then_impl(Job *self, JobFn fn, void *user_data, OptJobArg arg);
+#define job_then(self, fn, user_data, ...) job_then_impl((self), (fn), (user_data), (OptJobArg){__VA_ARGS__})
+bool job_is_done(Job *self);
+//  runs queued tasks on the calling thread until `self` finished, returns its result
+void *job_wait(Job *self);
+//  drops the handle, the job still runs if it was submitted
+void job_release(Job *self);
+//  shared pool for `JOB_IO` jobs, sized for threads that spend their time blocked
+ThreadPool *thread_pool_global_io(void);
+
 //  ----------------------------------- //
 //                json                  //
 //  ----------------------------------- //
@@ -725,6 +1902,25 @@ String string_from_parts_impl(const char *ptr, size_t len, size_t cap, OptAllocA
     return str;
 }
 
+String string_adopt_impl(char *ptr, size_t len, size_t cap, OptAllocArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    if(cap > SHORT_STRING_LENGTH) {
+        return (String){
+            .alloc = alloc,
+            .type = STRING_LONG,
+            .data.l.ptr = ptr,
+            .data.l.len = len,
+            .data.l.cap = cap,
+        };
+    }
+    String str = { .alloc = alloc, .type = STRING_SHORT };
+    str.data.s.data[23] = SHORT_STRING_LENGTH - len;
+    memcpy(str.data.s.data, ptr, len);
+    str.data.s.data[len] = '\0';
+    allocator_free(&alloc, ptr);
+    return str;
+}
+
 String string_format(const char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -942,9 +2138,17 @@ Allocator std_alloc = {
     .free = _std_free,
 };
 
+MemoryStats core_memory_stats = {0};
+
+//  called with `core_memory_stats.lock` held, an address can come back after it was
+//  freed so the newest live record is the one that counts
 static Allocation *_core_allocation_find(void *addr) {
-    vec_foreach(core_context.memory_stats.allocations, alloc) {
-        if(alloc->addr == addr) {
+    if(!core_memory_stats.allocations) {
+        core_memory_stats.allocations = vec_new(.allocator = std_alloc);
+    }
+    for(size_t i = vec_len(core_memory_stats.allocations); i > 0; i--) {
+        Allocation *alloc = &core_memory_stats.allocations[i - 1];
+        if(alloc->addr == addr && !alloc->freed_at.line) {
             return alloc;
         }
     }
@@ -953,12 +2157,14 @@ static Allocation *_core_allocation_find(void *addr) {
 
 void *allocator_alloc_debug(Allocator *self, size_t size, size_t line, const char *file) {
     if(self->self == CORE_DEBUG_ALLOCATOR_MARKER) {
-        if(!core_context.memory_stats.allocations) {
-            core_context.memory_stats.allocations = vec_new(.allocator = std_alloc);
-        }
         auto alloc = self->alloc(self->self, size);
         Allocation a = {alloc, size, line, sv(file), .freed_at = {}};
-        vec_push(core_context.memory_stats.allocations, a);
+        mutex_lock(&core_memory_stats.lock);
+        if(!core_memory_stats.allocations) {
+            core_memory_stats.allocations = vec_new(.allocator = std_alloc);
+        }
+        vec_push(core_memory_stats.allocations, a);
+        mutex_unlock(&core_memory_stats.lock);
         return alloc;
     }
     return self->alloc(self->self, size);
@@ -966,9 +2172,7 @@ void *allocator_alloc_debug(Allocator *self, size_t size, size_t line, const cha
 
 void *allocator_realloc_debug(Allocator *self, void *mem, size_t size, size_t line, const char *file) {
     if(self->self == CORE_DEBUG_ALLOCATOR_MARKER) {
-        if(!core_context.memory_stats.allocations) {
-            core_context.memory_stats.allocations = vec_new(.allocator = std_alloc);
-        }
+        mutex_lock(&core_memory_stats.lock);
         Allocation *alloc = _core_allocation_find(mem);
         void *new = self->realloc(self->self, mem, size);
         if(alloc) {
@@ -977,6 +2181,7 @@ void *allocator_realloc_debug(Allocator *self, void *mem, size_t size, size_t li
             alloc->file = sv_from(file);
             alloc->line = line;
         }
+        mutex_unlock(&core_memory_stats.lock);
         return new;
     }
     return self->realloc(self->self, mem, size);
@@ -984,14 +2189,15 @@ void *allocator_realloc_debug(Allocator *self, void *mem, size_t size, size_t li
 
 void allocator_free_debug(Allocator *self, void *_block, size_t line, const char *file) {
     if(self->self == CORE_DEBUG_ALLOCATOR_MARKER) {
-        if(!core_context.memory_stats.allocations) {
-            core_context.memory_stats.allocations = vec_new(.allocator = std_alloc);
-        }
+        //  marked before the block is released, once it is gone another thread may get
+        //  the same address and push its own record
+        mutex_lock(&core_memory_stats.lock);
         Allocation *alloc = _core_allocation_find(_block);
         if(alloc) {
             alloc->freed_at.file = sv_from(file);
             alloc->freed_at.line = line;
         }
+        mutex_unlock(&core_memory_stats.lock);
     }
     self->free(self->self, _block);
 }
@@ -1054,47 +2260,128 @@ Allocator default_allocator = {
     return ;
 }*/
 
-RingBuffer ringbuffer_init_impl(OptAllocArg args) {
+typedef struct _RingBufferHeader {
+    size_t size;
+    //  position in the ring counted over all laps, `lap | _RINGBUFFER_LARGE` for heap blocks
+    u64 stamp;
+}_RingBufferHeader;
+
+#define _RINGBUFFER_ALIGN 16
+#define _RINGBUFFER_LARGE ((u64)1 << 63)
+
+RingBuffer ringbuffer_init_impl(OptRingBufferArg args) {
     Allocator alloc = ALLOC_ARG_OR_DEF(args);
+    size_t size = args.size ? args.size : RINGBUFFER_SIZE;
+    size = (size + _RINGBUFFER_ALIGN - 1) & ~(size_t)(_RINGBUFFER_ALIGN - 1);
     return (RingBuffer) {
-        .base = allocator_alloc(&alloc, RINGBUFFER_SIZE),
-        .size = RINGBUFFER_SIZE,
+        .base = allocator_alloc(&alloc, size),
+        .size = size,
         .write_pos = 0,
         .alloc = alloc,
     };
 }
 
+static void _ringbuffer_free_large(RingBuffer *self, size_t index) {
+    if(!self->large[index]) {
+        return;
+    }
+    vec_foreach(self->large[index], block) {
+        allocator_free(&self->alloc, *block);
+    }
+    vec_clear(self->large[index]);
+}
+
 void ringbuffer_deinit(RingBuffer *self) {
     if(!self->base) {
         return;
     }
+    for(size_t i = 0; i < CORE_ARRLEN(self->large); i++) {
+        if(self->large[i]) {
+            _ringbuffer_free_large(self, i);
+            vec_destroy(self->large[i]);
+        }
+    }
     allocator_free(&self->alloc, self->base);
+    *self = (RingBuffer){ .size = self->size, .alloc = self->alloc };
+}
+
+static void _ringbuffer_wrap(RingBuffer *self) {
+    self->lap++;
+    self->write_pos = 0;
+    self->large_bytes = 0;
+    _ringbuffer_free_large(self, self->lap % 2);
 }
 
 void *ringbuffer_alloc(RingBuffer *self, size_t size) {
-    if(!self || (self && self->base == NULL)) {
-        *self = ringbuffer_init(.allocator = self->alloc);
+    if(self->base == NULL) {
+        *self = ringbuffer_init(.allocator = self->alloc, .size = self->size);
     }
 
-    if(size > self->size) {
-        log(CORE_ERROR, "size = %zu, self->size = %zu", size, self->size);
-        CORE_ASSERT(false && "ringbuffer tried to allocate more then self->size");
-        return NULL;
+    size_t total = sizeof(_RingBufferHeader) + ((size + _RINGBUFFER_ALIGN - 1) & ~(size_t)(_RINGBUFFER_ALIGN - 1));
+    _RingBufferHeader *header = NULL;
+    if(total > self->size / 4) {
+        header = allocator_alloc(&self->alloc, sizeof(_RingBufferHeader) + size);
+        if(!header) {
+            return NULL;
+        }
+        *header = (_RingBufferHeader){ .size = size, .stamp = self->lap | _RINGBUFFER_LARGE };
+        size_t index = self->lap % 2;
+        if(!self->large[index]) {
+            self->large[index] = vec_new(.allocator = self->alloc);
+        }
+        vec_push(self->large[index], (void *)header);
+        //  heap blocks count towards the lap as well so they cannot pile up
+        self->large_bytes += size;
+        if(self->large_bytes > self->size * 4) {
+            _ringbuffer_wrap(self);
+        }
+        return header + 1;
     }
 
-    if((char*)self->base + self->write_pos + size > (char*)self->base + self->size) {
+    if(self->write_pos + total > self->size) {
         log(CORE_DEBUG, "reset ringbuffer");
-        self->write_pos = 0;
+        _ringbuffer_wrap(self);
     }
 
-    void *alloc = (char*)self->base + self->write_pos;
-    self->write_pos += size;
-    return alloc;
+    header = (_RingBufferHeader *)((char*)self->base + self->write_pos);
+    *header = (_RingBufferHeader){ .size = size, .stamp = self->lap * self->size + self->write_pos };
+    self->write_pos += total;
+    return header + 1;
+}
+
+bool ringbuffer_is_live(RingBuffer const *self, const void *ptr) {
+    if(!self->base || !ptr) {
+        return false;
+    }
+    const _RingBufferHeader *header = (const _RingBufferHeader *)ptr - 1;
+    const char *base = self->base;
+    if((const char *)header >= base && (const char *)header < base + self->size) {
+        u64 offset = (u64)((const char *)header - base);
+        u64 position = self->lap * self->size + self->write_pos;
+        //  the writer overwrites the allocation once it got a full ring ahead of it
+        return header->stamp % self->size == offset && header->stamp < position && position <= header->stamp + self->size;
+    }
+    for(size_t i = 0; i < CORE_ARRLEN(self->large); i++) {
+        if(!self->large[i]) {
+            continue;
+        }
+        vec_foreach(self->large[i], block) {
+            if(*block == header) {
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 static void *_ringbuffer_realloc(RingBuffer *self, void *mem, size_t size) {
-    CORE_UNUSED(mem);
-    return ringbuffer_alloc(self, size);
+    void *new = ringbuffer_alloc(self, size);
+    if(mem && new) {
+        size_t old_size = ((_RingBufferHeader *)mem - 1)->size;
+        //  after a wrap the new block can overlap the old one
+        memmove(new, mem, old_size < size ? old_size : size);
+    }
+    return new;
 }
 
 Allocator ringbuffer_allocator(RingBuffer *self) {
@@ -1107,7 +2394,7 @@ Allocator ringbuffer_allocator(RingBuffer *self) {
 }
 
 void ringbuffer_print_stats(RingBuffer *self) {
-    println("Ringbuffer { base: %p, size: %zu, write_pos: %zu }", self->base, self->size, self->write_pos);
+    println("Ringbuffer { base: %p, size: %zu, write_pos: %zu, lap: %llu, large_bytes: %zu }", self->base, self->size, self->write_pos, (unsigned long long)self->lap, self->large_bytes);
 }
 
 //  ----------------------------------- //
@@ -1115,22 +2402,21 @@ void ringbuffer_print_stats(RingBuffer *self) {
 //  ----------------------------------- //
 static String mode_to_string(FileMode_ mode) {
     String buffer = string_new_size(20, .allocator = scratch_allocator(&core_context.ring_buffer));
-    switch (mode) {
-        case FILE_READ: {
-            string_pushf(&buffer, "%s", "r");
-        } break;
-        case FILE_APPEND: {
-            string_pushf(&buffer, "%s", "a");
-        } break;
-        case FILE_WRITE: {
-            string_pushf(&buffer, "%s", "w");
-        } break;
-        case FILE_PLUS: {
-            string_pushf(&buffer, "%s", "+");
-        } break;
-        case FILE_BIN: {
-            string_pushf(&buffer, "%s", "b");
-        } break;
+    if(FLAG_HAS(mode, FILE_APPEND)) {
+        string_push(&buffer, 'a');
+    }else if(FLAG_HAS(mode, FILE_READ) && FLAG_HAS(mode, FILE_WRITE) && !FLAG_HAS(mode, FILE_TRUNCATE)) {
+        //  read+write access keeps the contents
+        string_push(&buffer, 'r');
+    }else if(FLAG_HAS(mode, FILE_WRITE)) {
+        string_push(&buffer, 'w');
+    }else {
+        string_push(&buffer, 'r');
+    }
+    if(FLAG_HAS(mode, FILE_PLUS) || (FLAG_HAS(mode, FILE_READ) && FLAG_HAS(mode, FILE_WRITE | FILE_APPEND))) {
+        string_push(&buffer, '+');
+    }
+    if(FLAG_HAS(mode, FILE_BIN)) {
+        string_push(&buffer, 'b');
     }
     return buffer;
 }
@@ -1149,12 +2435,17 @@ FileHandle file_open_impl(const char *path, FileMode_ mode, OptAllocArg arg) {
         .alloc = alloc,
     };
     if(!self->fd) {
+        string_destroy(&self->path);
+        allocator_free(&alloc, self);
         return NULL;
     }
     return self;
 }
 
+static void _print_release_stream(FILE *stream);
+
 void file_close(FileHandle self) {
+    _print_release_stream(self->fd);
     fclose(self->fd);
     allocator_free(&self->alloc, self);
     self = NULL;
@@ -1164,6 +2455,14 @@ void *file_raw(FileHandle self) {
     return self->fd;
 }
 
+static i32 _core_file_fd(FileHandle self) {
+#ifdef PLATFORM_WIN32
+    return _fileno(self->fd);
+#else
+    return fileno(self->fd);
+#endif
+}
+
 String file_read_impl(FileHandle self, OptAllocArg arg) {
     Allocator alloc = ALLOC_ARG_OR_DEF(arg);
     fseek(self->fd, 0, SEEK_END);
@@ -1172,53 +2471,148 @@ String file_read_impl(FileHandle self, OptAllocArg arg) {
     char *content = allocator_alloc(&alloc, (size + 1) * sizeof(char));
     if(!content)
         return string_new(.allocator = alloc);
-    fread(content, sizeof(char), size, self->fd);
+    size = fread(content, sizeof(char), size, self->fd);
     content[size] = '\0';
-    String str = string_from_parts(content, size, size + 1, .allocator = alloc);
-    allocator_free(&alloc, content);
-    return str;
+    return string_adopt(content, size, size + 1, .allocator = alloc);
 }
 
 Vec(char) file_read_binary_impl(FileHandle self, OptAllocArg arg) {
-    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
     fseek(self->fd, 0, SEEK_END);
     size_t size = ftell(self->fd);
     rewind(self->fd);
-    char *content = allocator_alloc(&alloc, (size + 1) * sizeof(char));
-    if(!content)
-        return vec_new(.allocator = alloc);
-    fread(content, sizeof(char), size, self->fd);
-    Vec(char) vec = vec_from_parts(char, content, size, .allocator = alloc);
-    allocator_free(&alloc, content);
+    Vec(char) vec = vec_with_size(char, size, .allocator = arg.allocator);
+    vec_len(vec) = fread(vec, sizeof(char), size, self->fd);
     return vec;
 }
 
-bool file_write_raw(FileHandle self, const char *data, size_t len) {
-    fwrite(data, sizeof(char), len, self->fd);
-    return ferror(self->fd) != 0;
+static FileMapping _file_map_fd(i32 fd, OptFileMapArg arg) {
+    FileMapping self = {0};
+#ifdef PLATFORM_WIN32
+    CORE_UNUSED(arg);
+    HANDLE file = (HANDLE)_get_osfhandle(fd);
+    LARGE_INTEGER size;
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        return self;
+    }
+    self.size = (size_t)size.QuadPart;
+    if(self.size == 0) {
+        self.data = (void *)"";
+        return self;
+    }
+    self.handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!self.handle) {
+        return (FileMapping){0};
+    }
+    self.data = MapViewOfFile(self.handle, FILE_MAP_READ, 0, 0, 0);
+    if(!self.data) {
+        CloseHandle(self.handle);
+        return (FileMapping){0};
+    }
+#else
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        return self;
+    }
+    self.size = (size_t)st.st_size;
+    if(self.size == 0) {
+        self.data = (void *)"";
+        return self;
+    }
+    i32 flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if(arg.populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    self.data = mmap(NULL, self.size, PROT_READ, flags, fd, 0);
+    if(self.data == MAP_FAILED) {
+        return (FileMapping){0};
+    }
+    switch(arg.advice) {
+        case FILE_MAP_SEQUENTIAL: {
+            madvise(self.data, self.size, MADV_SEQUENTIAL);
+            madvise(self.data, self.size, MADV_WILLNEED);
+        } break;
+        case FILE_MAP_RANDOM: {
+            madvise(self.data, self.size, MADV_RANDOM);
+        } break;
+        case FILE_MAP_NORMAL: break;
+    }
+#endif
+    return self;
 }
 
-bool file_write(FileHandle self, const StringView data) {
-    return file_write_raw(self, data.data, data.len);
+FileMapping file_map_impl(FileHandle self, OptFileMapArg arg) {
+    fflush(self->fd);
+    return _file_map_fd(_core_file_fd(self), arg);
 }
 
-bool file_exists(const StringView path) {
-    FILE *fd = fopen(path.data, "r");
-    if(fd) {
-        fclose(fd);
-        return true;
+FileMapping file_map_path_impl(const char *path, OptFileMapArg arg) {
+#ifdef PLATFORM_WIN32
+    i32 fd = _open(path, _O_RDONLY | _O_BINARY);
+#else
+    i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+    if(fd < 0) {
+        return (FileMapping){0};
     }
-    return false;
+    //  the mapping keeps the pages alive, the descriptor is not needed anymore
+    FileMapping self = _file_map_fd(fd, arg);
+#ifdef PLATFORM_WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+    return self;
 }
 
-
-String file_read_to_string_impl(const char *path, OptAllocArg arg) {
-    FileHandle file = file_open(path, FILE_READ, .allocator = arg.allocator);
-#ifndef CORE_DEBUG
+void file_unmap(FileMapping *self) {
+    if(self->data && self->size > 0) {
+#ifdef PLATFORM_WIN32
+        UnmapViewOfFile(self->data);
+        CloseHandle(self->handle);
+#else
+        munmap(self->data, self->size);
+#endif
+    }
+    *self = (FileMapping){0};
+}
+
+StringView file_mapping_view(FileMapping const *self) {
+    return string_view_new(self->data, self->size);
+}
+
+Slice(char) file_mapping_slice(FileMapping const *self) {
+    return (_Slice){ .data = self->data, .len = self->size };
+}
+
+bool file_write_raw(FileHandle self, const char *data, size_t len) {
+    size_t written = fwrite(data, sizeof(char), len, self->fd);
+    return written == len && ferror(self->fd) == 0;
+}
+
+bool file_write(FileHandle self, const StringView data) {
+    return file_write_raw(self, data.data, data.len);
+}
+
+bool file_exists(const StringView path) {
+    FILE *fd = fopen(path.data, "r");
+    if(fd) {
+        fclose(fd);
+        return true;
+    }
+    return false;
+}
+
+
+String file_read_to_string_impl(const char *path, OptAllocArg arg) {
+    FileHandle file = file_open(path, FILE_READ, .allocator = arg.allocator);
     if(!file) {
+#ifndef CORE_DEBUG
         fprintf(stderr, "[INFO]: failed to open file `%s`", path);
-    }
 #endif
+        return string_new(.allocator = arg.allocator);
+    }
     String content = file_read(file, .allocator = arg.allocator);
     file_close(file);
     return content;
@@ -1226,16 +2620,125 @@ String file_read_to_string_impl(const char *path, OptAllocArg arg) {
 
 Vec(char) file_read_to_vec_impl(const char *path, OptAllocArg arg) {
     FileHandle file = file_open(path, FILE_READ | FILE_BIN, .allocator = arg.allocator);
-#ifndef CORE_DEBUG
     if(!file) {
+#ifndef CORE_DEBUG
         fprintf(stderr, "[INFO]: failed to open file `%s`", path);
-    }
 #endif
+        return vec_new(.allocator = arg.allocator);
+    }
     Vec(char) content = file_read_binary(file, .allocator = arg.allocator);
     file_close(file);
     return content;
 }
 
+static u32 _core_cpu_count(void) {
+#ifdef PLATFORM_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (u32)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+#endif
+}
+
+static i64 _core_read(i32 fd, void *buffer, size_t len) {
+#ifdef PLATFORM_WIN32
+    return _read(fd, buffer, (u32)(len > INT32_MAX ? INT32_MAX : len));
+#else
+    for(;;) {
+        ssize_t n = read(fd, buffer, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n;
+    }
+#endif
+}
+
+static bool _core_write_all(i32 fd, const char *data, size_t len) {
+    while(len > 0) {
+#ifdef PLATFORM_WIN32
+        i64 n = _write(fd, data, (u32)(len > INT32_MAX ? INT32_MAX : len));
+#else
+        ssize_t n = write(fd, data, len);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if(n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool _core_fd_is_regular(i32 fd) {
+#ifdef PLATFORM_WIN32
+    return GetFileType((HANDLE)_get_osfhandle(fd)) == FILE_TYPE_DISK;
+#else
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+}
+
+static i64 _core_fd_tell(i32 fd) {
+#ifdef PLATFORM_WIN32
+    return _lseeki64(fd, 0, SEEK_CUR);
+#else
+    return lseek(fd, 0, SEEK_CUR);
+#endif
+}
+
+//  ftell/fseek with 64 bit offsets, `long` is 32 bits on windows
+static i64 _core_ftell(FILE *file) {
+#ifdef PLATFORM_WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+}
+
+static bool _core_fseek(FILE *file, i64 offset) {
+#ifdef PLATFORM_WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+#ifdef PLATFORM_POSIX
+static bool _core_writev_all(i32 fd, const char *head, size_t head_len, const char *tail, size_t tail_len) {
+    struct iovec iov[2] = {
+        { .iov_base = (void *)head, .iov_len = head_len },
+        { .iov_base = (void *)tail, .iov_len = tail_len },
+    };
+    struct iovec *cur = head_len ? iov : iov + 1;
+    i32 count = head_len ? 2 : 1;
+    while(count > 0) {
+        ssize_t n = writev(fd, cur, count);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return false;
+        }
+        while(count > 0 && (size_t)n >= cur->iov_len) {
+            n -= cur->iov_len;
+            cur++;
+            count--;
+        }
+        if(count > 0) {
+            cur->iov_base = (char *)cur->iov_base + n;
+            cur->iov_len -= n;
+        }
+    }
+    return true;
+}
+#endif
+
 static bool std_file_handles_init = false;
 static File out = {0};
 static File err = {0};
@@ -1285,157 +2788,3712 @@ FileHandle stdin_get(void) {
 }
 
 //  ----------------------------------- //
-//             vector-impl              //
+//            file-copy-impl            //
 //  ----------------------------------- //
-void *core_vec_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg) {
-    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
-    ArrayHeader *arr = allocator_alloc(&alloc, (capacity * elem_size) + sizeof(ArrayHeader));
-    memset(arr, 0, (capacity * elem_size) + sizeof(ArrayHeader));
-    arr[0].len = 0;
-    arr[0].cap = capacity;
-    arr[0].alloc = alloc;
-    arr++;
-    return arr;
-}
+#define FILE_COPY_BUFFER_SIZE CORE_KB(1024)
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
-/*static void *core_vec_create_header_present_internal(void *arr, size_t capacity, size_t elem_size) {
-    ArrayHeader *tmp = global_allocator.realloc(vec_header(arr), sizeof(ArrayHeader) + capacity * elem_size);
-    tmp->cap = capacity;
-    tmp++;
-    return tmp;
-}*/
+static i64 _file_copy_loop(i32 out, i64 out_off, i32 in, i64 in_off, u64 len) {
+    char *buffer = malloc(FILE_COPY_BUFFER_SIZE);
+    if(!buffer) {
+        return -1;
+    }
+    u64 copied = 0;
+    while(copied < len) {
+        size_t want = len - copied < FILE_COPY_BUFFER_SIZE ? len - copied : FILE_COPY_BUFFER_SIZE;
+#ifdef PLATFORM_WIN32
+        _lseeki64(in, in_off + copied, SEEK_SET);
+        i64 n = _core_read(in, buffer, want);
+#else
+        i64 n = pread(in, buffer, want, in_off + copied);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+#endif
+        if(n < 0) {
+            free(buffer);
+            return -1;
+        }
+        if(n == 0) {
+            break;
+        }
+#ifdef PLATFORM_WIN32
+        _lseeki64(out, out_off + copied, SEEK_SET);
+        bool ok = _core_write_all(out, buffer, n);
+#else
+        bool ok = true;
+        for(i64 done = 0; done < n;) {
+            ssize_t w = pwrite(out, buffer + done, n - done, out_off + copied + done);
+            if(w < 0 && errno == EINTR) {
+                continue;
+            }
+            if(w <= 0) {
+                ok = false;
+                break;
+            }
+            done += w;
+        }
+#endif
+        if(!ok) {
+            free(buffer);
+            return -1;
+        }
+        copied += n;
+    }
+    free(buffer);
+    return copied;
+}
 
+#ifdef __linux__
+//  each mechanism only gets skipped if it failed before copying anything
+static i64 _file_copy_kernel(i32 out, i64 out_off, i32 in, i64 in_off, u64 len, bool *unsupported) {
+    u64 copied = 0;
+    *unsupported = false;
 
-void *core_vec_maygrow_internal(void *arr, size_t elem_size) {
-    /*if(!arr) {
-        if((arr - sizeof(ArrayHeader)) != NULL) {
-            arr = core_vec_create_header_present_internal(arr, DEFAULT_INITIAL_VECTOR_SIZE, elem_size);
-        }else {
-            arr = core_vec_create_internal(DEFAULT_INITIAL_VECTOR_SIZE, elem_size);
+    loff_t in_pos = in_off, out_pos = out_off;
+    while(copied < len) {
+        ssize_t n = copy_file_range(in, &in_pos, out, &out_pos, len - copied, 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            if(copied == 0) {
+                break;
+            }
+            return -1;
+        }
+        if(n == 0) {
+            return copied;
         }
-    }*/
+        copied += n;
+    }
+    if(copied == len) {
+        return copied;
+    }
 
-    if(vec_len(arr) >= vec_cap(arr)) {
-        vec_cap(arr) = vec_cap(arr) == 0 ? DEFAULT_INITIAL_VECTOR_SIZE : vec_cap(arr) * 2;
-        ArrayHeader *tmp = allocator_alloc(&vec_header(arr)->alloc, vec_cap(arr) * elem_size + sizeof(ArrayHeader));
-        tmp++;
-        vec_len(tmp) = vec_len(arr);
-        vec_cap(tmp) = vec_cap(arr);
-        vec_header(tmp)->alloc = vec_header(arr)->alloc;
-        memcpy(tmp, arr, vec_len(arr) * elem_size);
-        allocator_free(&vec_header(arr)->alloc, vec_header(arr));
-        return tmp;
+    //  sendfile writes at the current position of `out`
+    if(lseek(out, out_off, SEEK_SET) >= 0) {
+        off_t pos = in_off;
+        while(copied < len) {
+            ssize_t n = sendfile(out, in, &pos, len - copied);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n < 0) {
+                if(copied == 0) {
+                    break;
+                }
+                return -1;
+            }
+            if(n == 0) {
+                return copied;
+            }
+            copied += n;
+        }
+        if(copied == len) {
+            return copied;
+        }
     }
-    return arr;
-}
 
-void core_vec_destroy_internal(void *arr) {
-    ArrayHeader *header = arr;
-    allocator_free(&header->alloc, header);
+    //  neither side is a regular file, move the pages through a pipe
+    i32 pipe_fds[2];
+    if(pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        *unsupported = true;
+        return -1;
+    }
+    loff_t splice_in = in_off, splice_out = out_off;
+    struct stat in_st, out_st;
+    bool in_seekable = fstat(in, &in_st) == 0 && S_ISREG(in_st.st_mode);
+    bool out_seekable = fstat(out, &out_st) == 0 && S_ISREG(out_st.st_mode);
+    while(copied < len) {
+        size_t chunk = len - copied < FILE_COPY_BUFFER_SIZE ? len - copied : FILE_COPY_BUFFER_SIZE;
+        ssize_t n = splice(in, in_seekable ? &splice_in : NULL, pipe_fds[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            *unsupported = n < 0 && copied == 0;
+            break;
+        }
+        for(ssize_t moved = 0; moved < n;) {
+            ssize_t m = splice(pipe_fds[0], NULL, out, out_seekable ? &splice_out : NULL, n - moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if(m < 0 && errno == EINTR) {
+                continue;
+            }
+            if(m <= 0) {
+                close(pipe_fds[0]);
+                close(pipe_fds[1]);
+                return -1;
+            }
+            moved += m;
+        }
+        copied += n;
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return *unsupported ? -1 : (i64)copied;
 }
+#endif
 
-void *core_vec_create_empty_internal(OptAllocArg arg) {
-    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
-    ArrayHeader *arr = allocator_alloc(&alloc, sizeof(ArrayHeader));
-    memset(arr, 0, sizeof(ArrayHeader));
-    arr[0].len = 0;
-    arr[0].cap = 0;
-    arr[0].alloc = alloc;
-    arr++;
-    return arr;
+//  pipes, terminals and sockets have no offsets, copies from the current position
+//  of `in` to the current position of `out` until `in` runs dry
+static i64 _file_copy_stream(i32 out, i32 in) {
+    i64 copied = 0;
+#ifdef __linux__
+    //  splice needs a pipe on one side, the other side may still refuse before anything moved
+    struct stat in_st, out_st;
+    if((fstat(in, &in_st) == 0 && S_ISFIFO(in_st.st_mode)) || (fstat(out, &out_st) == 0 && S_ISFIFO(out_st.st_mode))) {
+        for(;;) {
+            ssize_t n = splice(in, NULL, out, NULL, FILE_COPY_BUFFER_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n == 0) {
+                return copied;
+            }
+            if(n < 0) {
+                if(copied == 0 && errno == EINVAL) {
+                    break;
+                }
+                return -1;
+            }
+            copied += n;
+        }
+    }
+#endif
+    char *buffer = malloc(FILE_COPY_BUFFER_SIZE);
+    if(!buffer) {
+        return -1;
+    }
+    for(;;) {
+        i64 n = _core_read(in, buffer, FILE_COPY_BUFFER_SIZE);
+        if(n <= 0) {
+            free(buffer);
+            return n < 0 ? -1 : copied;
+        }
+        if(!_core_write_all(out, buffer, n)) {
+            free(buffer);
+            return -1;
+        }
+        copied += n;
+    }
 }
 
-void *core_vec_copy(void *arr, size_t elem_size, OptAllocArg arg) {
-    ArrayHeader *other = arr;
-    size_t other_cap = other[-1].cap;
-    ArrayHeader *new = core_vec_create_internal(other_cap, elem_size, arg);
-    new[-1].len = other[-1].len;
-    memcpy((void*)new, arr, new[-1].len * elem_size);
-    return new;
+static i64 _file_copy_fd(i32 out, i64 out_off, i32 in, i64 in_off, u64 len) {
+#ifdef __linux__
+    bool unsupported = false;
+    i64 copied = _file_copy_kernel(out, out_off, in, in_off, len, &unsupported);
+    if(!unsupported) {
+        return copied;
+    }
+#endif
+    return _file_copy_loop(out, out_off, in, in_off, len);
 }
 
-void *core_vec_create_from_parts_internal(void *ptr, size_t size, size_t elem_size, OptAllocArg arg) {
-    void *vec = core_vec_create_internal(size, elem_size, arg);
-    vec_len(vec) = size;
-    memcpy(vec, ptr, size * elem_size);
-    return vec;
+i64 file_copy_range(FileHandle dst, u64 dst_offset, FileHandle src, u64 src_offset, u64 len) {
+    fflush(dst->fd);
+    fflush(src->fd);
+    return _file_copy_fd(_core_file_fd(dst), (i64)dst_offset, _core_file_fd(src), (i64)src_offset, len);
 }
 
-size_t core_vec_find(void *vec, size_t elem_size, void *pred, size_t pred_size, EqCallback callback) {
-    if(elem_size != pred_size) {
-        return FIND_NO_ELEM;
-    }
-    vec_iter(vec, i) {
-        if(callback((char*)vec + (i * elem_size), pred)) {
-            return i;
+i64 file_copy(FileHandle dst, FileHandle src) {
+    fflush(dst->fd);
+    fflush(src->fd);
+    i32 out = _core_file_fd(dst), in = _core_file_fd(src);
+    bool in_regular = _core_fd_is_regular(in), out_regular = _core_fd_is_regular(out);
+    if(!in_regular || !out_regular) {
+        i64 copied = _file_copy_stream(out, in);
+        //  the stdio position of a regular side follows its fd
+        if(in_regular) {
+            _core_fseek(src->fd, _core_fd_tell(in));
         }
+        if(out_regular) {
+            _core_fseek(dst->fd, _core_fd_tell(out));
+        }
+        return copied;
     }
-    return FIND_NO_ELEM;
+    i64 out_off = _core_ftell(dst->fd), in_off = _core_ftell(src->fd);
+    if(out_off < 0 || in_off < 0) {
+        return -1;
+    }
+    u64 len = (u64)-1;
+#ifdef PLATFORM_WIN32
+    i64 size = _filelengthi64(in);
+    if(size >= 0) {
+        len = size > in_off ? (u64)(size - in_off) : 0;
+    }
+#else
+    struct stat st;
+    if(fstat(in, &st) == 0) {
+        len = st.st_size > in_off ? (u64)(st.st_size - in_off) : 0;
+    }
+#endif
+#ifdef __linux__
+    //  a whole file into an empty one can share the extents on btrfs/xfs
+    struct stat out_st;
+    if(len != (u64)-1 && in_off == 0 && out_off == 0 && fstat(out, &out_st) == 0 && out_st.st_size == 0 && ioctl(out, FICLONE, in) == 0) {
+        _core_fseek(src->fd, (i64)len);
+        _core_fseek(dst->fd, (i64)len);
+        return len;
+    }
+#endif
+    i64 copied = _file_copy_fd(out, out_off, in, in_off, len);
+    if(copied >= 0) {
+        _core_fseek(src->fd, in_off + copied);
+        _core_fseek(dst->fd, out_off + copied);
+    }
+    return copied;
 }
 
-bool core_vec_remove(void *vec, size_t elem_size, size_t index) {
-    if(vec_len(vec) < index) {
+bool file_copy_path(const char *dst, const char *src) {
+    FileHandle in = file_open(src, FILE_READ | FILE_BIN);
+    if(!in) {
         return false;
     }
-    for(size_t i = index; i < vec_len(vec); i++) {
-        memcpy((char*)vec + i * elem_size, ((char*)vec + (i + 1) * elem_size), elem_size);
+    FileHandle out = file_open(dst, FILE_WRITE | FILE_BIN);
+    if(!out) {
+        file_close(in);
+        return false;
     }
-    vec_len(vec)--;
-    return true;
-}
-
-void vec_dump(void *vec) {
-    println("Vec { data: [..], len: %zu, cap: %zu }", vec_len(vec), vec_cap(vec));
+    bool ok = file_copy(out, in) >= 0;
+    file_close(in);
+    file_close(out);
+    return ok;
 }
 
 //  ----------------------------------- //
-//             arena-impl               //
+//           file-reader-impl           //
 //  ----------------------------------- //
-Arena arena_new(size_t size) {
-    if(size == 0) {
-        size = ARENA_DEFAULT_ALLOC_SIZE;
-    }
-    Vec(char) buffer = vec_with_size(char, size);
-    Arena self = {
-        .buffer = buffer,
-        .current_alloc = buffer,
-        .next = NULL,
+FileReader file_reader_new_impl(FileHandle file, OptFileReaderArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    size_t cap = arg.buffer_size ? arg.buffer_size : FILE_READER_DEFAULT_SIZE;
+    FileReader self = {
+        .fd = _core_file_fd(file),
+        .buffer = allocator_alloc(&alloc, cap),
+        .cap = cap,
+        .alloc = alloc,
     };
+    //  continue where the stdio stream left off
+    i64 offset = _core_ftell(file->fd);
+#ifdef PLATFORM_WIN32
+    if(offset >= 0) _lseeki64(self.fd, offset, SEEK_SET);
+#else
+    if(offset >= 0) lseek(self.fd, offset, SEEK_SET);
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(self.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    self.error = self.buffer == NULL;
     return self;
 }
 
-void arena_dealloc(Arena *self) {
-    if(self->next) {
-        arena_dealloc(self->next);
+void file_reader_deinit(FileReader *self) {
+    if(self->buffer) {
+        allocator_free(&self->alloc, self->buffer);
     }
-    vec_destroy(self->buffer);
-}
-
-static void arena_clear_int(Arena *self) {
-    self->current_alloc = self->buffer;
-    if(self->next)
-        arena_clear_int(self->next);
+    *self = (FileReader){0};
 }
 
-static void* arena_alloc_internal(Arena *self, size_t size) {
-    if(self->buffer == NULL || self->current_alloc == NULL) {
-        *self = arena_new(0);
+//  moves the unconsumed bytes to the front and reads as much as fits
+static bool _file_reader_fill(FileReader *self) {
+    if(self->eof || self->error) {
+        return false;
+    }
+    if(self->pos > 0) {
+        memmove(self->buffer, self->buffer + self->pos, self->len - self->pos);
+        self->len -= self->pos;
+        self->scan -= self->pos;
+        self->pos = 0;
     }
+    if(self->len == self->cap) {
+        size_t new_cap = self->cap * 2;
+        char *buffer = allocator_realloc(&self->alloc, self->buffer, new_cap);
+        if(!buffer) {
+            self->error = true;
+            return false;
+        }
+        self->buffer = buffer;
+        self->cap = new_cap;
+    }
+    i64 n = _core_read(self->fd, self->buffer + self->len, self->cap - self->len);
+    if(n <= 0) {
+        self->error = n < 0;
+        self->eof = true;
+        return false;
+    }
+    self->len += n;
+    return true;
+}
 
-    if(self->next) {
-        return arena_alloc_internal(self->next, size);
+bool file_reader_next_line(FileReader *self, StringView *line) {
+    for(;;) {
+        char *end = memchr(self->buffer + self->scan, '\n', self->len - self->scan);
+        if(end) {
+            size_t line_end = end - self->buffer;
+            size_t len = line_end - self->pos;
+            if(len > 0 && self->buffer[line_end - 1] == '\r') {
+                len--;
+            }
+            *line = string_view_new(self->buffer + self->pos, len);
+            self->pos = self->scan = line_end + 1;
+            return true;
+        }
+        self->scan = self->len;
+        if(!_file_reader_fill(self)) {
+            break;
+        }
     }
-    if(self->current_alloc + size > self->buffer + vec_cap(self->buffer)) {
-        self->next = allocator_alloc(&default_allocator, sizeof(Arena));
-        *self->next = arena_new(ARENA_DEFAULT_ALLOC_SIZE);
-        return arena_alloc_internal(self->next, size);
+    //  last line without a trailing newline
+    if(self->pos < self->len) {
+        *line = string_view_new(self->buffer + self->pos, self->len - self->pos);
+        self->pos = self->scan = self->len;
+        return true;
     }
-    void *alloc = self->current_alloc;
-    self->current_alloc += size;
-    return alloc;
+    return false;
 }
 
-void *arena_alloc(Arena *alloc, size_t size) {
+bool file_reader_next_chunk(FileReader *self, size_t size, Slice(char) *chunk) {
+    if(size > self->cap) {
+        char *buffer = allocator_realloc(&self->alloc, self->buffer, size);
+        if(!buffer) {
+            self->error = true;
+            return false;
+        }
+        self->buffer = buffer;
+        self->cap = size;
+    }
+    while(self->len - self->pos < size && _file_reader_fill(self));
+    size_t len = self->len - self->pos;
+    if(len == 0) {
+        return false;
+    }
+    if(len > size) {
+        len = size;
+    }
+    *chunk = (_Slice){ .data = self->buffer + self->pos, .len = len };
+    self->pos += len;
+    if(self->scan < self->pos) {
+        self->scan = self->pos;
+    }
+    return true;
+}
+
+//  ----------------------------------- //
+//           file-writer-impl           //
+//  ----------------------------------- //
+FileWriter file_writer_new_impl(FileHandle file, OptFileWriterArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    size_t cap = arg.buffer_size ? arg.buffer_size : FILE_WRITER_DEFAULT_SIZE;
+    //  anything still sitting in the stdio buffer has to land before our writes
+    fflush(file->fd);
+    FileWriter self = {
+        .fd = _core_file_fd(file),
+        .buffer = allocator_alloc(&alloc, cap),
+        .cap = cap,
+        .alloc = alloc,
+    };
+    self.error = self.buffer == NULL;
+    return self;
+}
+
+bool file_writer_deinit(FileWriter *self) {
+    bool ok = file_writer_flush(self);
+    if(self->buffer) {
+        allocator_free(&self->alloc, self->buffer);
+    }
+    *self = (FileWriter){0};
+    return ok;
+}
+
+//  writes the buffered bytes followed by `data` in as few syscalls as possible
+static bool _file_writer_flush_with(FileWriter *self, const char *data, size_t len) {
+    bool ok = true;
+    if(len == 0) {
+        ok = _core_write_all(self->fd, self->buffer, self->len);
+    }else {
+#ifdef PLATFORM_WIN32
+        ok = _core_write_all(self->fd, self->buffer, self->len) && _core_write_all(self->fd, data, len);
+#else
+        ok = _core_writev_all(self->fd, self->buffer, self->len, data, len);
+#endif
+    }
+    if(ok) {
+        self->written += self->len + len;
+    }
+    self->len = 0;
+    self->error |= !ok;
+    return ok;
+}
+
+bool file_writer_flush(FileWriter *self) {
+    if(self->error) {
+        return false;
+    }
+    if(self->len == 0) {
+        return true;
+    }
+    return _file_writer_flush_with(self, NULL, 0);
+}
+
+bool file_writer_sync(FileWriter *self) {
+    if(!file_writer_flush(self)) {
+        return false;
+    }
+#if defined(PLATFORM_WIN32)
+    self->error |= _commit(self->fd) != 0;
+#elif defined(__APPLE__)
+    self->error |= fsync(self->fd) != 0;
+#else
+    self->error |= fdatasync(self->fd) != 0;
+#endif
+    return !self->error;
+}
+
+i64 file_writer_write_raw(FileWriter *self, const void *data, size_t len) {
+    if(self->error) {
+        return -1;
+    }
+    if(self->len + len <= self->cap) {
+        memcpy(self->buffer + self->len, data, len);
+        self->len += len;
+        return len;
+    }
+    //  big appends go out together with the buffer instead of being copied
+    if(len >= self->cap / 2) {
+        return _file_writer_flush_with(self, data, len) ? (i64)len : -1;
+    }
+    if(!file_writer_flush(self)) {
+        return -1;
+    }
+    memcpy(self->buffer, data, len);
+    self->len = len;
+    return len;
+}
+
+i64 file_writer_write(FileWriter *self, StringView data) {
+    return file_writer_write_raw(self, data.data, data.len);
+}
+
+i64 file_writer_vprintf(FileWriter *self, const char *fmt, va_list args) {
+    if(self->error) {
+        return -1;
+    }
+    va_list args_copy;
+    va_copy(args_copy, args);
+    size_t space = self->cap - self->len;
+    i32 size = vsnprintf(self->buffer + self->len, space, fmt, args);
+    if(size < 0) {
+        va_end(args_copy);
+        return -1;
+    }
+    if((size_t)size < space) {
+        self->len += size;
+        va_end(args_copy);
+        return size;
+    }
+    i64 ret = -1;
+    if((size_t)size < self->cap) {
+        if(file_writer_flush(self)) {
+            vsnprintf(self->buffer, self->cap, fmt, args_copy);
+            self->len = size;
+            ret = size;
+        }
+    }else {
+        char *tmp = allocator_alloc(&self->alloc, size + 1);
+        if(tmp) {
+            vsnprintf(tmp, size + 1, fmt, args_copy);
+            ret = _file_writer_flush_with(self, tmp, size) ? size : -1;
+            allocator_free(&self->alloc, tmp);
+        }
+    }
+    va_end(args_copy);
+    return ret;
+}
+
+i64 file_writer_printf(FileWriter *self, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    i64 ret = file_writer_vprintf(self, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+//  ----------------------------------- //
+//            async-io-impl             //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#ifdef CORE_IO_URING
+typedef struct AsyncUring {
+    i32 fd;
+    u32 entries;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    u32 *sq_head;
+    u32 *sq_tail;
+    u32 *sq_mask;
+    u32 *sq_array;
+    u32 *cq_head;
+    u32 *cq_tail;
+    u32 *cq_mask;
+    struct io_uring_cqe *cqes;
+    u32 to_submit;
+}AsyncUring;
+#endif
+
+typedef struct AsyncPool {
+    thrd_t *threads;
+    u32 count;
+    mtx_t lock;
+    cnd_t work_ready;
+    cnd_t done_ready;
+    //  lock and condition variables were initialised
+    bool synced;
+    //  fifo rings of `depth` entries, `in_flight < depth` keeps them from overflowing
+    AsyncRequest **pending;
+    u32 pending_head;
+    u32 pending_len;
+    AsyncCompletion *done;
+    u32 done_head;
+    u32 done_len;
+    u32 depth;
+    bool stop;
+}AsyncPool;
+
+struct AsyncIO {
+    Allocator alloc;
+    bool uring;
+    u32 depth;
+    u32 in_flight;
+#ifdef CORE_IO_URING
+    AsyncUring ring;
+#endif
+    AsyncPool pool;
+};
+
+static i64 _async_execute(AsyncRequest *req) {
+    i64 res = 0;
+    switch(req->kind) {
+        case ASYNC_OP_OPEN: {
+            res = open(req->path, req->flags | O_CLOEXEC, req->mode);
+        } break;
+        case ASYNC_OP_READ: {
+            res = req->offset == ASYNC_OFFSET_CURRENT ?
+                read(req->fd, req->buffer, req->len) :
+                pread(req->fd, req->buffer, req->len, (off_t)req->offset);
+        } break;
+        case ASYNC_OP_WRITE: {
+            res = req->offset == ASYNC_OFFSET_CURRENT ?
+                write(req->fd, req->buffer, req->len) :
+                pwrite(req->fd, req->buffer, req->len, (off_t)req->offset);
+        } break;
+        case ASYNC_OP_CLOSE: {
+            res = close(req->fd);
+        } break;
+    }
+    return res < 0 ? -errno : res;
+}
+
+static i32 _async_worker(void *arg) {
+    AsyncPool *pool = arg;
+    mtx_lock(&pool->lock);
+    for(;;) {
+        while(!pool->stop && pool->pending_len == 0) {
+            cnd_wait(&pool->work_ready, &pool->lock);
+        }
+        if(pool->pending_len == 0) {
+            break;
+        }
+        AsyncRequest *req = pool->pending[pool->pending_head];
+        pool->pending_head = (pool->pending_head + 1) % pool->depth;
+        pool->pending_len--;
+        mtx_unlock(&pool->lock);
+        AsyncCompletion completion = { .request = req, .result = _async_execute(req), .user_data = req->user_data };
+        mtx_lock(&pool->lock);
+        pool->done[(pool->done_head + pool->done_len) % pool->depth] = completion;
+        pool->done_len++;
+        cnd_signal(&pool->done_ready);
+    }
+    mtx_unlock(&pool->lock);
+    return 0;
+}
+
+static bool _async_pool_init(AsyncIO *self, u32 workers) {
+    AsyncPool *pool = &self->pool;
+    pool->depth = self->depth;
+    pool->pending = allocator_alloc(&self->alloc, pool->depth * sizeof(AsyncRequest *));
+    pool->done = allocator_alloc(&self->alloc, pool->depth * sizeof(AsyncCompletion));
+    pool->threads = allocator_alloc(&self->alloc, workers * sizeof(thrd_t));
+    if(!pool->pending || !pool->done || !pool->threads) {
+        return false;
+    }
+    if(mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+        return false;
+    }
+    if(cnd_init(&pool->work_ready) != thrd_success) {
+        mtx_destroy(&pool->lock);
+        return false;
+    }
+    if(cnd_init(&pool->done_ready) != thrd_success) {
+        cnd_destroy(&pool->work_ready);
+        mtx_destroy(&pool->lock);
+        return false;
+    }
+    pool->synced = true;
+    for(u32 i = 0; i < workers; i++) {
+        if(thrd_create(&pool->threads[i], _async_worker, pool) != thrd_success) {
+            break;
+        }
+        pool->count++;
+    }
+    return pool->count > 0;
+}
+
+static void _async_pool_deinit(AsyncIO *self) {
+    AsyncPool *pool = &self->pool;
+    if(pool->synced) {
+        mtx_lock(&pool->lock);
+        pool->stop = true;
+        cnd_broadcast(&pool->work_ready);
+        mtx_unlock(&pool->lock);
+        for(u32 i = 0; i < pool->count; i++) {
+            thrd_join(pool->threads[i], NULL);
+        }
+        mtx_destroy(&pool->lock);
+        cnd_destroy(&pool->work_ready);
+        cnd_destroy(&pool->done_ready);
+    }
+    if(pool->threads) {
+        allocator_free(&self->alloc, pool->threads);
+    }
+    if(pool->pending) {
+        allocator_free(&self->alloc, pool->pending);
+    }
+    if(pool->done) {
+        allocator_free(&self->alloc, pool->done);
+    }
+    *pool = (AsyncPool){0};
+}
+
+#ifdef CORE_IO_URING
+static i32 _async_uring_enter(i32 fd, u32 to_submit, u32 min_complete, u32 flags) {
+    return (i32)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static bool _async_uring_init(AsyncIO *self) {
+    AsyncUring *ring = &self->ring;
+    struct io_uring_params params = {0};
+    ring->fd = (i32)syscall(__NR_io_uring_setup, self->depth, &params);
+    if(ring->fd < 0) {
+        return false;
+    }
+    ring->entries = params.sq_entries;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sq_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_size);
+            close(ring->fd);
+            return false;
+        }
+    }
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED) {
+        if(ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+        munmap(ring->sq_ptr, ring->sq_size);
+        close(ring->fd);
+        return false;
+    }
+    char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+    ring->sq_head = (u32 *)(sq + params.sq_off.head);
+    ring->sq_tail = (u32 *)(sq + params.sq_off.tail);
+    ring->sq_mask = (u32 *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (u32 *)(sq + params.sq_off.array);
+    ring->cq_head = (u32 *)(cq + params.cq_off.head);
+    ring->cq_tail = (u32 *)(cq + params.cq_off.tail);
+    ring->cq_mask = (u32 *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    self->depth = ring->entries;
+
+    //  openat/read/write/close need 5.6, older kernels use the worker threads
+    struct io_uring_probe *probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+    bool supported = probe && syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    u8 ops[] = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+    for(size_t i = 0; supported && i < CORE_ARRLEN(ops); i++) {
+        supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    if(!supported) {
+        munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+        if(ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+        munmap(ring->sq_ptr, ring->sq_size);
+        close(ring->fd);
+        return false;
+    }
+    return true;
+}
+
+static void _async_uring_deinit(AsyncIO *self) {
+    AsyncUring *ring = &self->ring;
+    munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+    if(ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd);
+}
+
+static bool _async_uring_push(AsyncIO *self, AsyncRequest *req) {
+    AsyncUring *ring = &self->ring;
+    u32 tail = *ring->sq_tail;
+    u32 head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if(tail - head >= ring->entries) {
+        return false;
+    }
+    u32 index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (u64)(ptr_t)req;
+    sqe->fd = req->fd;
+    switch(req->kind) {
+        case ASYNC_OP_OPEN: {
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (u64)(ptr_t)req->path;
+            sqe->len = req->mode;
+            sqe->open_flags = req->flags | O_CLOEXEC;
+        } break;
+        case ASYNC_OP_READ:
+        case ASYNC_OP_WRITE: {
+            sqe->opcode = req->kind == ASYNC_OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->addr = (u64)(ptr_t)req->buffer;
+            sqe->len = (u32)(req->len > UINT32_MAX ? UINT32_MAX : req->len);
+            sqe->off = req->offset;
+        } break;
+        case ASYNC_OP_CLOSE: {
+            sqe->opcode = IORING_OP_CLOSE;
+        } break;
+    }
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return true;
+}
+
+static size_t _async_uring_reap(AsyncIO *self, AsyncCompletion *out, size_t max, size_t *stored) {
+    AsyncUring *ring = &self->ring;
+    size_t reaped = 0;
+    u32 head = *ring->cq_head;
+    for(;;) {
+        u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if(head == tail) {
+            break;
+        }
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        AsyncRequest *req = (AsyncRequest *)(ptr_t)cqe->user_data;
+        AsyncCompletion completion = { .request = req, .result = cqe->res, .user_data = req->user_data };
+        if(!req->callback && *stored == max) {
+            break;
+        }
+        head++;
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        self->in_flight--;
+        reaped++;
+        if(req->callback) {
+            req->callback(&completion);
+        }else {
+            out[(*stored)++] = completion;
+        }
+    }
+    return reaped;
+}
+#endif
+
+static size_t _async_pool_reap(AsyncIO *self, AsyncCompletion *out, size_t max, size_t min) {
+    AsyncPool *pool = &self->pool;
+    size_t reaped = 0, stored = 0;
+    mtx_lock(&pool->lock);
+    for(;;) {
+        while(reaped < min && pool->done_len == 0) {
+            cnd_wait(&pool->done_ready, &pool->lock);
+        }
+        if(pool->done_len == 0) {
+            break;
+        }
+        AsyncCompletion completion = pool->done[pool->done_head];
+        if(!completion.request->callback && stored == max) {
+            break;
+        }
+        pool->done_head = (pool->done_head + 1) % pool->depth;
+        pool->done_len--;
+        self->in_flight--;
+        reaped++;
+        if(completion.request->callback) {
+            mtx_unlock(&pool->lock);
+            completion.request->callback(&completion);
+            mtx_lock(&pool->lock);
+        }else {
+            out[stored++] = completion;
+        }
+    }
+    mtx_unlock(&pool->lock);
+    return stored;
+}
+
+AsyncIO *async_io_new_impl(OptAsyncIOArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    AsyncIO *self = allocator_alloc(&alloc, sizeof(AsyncIO));
+    if(!self) return NULL;
+    *self = (AsyncIO){
+        .alloc = alloc,
+        .depth = arg.queue_depth ? arg.queue_depth : ASYNC_IO_DEFAULT_DEPTH,
+    };
+#ifdef CORE_IO_URING
+    if(!arg.no_uring) {
+        self->uring = _async_uring_init(self);
+    }
+#endif
+    if(!self->uring && !_async_pool_init(self, arg.workers ? arg.workers : ASYNC_IO_DEFAULT_WORKERS)) {
+        _async_pool_deinit(self);
+        allocator_free(&alloc, self);
+        return NULL;
+    }
+    return self;
+}
+
+void async_io_destroy(AsyncIO *self) {
+    while(self->in_flight > 0) {
+        //  completions without a callback are dropped
+        AsyncCompletion sink[16];
+        async_io_wait(self, sink, CORE_ARRLEN(sink), 1);
+    }
+#ifdef CORE_IO_URING
+    if(self->uring) {
+        _async_uring_deinit(self);
+    }
+#endif
+    _async_pool_deinit(self);
+    Allocator alloc = self->alloc;
+    allocator_free(&alloc, self);
+}
+
+bool async_io_is_uring(AsyncIO const *self) {
+    return self->uring;
+}
+
+u32 async_io_in_flight(AsyncIO const *self) {
+    return self->in_flight;
+}
+
+size_t async_io_submit(AsyncIO *self, AsyncRequest *requests, size_t count) {
+    size_t queued = 0;
+#ifdef CORE_IO_URING
+    if(self->uring) {
+        while(queued < count && self->in_flight + queued < self->ring.entries * 2 && _async_uring_push(self, &requests[queued])) {
+            queued++;
+        }
+        while(self->ring.to_submit > 0) {
+            i32 res = _async_uring_enter(self->ring.fd, self->ring.to_submit, 0, 0);
+            if(res < 0) {
+                if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                    continue;
+                }
+                break;
+            }
+            self->ring.to_submit -= res;
+        }
+        self->in_flight += queued;
+        return queued;
+    }
+#endif
+    AsyncPool *pool = &self->pool;
+    mtx_lock(&pool->lock);
+    for(; queued < count && self->in_flight + queued < self->depth; queued++) {
+        pool->pending[(pool->pending_head + pool->pending_len) % pool->depth] = &requests[queued];
+        pool->pending_len++;
+    }
+    cnd_broadcast(&pool->work_ready);
+    mtx_unlock(&pool->lock);
+    self->in_flight += queued;
+    return queued;
+}
+
+size_t async_io_poll(AsyncIO *self, AsyncCompletion *out, size_t max) {
+    if(self->in_flight == 0) {
+        return 0;
+    }
+#ifdef CORE_IO_URING
+    if(self->uring) {
+        size_t stored = 0;
+        _async_uring_reap(self, out, max, &stored);
+        return stored;
+    }
+#endif
+    return _async_pool_reap(self, out, max, 0);
+}
+
+size_t async_io_wait(AsyncIO *self, AsyncCompletion *out, size_t max, size_t min) {
+    if(min > self->in_flight) {
+        min = self->in_flight;
+    }
+    if(min == 0) {
+        return async_io_poll(self, out, max);
+    }
+#ifdef CORE_IO_URING
+    if(self->uring) {
+        size_t stored = 0;
+        size_t reaped = _async_uring_reap(self, out, max, &stored);
+        while(reaped < min) {
+            if(_async_uring_enter(self->ring.fd, 0, (u32)(min - reaped), IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                break;
+            }
+            size_t more = _async_uring_reap(self, out, max, &stored);
+            if(more == 0 && stored == max) {
+                break;
+            }
+            reaped += more;
+        }
+        return stored;
+    }
+#endif
+    return _async_pool_reap(self, out, max, min);
+}
+#endif
+
+//  ----------------------------------- //
+//              fiber-impl              //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#ifdef CORE_FIBER_UCONTEXT
+typedef ucontext_t _FiberContext;
+#else
+typedef struct _FiberContext {
+    void *sp;
+}_FiberContext;
+
+#ifdef __APPLE__
+#define _FIBER_SYMBOL(name) "_" #name
+#else
+#define _FIBER_SYMBOL(name) #name
+#endif
+
+//  saves the callee saved registers on the current stack, stores the stack pointer
+//  in `*from` and restores the registers from the stack at `to`
+void _core_fiber_switch(void **from, void *to);
+#if defined(__x86_64__)
+__asm__(
+    ".text\n"
+    ".globl " _FIBER_SYMBOL(_core_fiber_switch) "\n"
+    _FIBER_SYMBOL(_core_fiber_switch) ":\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+);
+#elif defined(__aarch64__)
+__asm__(
+    ".text\n"
+    ".globl " _FIBER_SYMBOL(_core_fiber_switch) "\n"
+    _FIBER_SYMBOL(_core_fiber_switch) ":\n"
+    "    sub sp, sp, #0xa0\n"
+    "    stp x19, x20, [sp, #0x00]\n"
+    "    stp x21, x22, [sp, #0x10]\n"
+    "    stp x23, x24, [sp, #0x20]\n"
+    "    stp x25, x26, [sp, #0x30]\n"
+    "    stp x27, x28, [sp, #0x40]\n"
+    "    stp x29, x30, [sp, #0x50]\n"
+    "    stp d8, d9, [sp, #0x60]\n"
+    "    stp d10, d11, [sp, #0x70]\n"
+    "    stp d12, d13, [sp, #0x80]\n"
+    "    stp d14, d15, [sp, #0x90]\n"
+    "    mov x2, sp\n"
+    "    str x2, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0x00]\n"
+    "    ldp x21, x22, [sp, #0x10]\n"
+    "    ldp x23, x24, [sp, #0x20]\n"
+    "    ldp x25, x26, [sp, #0x30]\n"
+    "    ldp x27, x28, [sp, #0x40]\n"
+    "    ldp x29, x30, [sp, #0x50]\n"
+    "    ldp d8, d9, [sp, #0x60]\n"
+    "    ldp d10, d11, [sp, #0x70]\n"
+    "    ldp d12, d13, [sp, #0x80]\n"
+    "    ldp d14, d15, [sp, #0x90]\n"
+    "    add sp, sp, #0xa0\n"
+    "    ret\n"
+);
+#endif
+#endif
+
+typedef struct _FiberStack {
+    //  start of the mapping, the lowest page is the guard
+    u8 *base;
+    size_t size;
+}_FiberStack;
+
+typedef enum _FiberState {
+    _FIBER_RUNNING,
+    _FIBER_PARKED,
+    _FIBER_NOTIFIED,
+}_FiberState;
+
+//  what the worker does with the fiber once it switched back
+typedef enum _FiberAction {
+    _FIBER_ACTION_YIELD,
+    _FIBER_ACTION_PARK,
+    _FIBER_ACTION_DONE,
+}_FiberAction;
+
+struct Fiber {
+    _FiberContext ctx;
+    FiberScheduler *sched;
+    FiberFn fn;
+    void *arg;
+    _FiberStack stack;
+    _Atomic u32 state;
+    _FiberAction action;
+    Fiber *next;
+#ifdef CORE_ASAN
+    void *fake_stack;
+#endif
+};
+
+struct FiberScheduler {
+    Allocator alloc;
+    size_t stack_size;
+    u32 count;
+    thrd_t *threads;
+    mtx_t lock;
+    cnd_t ready;
+    cnd_t idle;
+    Fiber *head;
+    Fiber *tail;
+    size_t live;
+    bool stop;
+    bool polling;
+    Vec(_FiberStack) stacks;
+    AsyncIO *io;
+    bool owns_io;
+    mtx_t io_lock;
+    _Atomic u32 io_pending;
+};
+
+typedef struct _FiberWorker {
+    _FiberContext ctx;
+    Fiber *current;
+#ifdef CORE_ASAN
+    void *fake_stack;
+    const void *stack_bottom;
+    size_t stack_size;
+#endif
+}_FiberWorker;
+
+static thread_local _FiberWorker _fiber_worker_state = {0};
+
+//  fibers move between threads, the thread local has to be looked up again after
+//  every switch instead of reusing an address computed before it
+__attribute__((noinline)) static _FiberWorker *_fiber_worker(void) {
+    _FiberWorker *worker = &_fiber_worker_state;
+    __asm__ volatile("" : "+r"(worker) :: "memory");
+    return worker;
+}
+
+static bool _fiber_stack_acquire(FiberScheduler *self, _FiberStack *stack) {
+    mtx_lock(&self->lock);
+    if(vec_len(self->stacks) > 0) {
+        *stack = vec_pop(self->stacks);
+        mtx_unlock(&self->lock);
+        return true;
+    }
+    mtx_unlock(&self->lock);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = self->stack_size + page;
+    u8 *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+        return false;
+    }
+    if(mprotect(base, page, PROT_NONE) != 0) {
+        munmap(base, size);
+        return false;
+    }
+    *stack = (_FiberStack){ .base = base, .size = size };
+    return true;
+}
+
+static void _fiber_stack_release(FiberScheduler *self, _FiberStack stack) {
+    mtx_lock(&self->lock);
+    if(vec_len(self->stacks) < FIBER_STACK_POOL_SIZE) {
+        vec_push(self->stacks, stack);
+        stack.base = NULL;
+    }
+    mtx_unlock(&self->lock);
+    if(stack.base) {
+        munmap(stack.base, stack.size);
+    }
+}
+
+static void _fiber_push_ready(FiberScheduler *self, Fiber *fiber) {
+    mtx_lock(&self->lock);
+    fiber->next = NULL;
+    if(self->tail) {
+        self->tail->next = fiber;
+    } else {
+        self->head = fiber;
+    }
+    self->tail = fiber;
+    cnd_signal(&self->ready);
+    mtx_unlock(&self->lock);
+}
+
+//  called on the fiber, returns once a worker resumed it again
+static void _fiber_suspend(Fiber *fiber, _FiberAction action) {
+    fiber->action = action;
+    _FiberWorker *worker = _fiber_worker();
+#ifdef CORE_ASAN
+    __sanitizer_start_switch_fiber(action == _FIBER_ACTION_DONE ? NULL : &fiber->fake_stack, worker->stack_bottom, worker->stack_size);
+#endif
+#ifdef CORE_FIBER_UCONTEXT
+    swapcontext(&fiber->ctx, &worker->ctx);
+#else
+    _core_fiber_switch(&fiber->ctx.sp, worker->ctx.sp);
+#endif
+#ifdef CORE_ASAN
+    worker = _fiber_worker();
+    __sanitizer_finish_switch_fiber(fiber->fake_stack, &worker->stack_bottom, &worker->stack_size);
+#endif
+}
+
+static void _fiber_entry(void) {
+    _FiberWorker *worker = _fiber_worker();
+#ifdef CORE_ASAN
+    __sanitizer_finish_switch_fiber(NULL, &worker->stack_bottom, &worker->stack_size);
+#endif
+    Fiber *fiber = worker->current;
+    fiber->fn(fiber->arg);
+    _fiber_suspend(fiber, _FIBER_ACTION_DONE);
+    CORE_UNREACHABLE("finished fiber resumed");
+}
+
+static void _fiber_resume(FiberScheduler *self, Fiber *fiber) {
+    _FiberWorker *worker = _fiber_worker();
+    worker->current = fiber;
+    atomic_store_explicit(&fiber->state, _FIBER_RUNNING, memory_order_relaxed);
+#ifdef CORE_ASAN
+    __sanitizer_start_switch_fiber(&worker->fake_stack, fiber->stack.base + fiber->stack.size - self->stack_size, self->stack_size);
+#endif
+#ifdef CORE_FIBER_UCONTEXT
+    swapcontext(&worker->ctx, &fiber->ctx);
+#else
+    _core_fiber_switch(&worker->ctx.sp, fiber->ctx.sp);
+#endif
+#ifdef CORE_ASAN
+    __sanitizer_finish_switch_fiber(worker->fake_stack, NULL, NULL);
+#endif
+    worker->current = NULL;
+    switch(fiber->action) {
+        case _FIBER_ACTION_YIELD: {
+            _fiber_push_ready(self, fiber);
+        } break;
+        case _FIBER_ACTION_PARK: {
+            //  a wake that arrived while the fiber was still running makes it ready again
+            u32 expected = _FIBER_RUNNING;
+            if(!atomic_compare_exchange_strong(&fiber->state, &expected, _FIBER_PARKED)) {
+                atomic_store(&fiber->state, _FIBER_RUNNING);
+                _fiber_push_ready(self, fiber);
+            }
+        } break;
+        case _FIBER_ACTION_DONE: {
+            _fiber_stack_release(self, fiber->stack);
+            allocator_free(&self->alloc, fiber);
+            mtx_lock(&self->lock);
+            if(--self->live == 0) {
+                cnd_broadcast(&self->idle);
+            }
+            mtx_unlock(&self->lock);
+        } break;
+    }
+}
+
+static void _fiber_poll_io(FiberScheduler *self) {
+    AsyncCompletion sink[16];
+    mtx_lock(&self->io_lock);
+    async_io_poll(self->io, sink, CORE_ARRLEN(sink));
+    mtx_unlock(&self->io_lock);
+}
+
+//  reaps completions every so often while there are ready fibers, so a busy scheduler
+//  does not starve the fibers waiting on io
+#define _FIBER_POLL_INTERVAL 32
+
+static i32 _fiber_worker_main(void *arg) {
+    FiberScheduler *self = arg;
+    context_thread_init();
+    u32 resumed = 0;
+    mtx_lock(&self->lock);
+    for(;;) {
+        Fiber *fiber = self->head;
+        if(fiber) {
+            self->head = fiber->next;
+            if(!self->head) {
+                self->tail = NULL;
+            }
+            mtx_unlock(&self->lock);
+            _fiber_resume(self, fiber);
+            if(++resumed % _FIBER_POLL_INTERVAL == 0 && atomic_load(&self->io_pending) > 0) {
+                _fiber_poll_io(self);
+            }
+            mtx_lock(&self->lock);
+            continue;
+        }
+        if(self->stop) {
+            break;
+        }
+        if(atomic_load(&self->io_pending) > 0 && !self->polling) {
+            //  one idle worker reaps completions, waking up early when a fiber becomes ready
+            self->polling = true;
+            mtx_unlock(&self->lock);
+            _fiber_poll_io(self);
+            mtx_lock(&self->lock);
+            self->polling = false;
+            if(!self->head) {
+                struct timespec until;
+                timespec_get(&until, TIME_UTC);
+                until.tv_nsec += 100 * 1000;
+                if(until.tv_nsec >= 1000000000) {
+                    until.tv_sec++;
+                    until.tv_nsec -= 1000000000;
+                }
+                cnd_timedwait(&self->ready, &self->lock, &until);
+            }
+            continue;
+        }
+        cnd_wait(&self->ready, &self->lock);
+    }
+    mtx_unlock(&self->lock);
+    context_thread_deinit();
+    return 0;
+}
+
+FiberScheduler *fiber_scheduler_new_impl(OptFiberSchedulerArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t stack_size = arg.stack_size ? arg.stack_size : FIBER_DEFAULT_STACK_SIZE;
+    u32 count = arg.threads ? arg.threads : _core_cpu_count();
+    FiberScheduler *self = allocator_alloc(&alloc, sizeof(FiberScheduler));
+    *self = (FiberScheduler){
+        .alloc = alloc,
+        .stack_size = (stack_size + page - 1) / page * page,
+        .threads = allocator_alloc(&alloc, count * sizeof(thrd_t)),
+        .stacks = vec_new(.allocator = alloc),
+        .io = arg.io,
+    };
+    if(!self->io) {
+        self->io = async_io_new(.allocator = alloc);
+        self->owns_io = self->io != NULL;
+    }
+    mtx_init(&self->lock, mtx_plain);
+    mtx_init(&self->io_lock, mtx_plain);
+    cnd_init(&self->ready);
+    cnd_init(&self->idle);
+    for(u32 i = 0; i < count; i++) {
+        if(thrd_create(&self->threads[i], _fiber_worker_main, self) != thrd_success) {
+            break;
+        }
+        self->count++;
+    }
+    if(self->count == 0) {
+        fiber_scheduler_destroy(self);
+        return NULL;
+    }
+    return self;
+}
+
+void fiber_scheduler_wait(FiberScheduler *self) {
+    mtx_lock(&self->lock);
+    while(self->live > 0) {
+        cnd_wait(&self->idle, &self->lock);
+    }
+    mtx_unlock(&self->lock);
+}
+
+void fiber_scheduler_destroy(FiberScheduler *self) {
+    fiber_scheduler_wait(self);
+    mtx_lock(&self->lock);
+    self->stop = true;
+    cnd_broadcast(&self->ready);
+    mtx_unlock(&self->lock);
+    for(u32 i = 0; i < self->count; i++) {
+        thrd_join(self->threads[i], NULL);
+    }
+    vec_foreach(self->stacks, stack) {
+        munmap(stack->base, stack->size);
+    }
+    vec_destroy(self->stacks);
+    if(self->owns_io) {
+        async_io_destroy(self->io);
+    }
+    mtx_destroy(&self->lock);
+    mtx_destroy(&self->io_lock);
+    cnd_destroy(&self->ready);
+    cnd_destroy(&self->idle);
+    Allocator alloc = self->alloc;
+    allocator_free(&alloc, self->threads);
+    allocator_free(&alloc, self);
+}
+
+bool fiber_spawn(FiberScheduler *self, FiberFn fn, void *arg) {
+    Fiber *fiber = allocator_alloc(&self->alloc, sizeof(Fiber));
+    *fiber = (Fiber){ .sched = self, .fn = fn, .arg = arg };
+    if(!_fiber_stack_acquire(self, &fiber->stack)) {
+        allocator_free(&self->alloc, fiber);
+        return false;
+    }
+    u8 *top = fiber->stack.base + fiber->stack.size;
+#ifdef CORE_FIBER_UCONTEXT
+    getcontext(&fiber->ctx);
+    fiber->ctx.uc_stack.ss_sp = top - self->stack_size;
+    fiber->ctx.uc_stack.ss_size = self->stack_size;
+    fiber->ctx.uc_link = NULL;
+    makecontext(&fiber->ctx, _fiber_entry, 0);
+#elif defined(__x86_64__)
+    //  mxcsr/x87 control words, six callee saved registers, the return address and
+    //  an empty slot so the entry sees the stack alignment of a regular call
+    void **sp = (void **)top - 9;
+    memset(sp, 0, 9 * sizeof(void *));
+    //  copied, ISO C has no conversion from a function pointer to `void *`
+    void (*entry)(void) = _fiber_entry;
+    memcpy(&sp[7], &entry, sizeof(entry));
+    u32 control[2] = { 0x1F80, 0x037F };
+    memcpy(sp, control, sizeof(control));
+    fiber->ctx.sp = sp;
+#elif defined(__aarch64__)
+    void **sp = (void **)(top - 0xa0);
+    memset(sp, 0, 0xa0);
+    //  x30, the link register
+    void (*entry)(void) = _fiber_entry;
+    memcpy(&sp[11], &entry, sizeof(entry));
+    fiber->ctx.sp = sp;
+#endif
+    atomic_init(&fiber->state, _FIBER_RUNNING);
+    mtx_lock(&self->lock);
+    self->live++;
+    mtx_unlock(&self->lock);
+    _fiber_push_ready(self, fiber);
+    return true;
+}
+
+Fiber *fiber_current(void) {
+    return _fiber_worker()->current;
+}
+
+void fiber_yield(void) {
+    Fiber *fiber = fiber_current();
+    if(!fiber) {
+        thrd_yield();
+        return;
+    }
+    _fiber_suspend(fiber, _FIBER_ACTION_YIELD);
+}
+
+void fiber_park(void) {
+    Fiber *fiber = fiber_current();
+    CORE_ASSERT(fiber && "fiber_park called outside of a fiber");
+    _fiber_suspend(fiber, _FIBER_ACTION_PARK);
+}
+
+void fiber_wake(Fiber *fiber) {
+    if(atomic_exchange(&fiber->state, _FIBER_NOTIFIED) == _FIBER_PARKED) {
+        _fiber_push_ready(fiber->sched, fiber);
+    }
+}
+
+typedef struct _FiberIOWait {
+    Fiber *fiber;
+    FiberScheduler *sched;
+    i64 result;
+    //  0 pending, 1 completed but still waking the fiber, 2 done
+    _Atomic u32 state;
+}_FiberIOWait;
+
+static void _fiber_io_done(AsyncCompletion *completion) {
+    _FiberIOWait *wait = completion->user_data;
+    wait->result = completion->result;
+    atomic_fetch_sub(&wait->sched->io_pending, 1);
+    atomic_store(&wait->state, 1);
+    fiber_wake(wait->fiber);
+    //  `wait` lives on the fiber's stack, it may be gone after this store
+    atomic_store(&wait->state, 2);
+}
+
+i64 fiber_await_io(AsyncRequest *request) {
+    Fiber *fiber = fiber_current();
+    CORE_ASSERT(fiber && "fiber_await_io called outside of a fiber");
+    FiberScheduler *sched = fiber->sched;
+    CORE_ASSERT(sched->io);
+    _FiberIOWait wait = { .fiber = fiber, .sched = sched };
+    request->callback = _fiber_io_done;
+    request->user_data = &wait;
+    atomic_fetch_add(&sched->io_pending, 1);
+    for(;;) {
+        mtx_lock(&sched->io_lock);
+        size_t queued = async_io_submit(sched->io, request, 1);
+        if(!queued) {
+            //  the queue is full, make room
+            AsyncCompletion sink[16];
+            async_io_poll(sched->io, sink, CORE_ARRLEN(sink));
+        }
+        mtx_unlock(&sched->io_lock);
+        if(queued) {
+            break;
+        }
+        fiber_yield();
+    }
+    //  make sure an idle worker starts polling
+    mtx_lock(&sched->lock);
+    cnd_signal(&sched->ready);
+    mtx_unlock(&sched->lock);
+    u32 state;
+    while((state = atomic_load(&wait.state)) != 2) {
+        if(state == 1) {
+            fiber_yield();
+        } else {
+            fiber_park();
+        }
+    }
+    return wait.result;
+}
+#endif
+
+//  ----------------------------------- //
+//               dir-impl               //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+#ifdef __linux__
+typedef struct _CoreDirent64 {
+    u64 d_ino;
+    i64 d_off;
+    u16 d_reclen;
+    u8 d_type;
+    char d_name[];
+}_CoreDirent64;
+#endif
+
+static DirEntryKind _dir_kind_from_type(u8 type) {
+    switch(type) {
+        case DT_REG: return DIR_ENTRY_FILE;
+        case DT_DIR: return DIR_ENTRY_DIR;
+        case DT_LNK: return DIR_ENTRY_SYMLINK;
+        case DT_UNKNOWN: return DIR_ENTRY_UNKNOWN;
+        default: return DIR_ENTRY_OTHER;
+    }
+}
+
+static DirEntryKind _dir_kind_from_mode(mode_t mode) {
+    if(S_ISREG(mode)) return DIR_ENTRY_FILE;
+    if(S_ISDIR(mode)) return DIR_ENTRY_DIR;
+    if(S_ISLNK(mode)) return DIR_ENTRY_SYMLINK;
+    return DIR_ENTRY_OTHER;
+}
+
+static StringView _dir_arena_copy(Arena *arena, StringView str) {
+    char *data = arena_alloc(arena, str.len + 1);
+    memcpy(data, str.data, str.len);
+    data[str.len] = '\0';
+    return string_view_new(data, str.len);
+}
+
+bool dir_iter_open(DirIter *self, const char *path, Arena *arena) {
+    self->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(self->fd < 0) {
+        return false;
+    }
+    self->path = string_view_from(path);
+    self->arena = arena;
+    self->pos = 0;
+    self->len = 0;
+    self->done = false;
+#ifndef __linux__
+    self->dir = fdopendir(self->fd);
+    if(!self->dir) {
+        close(self->fd);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void dir_iter_close(DirIter *self) {
+#ifdef __linux__
+    close(self->fd);
+#else
+    closedir(self->dir);
+#endif
+    self->fd = -1;
+}
+
+static void _dir_iter_fill_entry(DirIter *self, DirEntry *entry, const char *name, u8 type) {
+    StringView name_view = string_view_from(name);
+    size_t path_len = self->path.len + 1 + name_view.len;
+    char *path = arena_alloc(self->arena, path_len + 1);
+    memcpy(path, self->path.data, self->path.len);
+    path[self->path.len] = '/';
+    memcpy(path + self->path.len + 1, name, name_view.len + 1);
+    *entry = (DirEntry){
+        .name = string_view_new(path + self->path.len + 1, name_view.len),
+        .path = string_view_new(path, path_len),
+        .kind = _dir_kind_from_type(type),
+    };
+}
+
+bool dir_iter_next(DirIter *self, DirEntry *entry) {
+    for(;;) {
+#ifdef __linux__
+        if(self->pos >= self->len) {
+            if(self->done) {
+                return false;
+            }
+            long n = syscall(SYS_getdents64, self->fd, self->buffer, sizeof(self->buffer));
+            if(n <= 0) {
+                self->done = true;
+                return false;
+            }
+            self->pos = 0;
+            self->len = (size_t)n;
+        }
+        _CoreDirent64 *dirent = (_CoreDirent64 *)(self->buffer + self->pos);
+        self->pos += dirent->d_reclen;
+        const char *name = dirent->d_name;
+        u8 type = dirent->d_type;
+#else
+        struct dirent *dirent = readdir(self->dir);
+        if(!dirent) {
+            return false;
+        }
+        const char *name = dirent->d_name;
+        u8 type = dirent->d_type;
+#endif
+        if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        _dir_iter_fill_entry(self, entry, name, type);
+        return true;
+    }
+}
+
+bool dir_iter_stat(DirIter *self, DirEntry *entry) {
+    struct stat st;
+    if(fstatat(self->fd, entry->name.data, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    entry->kind = _dir_kind_from_mode(st.st_mode);
+    entry->size = (u64)st.st_size;
+    entry->mtime = (i64)st.st_mtime;
+    return true;
+}
+
+bool glob_match(StringView pattern, StringView str) {
+    size_t p = 0, s = 0;
+    size_t star_p = (size_t)-1, star_s = 0;
+    while(s < str.len) {
+        if(p < pattern.len) {
+            char c = pattern.data[p];
+            if(c == '*') {
+                star_p = p++;
+                star_s = s;
+                continue;
+            }
+            if(c == '?') {
+                p++;
+                s++;
+                continue;
+            }
+            if(c == '[') {
+                size_t i = p + 1;
+                bool negate = i < pattern.len && (pattern.data[i] == '!' || pattern.data[i] == '^');
+                if(negate) i++;
+                bool matched = false;
+                size_t start = i;
+                while(i < pattern.len && (pattern.data[i] != ']' || i == start)) {
+                    if(i + 2 < pattern.len && pattern.data[i + 1] == '-' && pattern.data[i + 2] != ']') {
+                        matched |= str.data[s] >= pattern.data[i] && str.data[s] <= pattern.data[i + 2];
+                        i += 3;
+                    }else {
+                        matched |= str.data[s] == pattern.data[i];
+                        i++;
+                    }
+                }
+                if(i < pattern.len && matched != negate) {
+                    p = i + 1;
+                    s++;
+                    continue;
+                }
+            }else if(c == str.data[s]) {
+                p++;
+                s++;
+                continue;
+            }
+        }
+        if(star_p == (size_t)-1) {
+            return false;
+        }
+        p = star_p + 1;
+        s = ++star_s;
+    }
+    while(p < pattern.len && pattern.data[p] == '*') {
+        p++;
+    }
+    return p == pattern.len;
+}
+
+typedef struct _DirWalkDir {
+    StringView path;
+    u32 depth;
+}_DirWalkDir;
+
+typedef struct _DirWalkShared {
+    OptDirWalkArg arg;
+    Allocator alloc;
+    mtx_t lock;
+    cnd_t cond;
+    Vec(_DirWalkDir) stack;
+    u32 active;
+}_DirWalkShared;
+
+typedef struct _DirWalkWorker {
+    _DirWalkShared *shared;
+    Arena arena;
+    //  full arenas, retired before they would chain
+    Vec(Arena) arenas;
+    Vec(DirEntry) entries;
+}_DirWalkWorker;
+
+#define _DIR_WALK_ARENA_SIZE CORE_KB(64)
+
+//  `Arena` chains small chunks once it is full and walks that chain on every alloc,
+//  so a worker swaps in a fresh arena while the next path still fits
+static void _dir_walk_reserve(_DirWalkWorker *worker, size_t size) {
+    Arena *arena = &worker->arena;
+    if((size_t)(arena->buffer + vec_cap(arena->buffer) - arena->current_alloc) >= size) {
+        return;
+    }
+    vec_push(worker->arenas, *arena);
+    *arena = arena_new(size > _DIR_WALK_ARENA_SIZE ? size : _DIR_WALK_ARENA_SIZE);
+}
+
+static bool _dir_walk_accept(OptDirWalkArg const *arg, DirEntry const *entry) {
+    if(entry->kind == DIR_ENTRY_DIR && !arg->include_dirs) {
+        return false;
+    }
+    if(arg->extension) {
+        StringView ext = string_view_from(arg->extension);
+        if(entry->name.len < ext.len || memcmp(entry->name.data + entry->name.len - ext.len, ext.data, ext.len) != 0) {
+            return false;
+        }
+    }
+    if(arg->pattern && !glob_match(string_view_from(arg->pattern), entry->name)) {
+        return false;
+    }
+    return true;
+}
+
+static void _dir_walk_visit(_DirWalkWorker *worker, _DirWalkDir dir, DirIter *iter) {
+    _DirWalkShared *shared = worker->shared;
+    if(!dir_iter_open(iter, dir.path.data, &worker->arena)) {
+        return;
+    }
+    DirEntry entry;
+    for(;;) {
+        //  `/`, the longest file name and the terminator
+        _dir_walk_reserve(worker, dir.path.len + 257);
+        if(!dir_iter_next(iter, &entry)) {
+            break;
+        }
+        if(entry.kind == DIR_ENTRY_UNKNOWN || (shared->arg.stat && entry.kind != DIR_ENTRY_DIR)) {
+            dir_iter_stat(iter, &entry);
+        }
+        if(entry.kind == DIR_ENTRY_DIR && (shared->arg.max_depth == 0 || dir.depth + 1 < shared->arg.max_depth)) {
+            _DirWalkDir sub = { .path = entry.path, .depth = dir.depth + 1 };
+            mtx_lock(&shared->lock);
+            vec_push(shared->stack, sub);
+            cnd_signal(&shared->cond);
+            mtx_unlock(&shared->lock);
+        }
+        if(_dir_walk_accept(&shared->arg, &entry)) {
+            if(shared->arg.stat && entry.kind == DIR_ENTRY_DIR) {
+                dir_iter_stat(iter, &entry);
+            }
+            vec_push(worker->entries, entry);
+        }
+    }
+    dir_iter_close(iter);
+}
+
+static i32 _dir_walk_worker(void *arg) {
+    _DirWalkWorker *worker = arg;
+    _DirWalkShared *shared = worker->shared;
+    DirIter *iter = allocator_alloc(&shared->alloc, sizeof(DirIter));
+    if(!iter) {
+        return 1;
+    }
+    mtx_lock(&shared->lock);
+    for(;;) {
+        while(vec_len(shared->stack) == 0 && shared->active > 0) {
+            cnd_wait(&shared->cond, &shared->lock);
+        }
+        if(vec_len(shared->stack) == 0) {
+            break;
+        }
+        _DirWalkDir dir = vec_pop(shared->stack);
+        shared->active++;
+        mtx_unlock(&shared->lock);
+        _dir_walk_visit(worker, dir, iter);
+        mtx_lock(&shared->lock);
+        shared->active--;
+        if(shared->active == 0 && vec_len(shared->stack) == 0) {
+            cnd_broadcast(&shared->cond);
+        }
+    }
+    mtx_unlock(&shared->lock);
+    allocator_free(&shared->alloc, iter);
+    return 0;
+}
+
+DirWalk dir_walk_impl(const char *root, OptDirWalkArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    u32 count = arg.threads ? arg.threads : _core_cpu_count();
+    DirWalk self = { .entries = vec_new(), .arenas = vec_new() };
+    _DirWalkShared shared = { .arg = arg, .alloc = alloc };
+    if(mtx_init(&shared.lock, mtx_plain) != thrd_success) {
+        return self;
+    }
+    if(cnd_init(&shared.cond) != thrd_success) {
+        mtx_destroy(&shared.lock);
+        return self;
+    }
+    _DirWalkWorker *workers = allocator_alloc(&alloc, count * sizeof(_DirWalkWorker));
+    thrd_t *threads = allocator_alloc(&alloc, count * sizeof(thrd_t));
+    if(!workers || !threads) {
+        if(workers) {
+            allocator_free(&alloc, workers);
+        }
+        if(threads) {
+            allocator_free(&alloc, threads);
+        }
+        cnd_destroy(&shared.cond);
+        mtx_destroy(&shared.lock);
+        return self;
+    }
+    shared.stack = vec_new(.allocator = alloc);
+    for(u32 i = 0; i < count; i++) {
+        workers[i] = (_DirWalkWorker){
+            .shared = &shared,
+            .arena = arena_new(_DIR_WALK_ARENA_SIZE),
+            .arenas = vec_new(.allocator = alloc),
+            .entries = vec_new(.allocator = alloc),
+        };
+    }
+    StringView root_view = string_view_from(root);
+    while(root_view.len > 1 && root_view.data[root_view.len - 1] == '/') {
+        root_view.len--;
+    }
+    _dir_walk_reserve(&workers[0], root_view.len + 1);
+    _DirWalkDir first = { .path = _dir_arena_copy(&workers[0].arena, root_view), .depth = 0 };
+    vec_push(shared.stack, first);
+
+    u32 started = 0;
+    for(; started < count; started++) {
+        if(thrd_create(&threads[started], _dir_walk_worker, &workers[started]) != thrd_success) {
+            break;
+        }
+    }
+    if(started == 0) {
+        _dir_walk_worker(&workers[0]);
+    }
+    for(u32 i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    size_t total = 0;
+    size_t arenas = 0;
+    for(u32 i = 0; i < count; i++) {
+        total += vec_len(workers[i].entries);
+        arenas += vec_len(workers[i].arenas) + 1;
+    }
+    self = (DirWalk){
+        .entries = vec_with_size(DirEntry, total, .allocator = alloc),
+        .arenas = vec_with_size(Arena, arenas, .allocator = alloc),
+    };
+    for(u32 i = 0; i < count; i++) {
+        memcpy(self.entries + vec_len(self.entries), workers[i].entries, vec_len(workers[i].entries) * sizeof(DirEntry));
+        vec_len(self.entries) += vec_len(workers[i].entries);
+        vec_destroy(workers[i].entries);
+        vec_foreach(workers[i].arenas, arena) {
+            vec_push(self.arenas, *arena);
+        }
+        vec_destroy(workers[i].arenas);
+        vec_push(self.arenas, workers[i].arena);
+    }
+    vec_destroy(shared.stack);
+    mtx_destroy(&shared.lock);
+    cnd_destroy(&shared.cond);
+    allocator_free(&alloc, workers);
+    allocator_free(&alloc, threads);
+    return self;
+}
+
+void dir_walk_free(DirWalk *self) {
+    vec_foreach(self->arenas, arena) {
+        arena_dealloc(arena);
+    }
+    vec_destroy(self->arenas);
+    vec_destroy(self->entries);
+}
+#endif
+
+//  ----------------------------------- //
+//           file-chunks-impl           //
+//  ----------------------------------- //
+typedef struct _ChunksShared {
+    Vec(StringView) chunks;
+    void **results;
+    ChunkProcessFn process;
+    void *user_data;
+    _Atomic size_t next;
+}_ChunksShared;
+
+typedef struct _ChunksWorker {
+    _ChunksShared *shared;
+    Arena arena;
+}_ChunksWorker;
+
+static i32 _chunks_worker(void *arg) {
+    _ChunksWorker *worker = arg;
+    _ChunksShared *shared = worker->shared;
+    for(;;) {
+        size_t index = atomic_fetch_add(&shared->next, 1);
+        if(index >= vec_len(shared->chunks)) {
+            break;
+        }
+        shared->results[index] = shared->process(shared->chunks[index], &worker->arena, shared->user_data);
+    }
+    return 0;
+}
+
+Vec(StringView) string_view_split_chunks_impl(StringView self, size_t count, char delimiter, OptAllocArg arg) {
+    if(count == 0) {
+        count = 1;
+    }
+    Vec(StringView) chunks = vec_with_size(StringView, count, .allocator = ALLOC_ARG_OR_DEF(arg));
+    size_t target = self.len / count;
+    if(target == 0) {
+        target = 1;
+    }
+    size_t start = 0;
+    while(start < self.len) {
+        size_t end = start + target;
+        if(end >= self.len || vec_len(chunks) + 1 == count) {
+            end = self.len;
+        } else {
+            const char *found = memchr(self.data + end - 1, delimiter, self.len - end + 1);
+            end = found ? (size_t)(found - self.data) + 1 : self.len;
+        }
+        vec_push(chunks, string_view_new(self.data + start, end - start));
+        start = end;
+    }
+    return chunks;
+}
+
+bool string_view_process_chunks_impl(StringView self, ChunkProcessFn process, ChunkMergeFn merge, void *user_data, OptChunksArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    u32 count = arg.threads ? arg.threads : _core_cpu_count();
+    size_t chunk_count = arg.chunks ? arg.chunks : (size_t)count * 4;
+    _ChunksShared shared = {
+        .chunks = string_view_split_chunks(self, chunk_count, arg.delimiter ? arg.delimiter : '\n', .allocator = alloc),
+        .process = process,
+        .user_data = user_data,
+    };
+    if(count > vec_len(shared.chunks)) {
+        count = vec_len(shared.chunks) ? (u32)vec_len(shared.chunks) : 1;
+    }
+    shared.results = allocator_alloc(&alloc, (vec_len(shared.chunks) + 1) * sizeof(void *));
+    _ChunksWorker *workers = allocator_alloc(&alloc, count * sizeof(_ChunksWorker));
+    thrd_t *threads = allocator_alloc(&alloc, count * sizeof(thrd_t));
+    if(!shared.results || !workers || !threads) {
+        if(shared.results) {
+            allocator_free(&alloc, shared.results);
+        }
+        if(workers) {
+            allocator_free(&alloc, workers);
+        }
+        if(threads) {
+            allocator_free(&alloc, threads);
+        }
+        vec_destroy(shared.chunks);
+        return false;
+    }
+    for(u32 i = 0; i < count; i++) {
+        workers[i] = (_ChunksWorker){ .shared = &shared, .arena = arena_new(CORE_KB(64)) };
+    }
+    //  the calling thread takes the first worker slot instead of idling in join
+    u32 started = 1;
+    for(; started < count; started++) {
+        if(thrd_create(&threads[started], _chunks_worker, &workers[started]) != thrd_success) {
+            break;
+        }
+    }
+    _chunks_worker(&workers[0]);
+    for(u32 i = 1; i < started; i++) {
+        thrd_join(threads[i], NULL);
+    }
+
+    if(merge) {
+        for(size_t i = 0; i < vec_len(shared.chunks); i++) {
+            merge(shared.results[i], i, user_data);
+        }
+    }
+    for(u32 i = 0; i < count; i++) {
+        arena_dealloc(&workers[i].arena);
+    }
+    vec_destroy(shared.chunks);
+    allocator_free(&alloc, shared.results);
+    allocator_free(&alloc, workers);
+    allocator_free(&alloc, threads);
+    return true;
+}
+
+bool file_process_chunks_impl(FileHandle self, ChunkProcessFn process, ChunkMergeFn merge, void *user_data, OptChunksArg arg) {
+    FileMapping mapping = file_map(self, .advice = FILE_MAP_SEQUENTIAL);
+    if(!mapping.data) {
+        return false;
+    }
+    bool result = string_view_process_chunks_impl(file_mapping_view(&mapping), process, merge, user_data, arg);
+    file_unmap(&mapping);
+    return result;
+}
+
+//  ----------------------------------- //
+//           file-watcher-impl          //
+//  ----------------------------------- //
+#ifdef __linux__
+#define FILE_WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM \
+                        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ATTRIB)
+
+static i64 _core_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (i64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static u32 _file_watch_kinds(u32 mask) {
+    u32 kinds = 0;
+    if(mask & (IN_CREATE | IN_MOVED_TO)) {
+        kinds |= FILE_WATCH_CREATED;
+    }
+    if(mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+        kinds |= FILE_WATCH_MODIFIED;
+    }
+    if(mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        kinds |= FILE_WATCH_DELETED;
+    }
+    if(mask & IN_ATTRIB) {
+        kinds |= FILE_WATCH_ATTRIB;
+    }
+    if(mask & IN_Q_OVERFLOW) {
+        kinds |= FILE_WATCH_OVERFLOW;
+    }
+    return kinds;
+}
+
+static _FileWatch *_file_watcher_find(FileWatcher *self, i32 wd) {
+    vec_foreach(self->watches, watch) {
+        if(watch->wd == wd) {
+            return watch;
+        }
+    }
+    return NULL;
+}
+
+static void _file_watcher_push(FileWatcher *self, i32 wd, StringView name, u32 kinds) {
+    //  a burst mostly hits a handful of paths, scan from the newest entry
+    for(size_t i = vec_len(self->pending); i > 0; i--) {
+        FileWatchEvent *event = &self->pending[i - 1];
+        if(event->watch == wd && string_view_cmp(event->name, name)) {
+            event->kinds |= kinds;
+            return;
+        }
+    }
+    Arena *arena = &self->arenas[0];
+    _FileWatch *watch = _file_watcher_find(self, wd);
+    size_t dir_len = watch ? watch->len : 0;
+    size_t path_len = dir_len + (name.len ? name.len + 1 : 0);
+    char *path = arena_alloc(arena, path_len + 1);
+    if(watch) {
+        memcpy(path, watch->path, dir_len);
+    }
+    if(name.len) {
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name.data, name.len);
+    }
+    path[path_len] = 0;
+    FileWatchEvent event = {
+        .watch = wd,
+        .path = string_view_new(path, path_len),
+        .name = name.len ? string_view_new(path + dir_len + 1, name.len) : string_view_new(path + path_len, 0),
+        .kinds = kinds,
+    };
+    if(vec_len(self->pending) == 0) {
+        self->batch_start = _core_time_ms();
+    }
+    vec_push(self->pending, event);
+}
+
+static bool _file_watcher_read(FileWatcher *self) {
+    _Alignas(struct inotify_event) char buffer[CORE_KB(16)];
+    for(;;) {
+        ssize_t len = read(self->fd, buffer, sizeof(buffer));
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        }
+        for(char *ptr = buffer; ptr < buffer + len;) {
+            struct inotify_event *ev = (struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+            if(ev->mask & IN_IGNORED) {
+                _FileWatch *watch = _file_watcher_find(self, ev->wd);
+                if(watch) {
+                    allocator_free(&self->alloc, watch->path);
+                    *watch = self->watches[vec_len(self->watches) - 1];
+                    vec_len(self->watches)--;
+                }
+                continue;
+            }
+            u32 kinds = _file_watch_kinds(ev->mask);
+            if(kinds == 0) {
+                continue;
+            }
+            _file_watcher_push(self, ev->wd, ev->len ? string_view_from(ev->name) : string_view_new("", 0), kinds);
+        }
+    }
+}
+
+static i32 _file_watcher_timeout(FileWatcher *self) {
+    if(vec_len(self->pending) == 0) {
+        return -1;
+    }
+    i64 left = self->batch_start + self->coalesce_ms - _core_time_ms();
+    return left > 0 ? (i32)left : 0;
+}
+
+FileWatcher file_watcher_new_impl(OptFileWatcherArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    FileWatcher self = {
+        .fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC),
+        .callback = arg.callback,
+        .user_data = arg.user_data,
+        .coalesce_ms = arg.coalesce_ms,
+        .pending = vec_new(.allocator = alloc),
+        .events = vec_new(.allocator = alloc),
+        .watches = vec_new(.allocator = alloc),
+        .arenas = { arena_new(CORE_KB(4)), arena_new(CORE_KB(4)) },
+        .alloc = alloc,
+    };
+    return self;
+}
+
+void file_watcher_deinit(FileWatcher *self) {
+    if(self->fd >= 0) {
+        close(self->fd);
+    }
+    vec_foreach(self->watches, watch) {
+        allocator_free(&self->alloc, watch->path);
+    }
+    vec_destroy(self->watches);
+    vec_destroy(self->pending);
+    vec_destroy(self->events);
+    arena_dealloc(&self->arenas[0]);
+    arena_dealloc(&self->arenas[1]);
+    self->fd = -1;
+}
+
+i32 file_watcher_add(FileWatcher *self, const char *path) {
+    if(self->fd < 0) {
+        return -1;
+    }
+    i32 wd = inotify_add_watch(self->fd, path, FILE_WATCH_MASK);
+    if(wd < 0) {
+        return -1;
+    }
+    //  the same inode watched twice hands back the old descriptor
+    if(_file_watcher_find(self, wd)) {
+        return wd;
+    }
+    size_t len = strlen(path);
+    while(len > 1 && path[len - 1] == '/') {
+        len--;
+    }
+    _FileWatch watch = { .wd = wd, .path = allocator_alloc(&self->alloc, len + 1), .len = len };
+    memcpy(watch.path, path, len);
+    watch.path[len] = 0;
+    vec_push(self->watches, watch);
+    return wd;
+}
+
+bool file_watcher_remove(FileWatcher *self, i32 watch) {
+    //  the watch entry itself is dropped once IN_IGNORED comes back
+    return inotify_rm_watch(self->fd, watch) == 0;
+}
+
+bool file_watcher_wait_events(FileWatcher *self) {
+    if(self->fd < 0) {
+        return false;
+    }
+    for(;;) {
+        i32 timeout = _file_watcher_timeout(self);
+        if(timeout == 0) {
+            return file_watcher_poll_events(self);
+        }
+        struct pollfd pfd = { .fd = self->fd, .events = POLLIN };
+        i32 ready = poll(&pfd, 1, timeout);
+        if(ready < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if(ready > 0 && !_file_watcher_read(self)) {
+            return false;
+        }
+    }
+}
+
+bool file_watcher_poll_events(FileWatcher *self) {
+    if(self->fd < 0 || !_file_watcher_read(self) || _file_watcher_timeout(self) != 0) {
+        return false;
+    }
+    Vec(FileWatchEvent) batch = self->pending;
+    self->pending = self->events;
+    self->events = batch;
+    vec_clear(self->pending);
+    Arena arena = self->arenas[0];
+    self->arenas[0] = self->arenas[1];
+    self->arenas[1] = arena;
+    arena_clear(&self->arenas[0]);
+    if(self->callback) {
+        self->callback(self->events, vec_len(self->events), self->user_data);
+    }
+    return true;
+}
+#endif
+
+//  ----------------------------------- //
+//           mapped-file-impl           //
+//  ----------------------------------- //
+#ifndef CORE_SSE42
+static u32 _crc32c_table[256];
+static once_flag _crc32c_once = ONCE_FLAG_INIT;
+
+static void _crc32c_table_init(void) {
+    for(u32 i = 0; i < 256; i++) {
+        u32 crc = i;
+        for(u32 k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0u - (crc & 1)));
+        }
+        _crc32c_table[i] = crc;
+    }
+}
+#endif
+
+u32 crc32c(u32 crc, const void *data, size_t len) {
+    const u8 *ptr = data;
+    crc = ~crc;
+#ifdef CORE_SSE42
+    for(; len >= 8; len -= 8, ptr += 8) {
+        u64 word;
+        memcpy(&word, ptr, 8);
+        crc = (u32)_mm_crc32_u64(crc, word);
+    }
+    for(; len > 0; len--, ptr++) {
+        crc = _mm_crc32_u8(crc, *ptr);
+    }
+#else
+    call_once(&_crc32c_once, _crc32c_table_init);
+    for(; len > 0; len--, ptr++) {
+        crc = (crc >> 8) ^ _crc32c_table[(crc ^ *ptr) & 0xFF];
+    }
+#endif
+    return ~crc;
+}
+
+#ifdef PLATFORM_POSIX
+#define APPEND_LOG_MAGIC "CORELOG1"
+#define APPEND_LOG_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+MappedFile mapped_file_open(const char *path) {
+    MappedFile self = { .fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644) };
+    struct stat st;
+    if(self.fd < 0 || fstat(self.fd, &st) != 0) {
+        goto fail;
+    }
+    self.len = (size_t)st.st_size;
+    self.cap = self.len < MAPPED_FILE_MIN_SIZE ? MAPPED_FILE_MIN_SIZE : self.len;
+    if(self.cap != self.len && ftruncate(self.fd, (off_t)self.cap) != 0) {
+        goto fail;
+    }
+    self.data = mmap(NULL, self.cap, PROT_READ | PROT_WRITE, MAP_SHARED, self.fd, 0);
+    if(self.data == MAP_FAILED) {
+        goto fail;
+    }
+    self.synced = self.len;
+    return self;
+fail:
+    if(self.fd >= 0) {
+        close(self.fd);
+    }
+    return (MappedFile){ .fd = -1 };
+}
+
+void mapped_file_close(MappedFile *self) {
+    if(self->data) {
+        munmap(self->data, self->cap);
+        if(ftruncate(self->fd, (off_t)self->len) != 0) {
+            //  the tail stays zero filled, readers stop there anyway
+        }
+        close(self->fd);
+    }
+    *self = (MappedFile){ .fd = -1 };
+}
+
+bool mapped_file_reserve(MappedFile *self, size_t size) {
+    if(size <= self->cap) {
+        return true;
+    }
+    size_t cap = self->cap;
+    while(cap < size) {
+        cap *= 2;
+    }
+    if(ftruncate(self->fd, (off_t)cap) != 0) {
+        return false;
+    }
+#ifdef __linux__
+    void *data = mremap(self->data, self->cap, cap, MREMAP_MAYMOVE);
+#else
+    munmap(self->data, self->cap);
+    void *data = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+#endif
+    if(data == MAP_FAILED) {
+        return false;
+    }
+    self->data = data;
+    self->cap = cap;
+    return true;
+}
+
+void *mapped_file_append(MappedFile *self, size_t size) {
+    if(!mapped_file_reserve(self, self->len + size)) {
+        return NULL;
+    }
+    void *ptr = self->data + self->len;
+    self->len += size;
+    return ptr;
+}
+
+bool mapped_file_sync(MappedFile *self) {
+    if(self->synced >= self->len) {
+        return true;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = self->synced & ~(page - 1);
+    if(msync(self->data + start, self->len - start, MS_SYNC) != 0) {
+        return false;
+    }
+    self->synced = self->len;
+    return true;
+}
+
+static AppendLogIter _append_log_iter(const char *data, size_t len) {
+    if(len < 8 || memcmp(data, APPEND_LOG_MAGIC, 8) != 0) {
+        return (AppendLogIter){ .data = data, .len = 0 };
+    }
+    return (AppendLogIter){ .data = data, .len = len, .pos = 8 };
+}
+
+AppendLog append_log_open_impl(const char *path, OptAppendLogArg arg) {
+    AppendLog self = { .file = mapped_file_open(path), .sync_bytes = arg.sync_bytes };
+    if(!self.file.data) {
+        return self;
+    }
+    if(self.file.len == 0) {
+        char *magic = mapped_file_append(&self.file, 8);
+        if(!magic) {
+            mapped_file_close(&self.file);
+            return self;
+        }
+        memcpy(magic, APPEND_LOG_MAGIC, 8);
+    }
+    AppendLogIter iter = _append_log_iter(self.file.data, self.file.len);
+    if(iter.len == 0) {
+        //  not a log, closing truncates it back to its original size
+        mapped_file_close(&self.file);
+        return self;
+    }
+    Slice(char) record;
+    while(append_log_next(&iter, &record)) {
+        self.count++;
+    }
+    //  drops a torn record or the zero filled tail of an unclean shutdown, the dropped
+    //  bytes are cleared so a shorter record appended later can't make them valid again,
+    //  everything past the old length was zero filled by `ftruncate`
+    memset(self.file.data + iter.pos, 0, self.file.len - iter.pos);
+    self.file.len = iter.pos;
+    self.file.synced = iter.pos;
+    return self;
+}
+
+void append_log_close(AppendLog *self) {
+    if(self->file.data) {
+        mapped_file_sync(&self->file);
+    }
+    mapped_file_close(&self->file);
+}
+
+bool append_log_append(AppendLog *self, const void *data, u32 len) {
+    size_t size = APPEND_LOG_ALIGN(8 + (size_t)len);
+    char *ptr = mapped_file_append(&self->file, size);
+    if(!ptr) {
+        return false;
+    }
+    memcpy(ptr + 8, data, len);
+    //  padding may hold bytes of a dropped torn record
+    memset(ptr + 8 + len, 0, size - 8 - len);
+    u32 crc = crc32c(crc32c(0, &len, 4), data, len);
+    memcpy(ptr, &len, 4);
+    memcpy(ptr + 4, &crc, 4);
+    self->count++;
+    if(self->sync_bytes && self->file.len - self->file.synced >= self->sync_bytes) {
+        return mapped_file_sync(&self->file);
+    }
+    return true;
+}
+
+bool append_log_sync(AppendLog *self) {
+    return mapped_file_sync(&self->file);
+}
+
+AppendLogIter append_log_iter(AppendLog const *self) {
+    return _append_log_iter(self->file.data, self->file.len);
+}
+
+AppendLogIter append_log_iter_mapping(FileMapping const *mapping) {
+    return _append_log_iter(mapping->data, mapping->size);
+}
+
+bool append_log_next(AppendLogIter *iter, Slice(char) *record) {
+    if(iter->len - iter->pos < 8) {
+        return false;
+    }
+    const char *ptr = iter->data + iter->pos;
+    u32 len, crc;
+    memcpy(&len, ptr, 4);
+    memcpy(&crc, ptr + 4, 4);
+    if(len > iter->len - iter->pos - 8 || crc != crc32c(crc32c(0, &len, 4), ptr + 8, len)) {
+        return false;
+    }
+    *record = (_Slice){ .data = (void *)(ptr + 8), .len = len };
+    iter->pos += APPEND_LOG_ALIGN(8 + (size_t)len);
+    if(iter->pos > iter->len) {
+        iter->pos = iter->len;
+    }
+    return true;
+}
+#endif
+
+//  ----------------------------------- //
+//           magic-ring-impl            //
+//  ----------------------------------- //
+#ifdef PLATFORM_POSIX
+static i32 _magic_ring_fd(void) {
+#ifdef __linux__
+    i32 fd = memfd_create("core-magic-ring", MFD_CLOEXEC);
+    if(fd >= 0) {
+        return fd;
+    }
+#endif
+    static _Atomic u32 counter = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "/core-ring-%d-%u", (i32)getpid(), atomic_fetch_add(&counter, 1));
+    i32 fd_shm = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd_shm >= 0) {
+        shm_unlink(name);
+    }
+    return fd_shm;
+}
+
+MagicRing magic_ring_new(size_t capacity) {
+    MagicRing self = {0};
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t cap = capacity ? (capacity + page - 1) / page * page : page;
+    i32 fd = _magic_ring_fd();
+    if(fd < 0) {
+        return self;
+    }
+    if(ftruncate(fd, (off_t)cap) != 0) {
+        close(fd);
+        return self;
+    }
+    //  reserve both halves first so nothing else can land in between
+    char *base = mmap(NULL, 2 * cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+        close(fd);
+        return self;
+    }
+    if(mmap(base, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + cap, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, 2 * cap);
+        close(fd);
+        return self;
+    }
+    //  the mappings keep the memory alive
+    close(fd);
+    self.data = base;
+    self.cap = cap;
+    return self;
+}
+
+void magic_ring_destroy(MagicRing *self) {
+    if(self->data) {
+        munmap(self->data, 2 * self->cap);
+    }
+    self->data = NULL;
+    self->cap = 0;
+}
+
+size_t magic_ring_len(MagicRing *self) {
+    //  `tail` never passes `head`, reading it first keeps a racing consumer from
+    //  moving it beyond the `head` we saw, which would wrap the difference
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    return head - tail;
+}
+
+size_t magic_ring_space(MagicRing *self) {
+    return self->cap - magic_ring_len(self);
+}
+
+Slice(char) magic_ring_write_slice(MagicRing *self) {
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+    return (_Slice){ .data = self->data + head % self->cap, .len = self->cap - (head - tail) };
+}
+
+void magic_ring_commit(MagicRing *self, size_t len) {
+    CORE_ASSERT(len <= magic_ring_space(self));
+    atomic_fetch_add_explicit(&self->head, len, memory_order_release);
+}
+
+Slice(char) magic_ring_read_slice(MagicRing *self) {
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    return (_Slice){ .data = self->data + tail % self->cap, .len = head - tail };
+}
+
+void magic_ring_consume(MagicRing *self, size_t len) {
+    CORE_ASSERT(len <= magic_ring_len(self));
+    atomic_fetch_add_explicit(&self->tail, len, memory_order_release);
+}
+
+size_t magic_ring_write(MagicRing *self, const void *data, size_t len) {
+    Slice(char) region = magic_ring_write_slice(self);
+    size_t count = len < region.len ? len : region.len;
+    memcpy(region.data, data, count);
+    magic_ring_commit(self, count);
+    return count;
+}
+
+size_t magic_ring_read(MagicRing *self, void *out, size_t len) {
+    Slice(char) region = magic_ring_read_slice(self);
+    size_t count = len < region.len ? len : region.len;
+    memcpy(out, region.data, count);
+    magic_ring_consume(self, count);
+    return count;
+}
+#endif
+
+//  ----------------------------------- //
+//             vector-impl              //
+//  ----------------------------------- //
+void *core_vec_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    ArrayHeader *arr = allocator_alloc(&alloc, (capacity * elem_size) + sizeof(ArrayHeader));
+    memset(arr, 0, (capacity * elem_size) + sizeof(ArrayHeader));
+    arr[0].len = 0;
+    arr[0].cap = capacity;
+    arr[0].alloc = alloc;
+    arr++;
+    return arr;
+}
+
+/*static void *core_vec_create_header_present_internal(void *arr, size_t capacity, size_t elem_size) {
+    ArrayHeader *tmp = global_allocator.realloc(vec_header(arr), sizeof(ArrayHeader) + capacity * elem_size);
+    tmp->cap = capacity;
+    tmp++;
+    return tmp;
+}*/
+
+
+//  shared by every empty `Vec` using the default allocator, const so a stray write
+//  faults instead of racing with other threads, the first push moves the vec to
+//  its own allocation
+static const _Alignas(max_align_t) ArrayHeader _core_vec_empty = {0};
+
+static void *_core_vec_grow(void *arr, size_t cap, size_t elem_size) {
+    bool shared = vec_header(arr) == &_core_vec_empty;
+    Allocator alloc = shared ? default_allocator : vec_header(arr)->alloc;
+    ArrayHeader *tmp = allocator_alloc(&alloc, cap * elem_size + sizeof(ArrayHeader));
+    tmp++;
+    vec_len(tmp) = vec_len(arr);
+    vec_cap(tmp) = cap;
+    vec_header(tmp)->alloc = alloc;
+    memcpy(tmp, arr, vec_len(arr) * elem_size);
+    if(!shared) {
+        allocator_free(&alloc, vec_header(arr));
+    }
+    return tmp;
+}
+
+void *core_vec_maygrow_internal(void *arr, size_t elem_size) {
+    if(!arr) {
+        arr = (ArrayHeader *)&_core_vec_empty + 1;
+    }
+    if(vec_len(arr) >= vec_cap(arr)) {
+        return _core_vec_grow(arr, vec_cap(arr) == 0 ? DEFAULT_INITIAL_VECTOR_SIZE : vec_cap(arr) * 2, elem_size);
+    }
+    return arr;
+}
+
+void *core_vec_reserve_internal(void *arr, size_t count, size_t elem_size) {
+    if(!arr) {
+        arr = (ArrayHeader *)&_core_vec_empty + 1;
+    }
+    if(count <= vec_cap(arr)) {
+        return arr;
+    }
+    size_t cap = vec_cap(arr) == 0 ? DEFAULT_INITIAL_VECTOR_SIZE : vec_cap(arr);
+    while(cap < count) {
+        cap *= 2;
+    }
+    return _core_vec_grow(arr, cap, elem_size);
+}
+
+void core_vec_destroy_internal(void *arr) {
+    ArrayHeader *header = arr;
+    if(header == &_core_vec_empty) {
+        return;
+    }
+    allocator_free(&header->alloc, header);
+}
+
+void *core_vec_create_empty_internal(OptAllocArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    if(alloc.self == default_allocator.self && alloc.alloc == default_allocator.alloc && alloc.free == default_allocator.free) {
+        return (ArrayHeader *)&_core_vec_empty + 1;
+    }
+    ArrayHeader *arr = allocator_alloc(&alloc, sizeof(ArrayHeader));
+    memset(arr, 0, sizeof(ArrayHeader));
+    arr[0].len = 0;
+    arr[0].cap = 0;
+    arr[0].alloc = alloc;
+    arr++;
+    return arr;
+}
+
+void *core_vec_copy(void *arr, size_t elem_size, OptAllocArg arg) {
+    ArrayHeader *other = arr;
+    size_t other_cap = other[-1].cap;
+    ArrayHeader *new = core_vec_create_internal(other_cap, elem_size, arg);
+    new[-1].len = other[-1].len;
+    memcpy((void*)new, arr, new[-1].len * elem_size);
+    return new;
+}
+
+void *core_vec_create_from_parts_internal(void *ptr, size_t size, size_t elem_size, OptAllocArg arg) {
+    void *vec = core_vec_create_internal(size, elem_size, arg);
+    vec_len(vec) = size;
+    memcpy(vec, ptr, size * elem_size);
+    return vec;
+}
+
+size_t core_vec_find(void *vec, size_t elem_size, void *pred, size_t pred_size, EqCallback callback) {
+    if(elem_size != pred_size) {
+        return FIND_NO_ELEM;
+    }
+    vec_iter(vec, i) {
+        if(callback((char*)vec + (i * elem_size), pred)) {
+            return i;
+        }
+    }
+    return FIND_NO_ELEM;
+}
+
+bool core_vec_remove(void *vec, size_t elem_size, size_t index) {
+    if(index >= vec_len(vec)) {
+        return false;
+    }
+    memmove((char*)vec + index * elem_size, (char*)vec + (index + 1) * elem_size, (vec_len(vec) - index - 1) * elem_size);
+    vec_len(vec)--;
+    return true;
+}
+
+void vec_dump(void *vec) {
+    println("Vec { data: [..], len: %zu, cap: %zu }", vec_len(vec), vec_cap(vec));
+}
+
+//  ----------------------------------- //
+//            small-vec-impl            //
+//  ----------------------------------- //
+void core_small_vec_init_internal(SmallVecHeader *header, OptAllocArg arg) {
+    *header = (SmallVecHeader){ .alloc = ALLOC_ARG_OR_DEF(arg) };
+}
+
+bool core_small_vec_maygrow_internal(SmallVecHeader *header, void *inline_data, size_t inline_cap, size_t elem_size) {
+    size_t cap = header->heap ? header->cap : inline_cap;
+    if(header->len < cap) {
+        return true;
+    }
+    if(!header->alloc.alloc) {
+        header->alloc = default_allocator;
+    }
+    size_t new_cap = cap ? cap * 2 : DEFAULT_INITIAL_VECTOR_SIZE;
+    void *heap;
+    if(header->heap) {
+        heap = allocator_realloc(&header->alloc, header->heap, new_cap * elem_size);
+    } else {
+        //  spill the inline elements
+        heap = allocator_alloc(&header->alloc, new_cap * elem_size);
+        if(heap) {
+            memcpy(heap, inline_data, header->len * elem_size);
+        }
+    }
+    if(!heap) {
+        return false;
+    }
+    header->heap = heap;
+    header->cap = new_cap;
+    return true;
+}
+
+void core_small_vec_destroy_internal(SmallVecHeader *header) {
+    if(header->heap) {
+        allocator_free(&header->alloc, header->heap);
+    }
+    header->heap = NULL;
+    header->len = 0;
+    header->cap = 0;
+}
+
+//  ----------------------------------- //
+//              sync-impl               //
+//  ----------------------------------- //
+#ifdef CORE_SYNC_STATS
+static _Atomic u64 _sync_acquires = 0;
+static _Atomic u64 _sync_contended = 0;
+static _Atomic u64 _sync_sleeps = 0;
+#define _SYNC_COUNT(counter) atomic_fetch_add_explicit(&(counter), 1, memory_order_relaxed)
+#else
+#define _SYNC_COUNT(counter)
+#endif
+
+SyncStats sync_stats(void) {
+#ifdef CORE_SYNC_STATS
+    return (SyncStats){
+        .acquires = atomic_load_explicit(&_sync_acquires, memory_order_relaxed),
+        .contended = atomic_load_explicit(&_sync_contended, memory_order_relaxed),
+        .sleeps = atomic_load_explicit(&_sync_sleeps, memory_order_relaxed),
+    };
+#else
+    return (SyncStats){0};
+#endif
+}
+
+void sync_stats_reset(void) {
+#ifdef CORE_SYNC_STATS
+    atomic_store(&_sync_acquires, 0);
+    atomic_store(&_sync_contended, 0);
+    atomic_store(&_sync_sleeps, 0);
+#endif
+}
+
+#if defined(PLATFORM_WIN32) && defined(_MSC_VER)
+#pragma comment(lib, "synchronization.lib")
+#endif
+
+#if !defined(__linux__) && !defined(PLATFORM_WIN32)
+//  no futex, sleepers park on a condition variable picked by address
+#define _FUTEX_BUCKETS 64
+typedef struct _FutexBucket {
+    mtx_t lock;
+    cnd_t cond;
+}_FutexBucket;
+
+static _FutexBucket _futex_buckets[_FUTEX_BUCKETS];
+static once_flag _futex_buckets_once = ONCE_FLAG_INIT;
+
+static void _futex_buckets_init(void) {
+    for(size_t i = 0; i < _FUTEX_BUCKETS; i++) {
+        mtx_init(&_futex_buckets[i].lock, mtx_plain);
+        cnd_init(&_futex_buckets[i].cond);
+    }
+}
+
+static _FutexBucket *_futex_bucket(_Atomic u32 *addr) {
+    call_once(&_futex_buckets_once, _futex_buckets_init);
+    return &_futex_buckets[((ptr_t)addr >> 2) % _FUTEX_BUCKETS];
+}
+#endif
+
+void futex_wait(_Atomic u32 *addr, u32 expected) {
+    _SYNC_COUNT(_sync_sleeps);
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#elif defined(PLATFORM_WIN32)
+    WaitOnAddress((volatile void *)addr, &expected, sizeof(u32), INFINITE);
+#else
+    _FutexBucket *bucket = _futex_bucket(addr);
+    mtx_lock(&bucket->lock);
+    if(atomic_load(addr) == expected) {
+        cnd_wait(&bucket->cond, &bucket->lock);
+    }
+    mtx_unlock(&bucket->lock);
+#endif
+}
+
+void futex_wake_one(_Atomic u32 *addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#elif defined(PLATFORM_WIN32)
+    WakeByAddressSingle((void *)addr);
+#else
+    //  buckets are shared, waking only one could pick a sleeper of another address
+    futex_wake_all(addr);
+#endif
+}
+
+void futex_wake_all(_Atomic u32 *addr) {
+#if defined(__linux__)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#elif defined(PLATFORM_WIN32)
+    WakeByAddressAll((void *)addr);
+#else
+    _FutexBucket *bucket = _futex_bucket(addr);
+    mtx_lock(&bucket->lock);
+    cnd_broadcast(&bucket->cond);
+    mtx_unlock(&bucket->lock);
+#endif
+}
+
+bool spin_try_lock(SpinLock *self) {
+    return !atomic_load_explicit(&self->locked, memory_order_relaxed) &&
+        !atomic_exchange_explicit(&self->locked, true, memory_order_acquire);
+}
+
+void spin_lock(SpinLock *self) {
+    _SYNC_COUNT(_sync_acquires);
+    if(spin_try_lock(self)) {
+        return;
+    }
+    _SYNC_COUNT(_sync_contended);
+    for(u32 spins = 0; !spin_try_lock(self); spins++) {
+        if(spins < SYNC_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            thrd_yield();
+        }
+    }
+}
+
+void spin_unlock(SpinLock *self) {
+    atomic_store_explicit(&self->locked, false, memory_order_release);
+}
+
+bool mutex_try_lock(Mutex *self) {
+    u32 expected = 0;
+    return atomic_compare_exchange_strong_explicit(&self->state, &expected, 1, memory_order_acquire, memory_order_relaxed);
+}
+
+void mutex_lock(Mutex *self) {
+    _SYNC_COUNT(_sync_acquires);
+    if(mutex_try_lock(self)) {
+        return;
+    }
+    _SYNC_COUNT(_sync_contended);
+    for(u32 spins = 0; spins < SYNC_SPIN_COUNT; spins++) {
+        cpu_relax();
+        if(atomic_load_explicit(&self->state, memory_order_relaxed) == 0 && mutex_try_lock(self)) {
+            return;
+        }
+    }
+    //  mark the mutex as having sleepers, whoever unlocks it next has to wake one
+    while(atomic_exchange_explicit(&self->state, 2, memory_order_acquire) != 0) {
+        futex_wait(&self->state, 2);
+    }
+}
+
+void mutex_unlock(Mutex *self) {
+    if(atomic_exchange_explicit(&self->state, 0, memory_order_release) == 2) {
+        futex_wake_one(&self->state);
+    }
+}
+
+#define _RWLOCK_SLEEPERS 0x80000000u
+
+static bool _rwlock_try_read(RwLock *self, u32 *state) {
+    u32 count = *state & RWLOCK_WRITER;
+    if(count >= RWLOCK_WRITER - 1) {
+        return false;
+    }
+    return atomic_compare_exchange_weak_explicit(&self->state, state, *state + 1, memory_order_acquire, memory_order_relaxed);
+}
+
+static bool _rwlock_try_write(RwLock *self, u32 *state) {
+    if((*state & RWLOCK_WRITER) != 0) {
+        return false;
+    }
+    //  keep the sleeper bit, unlocking wakes them
+    return atomic_compare_exchange_weak_explicit(&self->state, state, *state | RWLOCK_WRITER, memory_order_acquire, memory_order_relaxed);
+}
+
+//  sets the sleeper bit and sleeps unless the state changed in between
+static void _rwlock_sleep(RwLock *self, u32 state) {
+    if(!(state & _RWLOCK_SLEEPERS) &&
+        !atomic_compare_exchange_strong_explicit(&self->state, &state, state | _RWLOCK_SLEEPERS, memory_order_relaxed, memory_order_relaxed)) {
+        return;
+    }
+    futex_wait(&self->state, state | _RWLOCK_SLEEPERS);
+}
+
+bool rwlock_try_read_lock(RwLock *self) {
+    u32 state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    while((state & RWLOCK_WRITER) < RWLOCK_WRITER - 1) {
+        if(_rwlock_try_read(self, &state)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void rwlock_read_lock(RwLock *self) {
+    _SYNC_COUNT(_sync_acquires);
+    u32 state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    if(_rwlock_try_read(self, &state)) {
+        return;
+    }
+    _SYNC_COUNT(_sync_contended);
+    for(u32 spins = 0;; spins++) {
+        if(_rwlock_try_read(self, &state)) {
+            return;
+        }
+        if((state & RWLOCK_WRITER) < RWLOCK_WRITER - 1) {
+            //  lost a race against another reader
+            continue;
+        }
+        if(spins < SYNC_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            _rwlock_sleep(self, state);
+        }
+        state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    }
+}
+
+void rwlock_read_unlock(RwLock *self) {
+    u32 state = atomic_fetch_sub_explicit(&self->state, 1, memory_order_release);
+    if((state & RWLOCK_WRITER) == 1 && (state & _RWLOCK_SLEEPERS)) {
+        atomic_fetch_and_explicit(&self->state, ~_RWLOCK_SLEEPERS, memory_order_relaxed);
+        futex_wake_all(&self->state);
+    }
+}
+
+bool rwlock_try_write_lock(RwLock *self) {
+    u32 state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    while((state & RWLOCK_WRITER) == 0) {
+        if(_rwlock_try_write(self, &state)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void rwlock_write_lock(RwLock *self) {
+    _SYNC_COUNT(_sync_acquires);
+    u32 state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    if(_rwlock_try_write(self, &state)) {
+        return;
+    }
+    _SYNC_COUNT(_sync_contended);
+    for(u32 spins = 0;; spins++) {
+        if(_rwlock_try_write(self, &state)) {
+            return;
+        }
+        if((state & RWLOCK_WRITER) == 0) {
+            continue;
+        }
+        if(spins < SYNC_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            _rwlock_sleep(self, state);
+        }
+        state = atomic_load_explicit(&self->state, memory_order_relaxed);
+    }
+}
+
+void rwlock_write_unlock(RwLock *self) {
+    if(atomic_exchange_explicit(&self->state, 0, memory_order_release) & _RWLOCK_SLEEPERS) {
+        futex_wake_all(&self->state);
+    }
+}
+
+void event_set(Event *self) {
+    if(atomic_exchange_explicit(&self->set, 1, memory_order_release) == 0) {
+        futex_wake_all(&self->set);
+    }
+}
+
+void event_reset(Event *self) {
+    atomic_store_explicit(&self->set, 0, memory_order_relaxed);
+}
+
+bool event_is_set(Event *self) {
+    return atomic_load_explicit(&self->set, memory_order_acquire) != 0;
+}
+
+void event_wait(Event *self) {
+    while(!event_is_set(self)) {
+        futex_wait(&self->set, 0);
+    }
+}
+
+void semaphore_post(Semaphore *self, u32 count) {
+    atomic_fetch_add_explicit(&self->count, count, memory_order_release);
+    if(atomic_load(&self->sleepers) > 0) {
+        if(count == 1) {
+            futex_wake_one(&self->count);
+        } else {
+            futex_wake_all(&self->count);
+        }
+    }
+}
+
+bool semaphore_try_wait(Semaphore *self) {
+    u32 count = atomic_load_explicit(&self->count, memory_order_relaxed);
+    while(count > 0) {
+        if(atomic_compare_exchange_weak_explicit(&self->count, &count, count - 1, memory_order_acquire, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void semaphore_wait(Semaphore *self) {
+    _SYNC_COUNT(_sync_acquires);
+    if(semaphore_try_wait(self)) {
+        return;
+    }
+    _SYNC_COUNT(_sync_contended);
+    for(u32 spins = 0; spins < SYNC_SPIN_COUNT; spins++) {
+        cpu_relax();
+        if(semaphore_try_wait(self)) {
+            return;
+        }
+    }
+    //  the seq_cst increment pairs with the load in `semaphore_post`
+    atomic_fetch_add(&self->sleepers, 1);
+    while(!semaphore_try_wait(self)) {
+        futex_wait(&self->count, 0);
+    }
+    atomic_fetch_sub(&self->sleepers, 1);
+}
+
+bool barrier_wait(Barrier *self) {
+    u32 generation = atomic_load_explicit(&self->generation, memory_order_acquire);
+    if(atomic_fetch_add_explicit(&self->arrived, 1, memory_order_acq_rel) + 1 == self->threads) {
+        atomic_store_explicit(&self->arrived, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&self->generation, 1, memory_order_release);
+        futex_wake_all(&self->generation);
+        return true;
+    }
+    for(u32 spins = 0; atomic_load_explicit(&self->generation, memory_order_acquire) == generation; spins++) {
+        if(spins < SYNC_SPIN_COUNT) {
+            cpu_relax();
+        } else {
+            futex_wait(&self->generation, generation);
+        }
+    }
+    return false;
+}
+
+enum {
+    _ONCE_NEW,
+    _ONCE_RUNNING,
+    _ONCE_DONE,
+};
+
+void once_call(Once *self, void (*fn)(void *arg), void *arg) {
+    if(atomic_load_explicit(&self->state, memory_order_acquire) == _ONCE_DONE) {
+        return;
+    }
+    u32 expected = _ONCE_NEW;
+    if(atomic_compare_exchange_strong_explicit(&self->state, &expected, _ONCE_RUNNING, memory_order_acquire, memory_order_acquire)) {
+        fn(arg);
+        atomic_store_explicit(&self->state, _ONCE_DONE, memory_order_release);
+        futex_wake_all(&self->state);
+        return;
+    }
+    while(atomic_load_explicit(&self->state, memory_order_acquire) != _ONCE_DONE) {
+        futex_wait(&self->state, _ONCE_RUNNING);
+    }
+}
+
+//  ----------------------------------- //
+//              queue-impl              //
+//  ----------------------------------- //
+static size_t _queue_round_cap(size_t capacity) {
+    size_t cap = 2;
+    while(cap < capacity) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+void core_queue_destroy_internal(void *header, Allocator alloc) {
+    allocator_free(&alloc, header);
+}
+
+void *core_spsc_queue_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    size_t cap = _queue_round_cap(capacity);
+    SpscQueueHeader *header = allocator_alloc(&alloc, sizeof(SpscQueueHeader) + cap * elem_size);
+    if(!header) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(SpscQueueHeader));
+    header->cap = cap;
+    header->alloc = alloc;
+    return header + 1;
+}
+
+size_t core_spsc_queue_push_internal(void *queue, const void *items, size_t count, size_t elem_size) {
+    SpscQueueHeader *header = spsc_queue_header(queue);
+    size_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    //  only touch the consumer's line when the cached view says the queue is full
+    if(header->cap - (head - header->cached_tail) < count) {
+        header->cached_tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    }
+    size_t free = header->cap - (head - header->cached_tail);
+    size_t n = count < free ? count : free;
+    size_t offset = head & (header->cap - 1);
+    size_t first = header->cap - offset < n ? header->cap - offset : n;
+    memcpy((char *)queue + offset * elem_size, items, first * elem_size);
+    memcpy(queue, (const char *)items + first * elem_size, (n - first) * elem_size);
+    atomic_store_explicit(&header->head, head + n, memory_order_release);
+    return n;
+}
+
+size_t core_spsc_queue_pop_internal(void *queue, void *out, size_t count, size_t elem_size) {
+    SpscQueueHeader *header = spsc_queue_header(queue);
+    size_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    if(header->cached_head - tail < count) {
+        header->cached_head = atomic_load_explicit(&header->head, memory_order_acquire);
+    }
+    size_t available = header->cached_head - tail;
+    size_t n = count < available ? count : available;
+    size_t offset = tail & (header->cap - 1);
+    size_t first = header->cap - offset < n ? header->cap - offset : n;
+    memcpy(out, (char *)queue + offset * elem_size, first * elem_size);
+    memcpy((char *)out + first * elem_size, queue, (n - first) * elem_size);
+    atomic_store_explicit(&header->tail, tail + n, memory_order_release);
+    return n;
+}
+
+size_t core_spsc_queue_len_internal(void *queue) {
+    SpscQueueHeader *header = spsc_queue_header(queue);
+    size_t tail = atomic_load_explicit(&header->tail, memory_order_acquire);
+    return atomic_load_explicit(&header->head, memory_order_acquire) - tail;
+}
+
+void *core_mpmc_queue_create_internal(size_t capacity, size_t elem_size, OptAllocArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    size_t cap = _queue_round_cap(capacity);
+    size_t data_size = (cap * elem_size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+    MpmcQueueHeader *header = allocator_alloc(&alloc, sizeof(MpmcQueueHeader) + data_size + cap * sizeof(size_t));
+    if(!header) {
+        return NULL;
+    }
+    memset(header, 0, sizeof(MpmcQueueHeader));
+    header->cap = cap;
+    header->alloc = alloc;
+    header->sequence = (_Atomic size_t *)((char *)(header + 1) + data_size);
+    for(size_t i = 0; i < cap; i++) {
+        atomic_init(&header->sequence[i], i);
+    }
+    return header + 1;
+}
+
+//  a slot is free for position `pos` once its sequence is `pos`, and holds the
+//  element of `pos` once it is `pos + 1`; a run is claimed when its last slot is
+//  ready, earlier slots may still be finishing a copy on another thread
+static size_t _mpmc_queue_claim(MpmcQueueHeader *header, _Atomic size_t *cursor, size_t ready_offset, size_t *count) {
+    size_t mask = header->cap - 1;
+    size_t pos = atomic_load_explicit(cursor, memory_order_relaxed);
+    size_t n = *count;
+    for(;;) {
+        size_t last = pos + n - 1;
+        intptr_t diff = (intptr_t)atomic_load_explicit(&header->sequence[last & mask], memory_order_acquire) - (intptr_t)(last + ready_offset);
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_explicit(cursor, &pos, pos + n, memory_order_relaxed, memory_order_relaxed)) {
+                *count = n;
+                return pos;
+            }
+        } else if(diff > 0) {
+            pos = atomic_load_explicit(cursor, memory_order_relaxed);
+        } else if(n > 1) {
+            n /= 2;
+        } else {
+            *count = 0;
+            return 0;
+        }
+    }
+}
+
+size_t core_mpmc_queue_push_internal(void *queue, const void *items, size_t count, size_t elem_size) {
+    MpmcQueueHeader *header = mpmc_queue_header(queue);
+    size_t mask = header->cap - 1;
+    size_t pushed = 0;
+    while(pushed < count) {
+        size_t n = count - pushed;
+        size_t pos = _mpmc_queue_claim(header, &header->enqueue_pos, 0, &n);
+        if(n == 0) {
+            break;
+        }
+        for(size_t i = 0; i < n; i++) {
+            size_t slot = (pos + i) & mask;
+            while(atomic_load_explicit(&header->sequence[slot], memory_order_acquire) != pos + i) {
+                thrd_yield();
+            }
+            memcpy((char *)queue + slot * elem_size, (const char *)items + (pushed + i) * elem_size, elem_size);
+            atomic_store_explicit(&header->sequence[slot], pos + i + 1, memory_order_release);
+        }
+        pushed += n;
+    }
+    return pushed;
+}
+
+size_t core_mpmc_queue_pop_internal(void *queue, void *out, size_t count, size_t elem_size) {
+    MpmcQueueHeader *header = mpmc_queue_header(queue);
+    size_t mask = header->cap - 1;
+    size_t popped = 0;
+    while(popped < count) {
+        size_t n = count - popped;
+        size_t pos = _mpmc_queue_claim(header, &header->dequeue_pos, 1, &n);
+        if(n == 0) {
+            break;
+        }
+        for(size_t i = 0; i < n; i++) {
+            size_t slot = (pos + i) & mask;
+            while(atomic_load_explicit(&header->sequence[slot], memory_order_acquire) != pos + i + 1) {
+                thrd_yield();
+            }
+            memcpy((char *)out + (popped + i) * elem_size, (char *)queue + slot * elem_size, elem_size);
+            atomic_store_explicit(&header->sequence[slot], pos + i + header->cap, memory_order_release);
+        }
+        popped += n;
+    }
+    return popped;
+}
+
+size_t core_mpmc_queue_len_internal(void *queue) {
+    MpmcQueueHeader *header = mpmc_queue_header(queue);
+    size_t dequeue = atomic_load_explicit(&header->dequeue_pos, memory_order_acquire);
+    size_t enqueue = atomic_load_explicit(&header->enqueue_pos, memory_order_acquire);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+}
+
+//  ----------------------------------- //
+//              utf8-impl               //
+//  ----------------------------------- //
+u32 utf8_decode(const char *data, size_t len, size_t *advance) {
+    const u8 *s = (const u8 *)data;
+    *advance = 1;
+    if(s[0] < 0x80) {
+        return s[0];
+    }
+    size_t n = 0;
+    u32 cp = 0;
+    u8 lo = 0x80, hi = 0xBF;
+    if(s[0] < 0xC2) {
+        return UTF8_INVALID;
+    }else if(s[0] < 0xE0) {
+        n = 2;
+        cp = s[0] & 0x1F;
+    }else if(s[0] < 0xF0) {
+        n = 3;
+        cp = s[0] & 0x0F;
+        if(s[0] == 0xE0) lo = 0xA0;
+        if(s[0] == 0xED) hi = 0x9F;
+    }else if(s[0] < 0xF5) {
+        n = 4;
+        cp = s[0] & 0x07;
+        if(s[0] == 0xF0) lo = 0x90;
+        if(s[0] == 0xF4) hi = 0x8F;
+    }else {
+        return UTF8_INVALID;
+    }
+    if(len < n || s[1] < lo || s[1] > hi) {
+        return UTF8_INVALID;
+    }
+    cp = (cp << 6) | (s[1] & 0x3F);
+    for(size_t i = 2; i < n; i++) {
+        if((s[i] & 0xC0) != 0x80) {
+            return UTF8_INVALID;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+    *advance = n;
+    return cp;
+}
+
+size_t utf8_encode(u32 cp, char out[4]) {
+    if(cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if(cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if(cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        cp = UTF8_REPLACEMENT_CHAR;
+    }
+    if(cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+//  number of leading ascii bytes, 8 at a time
+static size_t _utf8_ascii_prefix(const char *data, size_t len) {
+    size_t i = 0;
+    for(; i + 8 <= len; i += 8) {
+        u64 word;
+        memcpy(&word, data + i, sizeof(word));
+        if(word & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while(i < len && (u8)data[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+static bool _utf8_validate_scalar(const char *data, size_t len) {
+    size_t i = 0;
+    while(i < len) {
+        i += _utf8_ascii_prefix(data + i, len - i);
+        if(i >= len) {
+            break;
+        }
+        size_t advance;
+        if(utf8_decode(data + i, len - i, &advance) == UTF8_INVALID) {
+            return false;
+        }
+        i += advance;
+    }
+    return true;
+}
+
+#ifdef CORE_AVX2
+//  lookup based validation from Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"
+#define _UTF8_TOO_SHORT      (1 << 0)
+#define _UTF8_TOO_LONG       (1 << 1)
+#define _UTF8_OVERLONG_3     (1 << 2)
+#define _UTF8_TOO_LARGE      (1 << 3)
+#define _UTF8_SURROGATE      (1 << 4)
+#define _UTF8_OVERLONG_2     (1 << 5)
+#define _UTF8_TOO_LARGE_1000 (1 << 6)
+#define _UTF8_OVERLONG_4     (1 << 6)
+#define _UTF8_TWO_CONTS      (1 << 7)
+#define _UTF8_CARRY (_UTF8_TOO_SHORT | _UTF8_TOO_LONG | _UTF8_TWO_CONTS)
+
+#ifdef _MSC_VER
+#define _core_popcount32 __popcnt
+#else
+#define _core_popcount32 __builtin_popcount
+#endif
+#define _UTF8_TABLE16(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+static inline __m256i _utf8_avx2_prev(__m256i input, __m256i prev_input, i32 n) {
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch(n) {
+        case 1: return _mm256_alignr_epi8(input, shifted, 15);
+        case 2: return _mm256_alignr_epi8(input, shifted, 14);
+        default: return _mm256_alignr_epi8(input, shifted, 13);
+    }
+}
+
+static inline __m256i _utf8_avx2_check_block(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_tbl = _UTF8_TABLE16(
+        _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG,
+        _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG,
+        _UTF8_TWO_CONTS, _UTF8_TWO_CONTS, _UTF8_TWO_CONTS, _UTF8_TWO_CONTS,
+        _UTF8_TOO_SHORT | _UTF8_OVERLONG_2,
+        _UTF8_TOO_SHORT,
+        _UTF8_TOO_SHORT | _UTF8_OVERLONG_3 | _UTF8_SURROGATE,
+        _UTF8_TOO_SHORT | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000 | _UTF8_OVERLONG_4
+    );
+    const __m256i byte_1_low_tbl = _UTF8_TABLE16(
+        _UTF8_CARRY | _UTF8_OVERLONG_3 | _UTF8_OVERLONG_2 | _UTF8_OVERLONG_4,
+        _UTF8_CARRY | _UTF8_OVERLONG_2,
+        _UTF8_CARRY,
+        _UTF8_CARRY,
+        _UTF8_CARRY | _UTF8_TOO_LARGE,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000 | _UTF8_SURROGATE,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+        _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000
+    );
+    const __m256i byte_2_high_tbl = _UTF8_TABLE16(
+        _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT,
+        _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT,
+        (char)(_UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_OVERLONG_3 | _UTF8_TOO_LARGE_1000 | _UTF8_OVERLONG_4),
+        (char)(_UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_OVERLONG_3 | _UTF8_TOO_LARGE),
+        (char)(_UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_SURROGATE | _UTF8_TOO_LARGE),
+        (char)(_UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_SURROGATE | _UTF8_TOO_LARGE),
+        _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT
+    );
+
+    __m256i prev1 = _utf8_avx2_prev(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_tbl, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_tbl, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_tbl, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i prev2 = _utf8_avx2_prev(input, prev_input, 2);
+    __m256i prev3 = _utf8_avx2_prev(input, prev_input, 3);
+    //  only 111_____ / 1111____ end up >= 0x80
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23_80 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23_80, special_cases);
+}
+
+static inline __m256i _utf8_avx2_incomplete(__m256i input) {
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+    );
+    return _mm256_subs_epu8(input, max_value);
+}
+
+static bool _utf8_validate_avx2(const char *data, size_t len) {
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i < len; i += 32) {
+        __m256i input;
+        if(i + 32 <= len) {
+            input = _mm256_loadu_si256((const __m256i *)(data + i));
+        }else {
+            char tail[32] = {0};
+            memcpy(tail, data + i, len - i);
+            input = _mm256_loadu_si256((const __m256i *)tail);
+        }
+        if(_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        }else {
+            error = _mm256_or_si256(error, _utf8_avx2_check_block(input, prev_input));
+            prev_incomplete = _utf8_avx2_incomplete(input);
+        }
+        prev_input = input;
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error);
+}
+#endif
+
+bool utf8_validate(StringView str) {
+#ifdef CORE_AVX2
+    return _utf8_validate_avx2(str.data, str.len);
+#else
+    return _utf8_validate_scalar(str.data, str.len);
+#endif
+}
+
+size_t utf8_count(StringView str) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef CORE_AVX2
+    //  every byte that is not a continuation byte (10______) starts a codepoint
+    const __m256i cont_max = _mm256_set1_epi8((char)0xBF);
+    for(; i + 32 <= str.len; i += 32) {
+        __m256i input = _mm256_loadu_si256((const __m256i *)(str.data + i));
+        count += _core_popcount32((u32)_mm256_movemask_epi8(_mm256_cmpgt_epi8(input, cont_max)));
+    }
+#endif
+    for(; i < str.len; i++) {
+        count += ((u8)str.data[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+Utf8Iter utf8_iter(StringView str) {
+    return (Utf8Iter){ .str = str, .index = 0 };
+}
+
+bool utf8_next(Utf8Iter *self, u32 *cp) {
+    if(self->index >= self->str.len) {
+        return false;
+    }
+    size_t advance;
+    u32 value = utf8_decode(self->str.data + self->index, self->str.len - self->index, &advance);
+    *cp = value == UTF8_INVALID ? UTF8_REPLACEMENT_CHAR : value;
+    self->index += advance;
+    return true;
+}
+
+//  widens the ascii run at the start of `data` into `out`, returns the amount of bytes consumed
+static size_t _utf8_widen_ascii_u16(const char *data, size_t len, u16 *out) {
+    size_t i = 0;
+#ifdef CORE_AVX2
+    for(; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128((const __m128i *)(data + i));
+        if(_mm_movemask_epi8(input)) {
+            break;
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_cvtepu8_epi16(input));
+    }
+#endif
+    for(; i < len && (u8)data[i] < 0x80; i++) {
+        out[i] = (u8)data[i];
+    }
+    return i;
+}
+
+static size_t _utf8_widen_ascii_u32(const char *data, size_t len, u32 *out) {
+    size_t i = 0;
+#ifdef CORE_AVX2
+    for(; i + 8 <= len; i += 8) {
+        __m128i input = _mm_loadl_epi64((const __m128i *)(data + i));
+        if(_mm_movemask_epi8(input)) {
+            break;
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_cvtepu8_epi32(input));
+    }
+#endif
+    for(; i < len && (u8)data[i] < 0x80; i++) {
+        out[i] = (u8)data[i];
+    }
+    return i;
+}
+
+Vec(u16) utf8_to_utf16_impl(StringView str, OptAllocArg arg) {
+    //  every utf8 sequence yields at most one utf16 unit per byte
+    Vec(u16) out = vec_with_size(u16, str.len + 1, .allocator = arg.allocator);
+    size_t i = 0, len = 0;
+    while(i < str.len) {
+        size_t ascii = _utf8_widen_ascii_u16(str.data + i, str.len - i, out + len);
+        i += ascii;
+        len += ascii;
+        if(i >= str.len) {
+            break;
+        }
+        size_t advance;
+        u32 cp = utf8_decode(str.data + i, str.len - i, &advance);
+        if(cp == UTF8_INVALID) {
+            cp = UTF8_REPLACEMENT_CHAR;
+        }
+        if(cp >= 0x10000) {
+            cp -= 0x10000;
+            out[len++] = (u16)(0xD800 | (cp >> 10));
+            out[len++] = (u16)(0xDC00 | (cp & 0x3FF));
+        }else {
+            out[len++] = (u16)cp;
+        }
+        i += advance;
+    }
+    out[len] = 0;
+    vec_len(out) = len;
+    return out;
+}
+
+Vec(u32) utf8_to_utf32_impl(StringView str, OptAllocArg arg) {
+    Vec(u32) out = vec_with_size(u32, str.len + 1, .allocator = arg.allocator);
+    size_t i = 0, len = 0;
+    while(i < str.len) {
+        size_t ascii = _utf8_widen_ascii_u32(str.data + i, str.len - i, out + len);
+        i += ascii;
+        len += ascii;
+        if(i >= str.len) {
+            break;
+        }
+        size_t advance;
+        u32 cp = utf8_decode(str.data + i, str.len - i, &advance);
+        out[len++] = cp == UTF8_INVALID ? UTF8_REPLACEMENT_CHAR : cp;
+        i += advance;
+    }
+    out[len] = 0;
+    vec_len(out) = len;
+    return out;
+}
+
+Vec(wchar) utf8_to_wchar_impl(StringView str, OptAllocArg arg) {
+#if WCHAR_MAX <= 0xFFFF
+    return (Vec(wchar))utf8_to_utf16_impl(str, arg);
+#else
+    return (Vec(wchar))utf8_to_utf32_impl(str, arg);
+#endif
+}
+
+Vec(char) utf16_to_utf8_impl(const u16 *data, size_t len, OptAllocArg arg) {
+    Vec(char) out = vec_with_size(char, len * 3 + 1, .allocator = arg.allocator);
+    size_t out_len = 0;
+    for(size_t i = 0; i < len; i++) {
+        u32 cp = data[i];
+        if(cp < 0x80) {
+            out[out_len++] = (char)cp;
+            continue;
+        }
+        if(cp >= 0xD800 && cp <= 0xDBFF && i + 1 < len && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (data[++i] - 0xDC00);
+        }
+        //  lone surrogates are encoded as `UTF8_REPLACEMENT_CHAR`
+        out_len += utf8_encode(cp, out + out_len);
+    }
+    out[out_len] = '\0';
+    vec_len(out) = out_len;
+    return out;
+}
+
+Vec(char) utf32_to_utf8_impl(const u32 *data, size_t len, OptAllocArg arg) {
+    Vec(char) out = vec_with_size(char, len * 4 + 1, .allocator = arg.allocator);
+    size_t out_len = 0;
+    for(size_t i = 0; i < len; i++) {
+        if(data[i] < 0x80) {
+            out[out_len++] = (char)data[i];
+            continue;
+        }
+        out_len += utf8_encode(data[i], out + out_len);
+    }
+    out[out_len] = '\0';
+    vec_len(out) = out_len;
+    return out;
+}
+
+Vec(char) wchar_to_utf8_impl(const wchar *data, size_t len, OptAllocArg arg) {
+#if WCHAR_MAX <= 0xFFFF
+    return utf16_to_utf8_impl((const u16 *)data, len, arg);
+#else
+    return utf32_to_utf8_impl((const u32 *)data, len, arg);
+#endif
+}
+
+//  ----------------------------------- //
+//             arena-impl               //
+//  ----------------------------------- //
+Arena arena_new(size_t size) {
+    if(size == 0) {
+        size = ARENA_DEFAULT_ALLOC_SIZE;
+    }
+    Vec(char) buffer = vec_with_size(char, size);
+    Arena self = {
+        .buffer = buffer,
+        .current_alloc = buffer,
+        .next = NULL,
+    };
+    return self;
+}
+
+void arena_dealloc(Arena *self) {
+    if(self->next) {
+        arena_dealloc(self->next);
+    }
+    vec_destroy(self->buffer);
+}
+
+static void arena_clear_int(Arena *self) {
+    self->current_alloc = self->buffer;
+    if(self->next)
+        arena_clear_int(self->next);
+}
+
+static void* arena_alloc_internal(Arena *self, size_t size) {
+    if(self->buffer == NULL || self->current_alloc == NULL) {
+        *self = arena_new(0);
+    }
+
+    if(self->next) {
+        return arena_alloc_internal(self->next, size);
+    }
+    if(self->current_alloc + size > self->buffer + vec_cap(self->buffer)) {
+        self->next = allocator_alloc(&default_allocator, sizeof(Arena));
+        *self->next = arena_new(ARENA_DEFAULT_ALLOC_SIZE);
+        return arena_alloc_internal(self->next, size);
+    }
+    void *alloc = self->current_alloc;
+    self->current_alloc += size;
+    return alloc;
+}
+
+void *arena_alloc(Arena *alloc, size_t size) {
     return arena_alloc_internal(alloc, size);
 }
 
@@ -1520,33 +6578,204 @@ void static_arena_print_stats(StaticArena *self) {
 //  ----------------------------------- //
 //               print-impl             //
 //  ----------------------------------- //
+typedef struct _PrintBuffer {
+    //  held by the owner while printing and by whoever flushes the buffer from outside
+    Mutex lock;
+    struct _PrintBuffer *next;
+    FILE *stream;
+    i32 fd;
+    bool tty;
+    bool unbuffered;
+    size_t len;
+    char data[PRINT_BUFFER_SIZE];
+}_PrintBuffer;
+
+static thread_local _PrintBuffer *_print_buffer = NULL;
+//  every live buffer, so exit and `file_close` reach the ones of other threads too
+static _PrintBuffer *_print_buffers = NULL;
+static Mutex _print_buffers_lock;
+static tss_t _print_key;
+static once_flag _print_once = ONCE_FLAG_INIT;
+
+static void _print_buffer_flush(_PrintBuffer *self) {
+    if(self->len > 0) {
+        //  keeps the order with anything already sitting in the stdio buffer
+        fflush(self->stream);
+        _core_write_all(self->fd, self->data, self->len);
+        self->len = 0;
+    }
+}
+
+static void _print_buffer_release(void *buffer) {
+    mutex_lock(&_print_buffers_lock);
+    for(_PrintBuffer **link = &_print_buffers; *link; link = &(*link)->next) {
+        if(*link == buffer) {
+            *link = ((_PrintBuffer *)buffer)->next;
+            break;
+        }
+    }
+    mutex_unlock(&_print_buffers_lock);
+    _print_buffer_flush(buffer);
+    free(buffer);
+}
+
+//  flushes the buffers of all threads, those writing to `stream` are detached from it
+static void _print_flush_all(FILE *stream) {
+    mutex_lock(&_print_buffers_lock);
+    for(_PrintBuffer *buffer = _print_buffers; buffer; buffer = buffer->next) {
+        mutex_lock(&buffer->lock);
+        if(buffer->stream && (!stream || buffer->stream == stream)) {
+            _print_buffer_flush(buffer);
+            if(stream) {
+                buffer->stream = NULL;
+            }
+        }
+        mutex_unlock(&buffer->lock);
+    }
+    mutex_unlock(&_print_buffers_lock);
+}
+
+static void _print_exit(void) {
+    _print_flush_all(NULL);
+}
+
+static void _print_init(void) {
+    tss_create(&_print_key, _print_buffer_release);
+    atexit(_print_exit);
+}
+
+//  returns the calling thread's buffer locked and switched to `stream`, NULL for
+//  streams other than stdout/stderr
+static _PrintBuffer *_print_buffer_get(FILE *stream) {
+    if(stream != stdout && stream != stderr) {
+        return NULL;
+    }
+    _PrintBuffer *self = _print_buffer;
+    if(!self) {
+        call_once(&_print_once, _print_init);
+        self = malloc(sizeof(_PrintBuffer));
+        if(!self) {
+            return NULL;
+        }
+        self->lock = (Mutex){0};
+        self->stream = NULL;
+        self->len = 0;
+        tss_set(_print_key, self);
+        _print_buffer = self;
+        mutex_lock(&_print_buffers_lock);
+        self->next = _print_buffers;
+        _print_buffers = self;
+        mutex_unlock(&_print_buffers_lock);
+    }
+    mutex_lock(&self->lock);
+    if(self->stream != stream) {
+        if(self->stream) {
+            _print_buffer_flush(self);
+        }
+        self->stream = stream;
+#ifdef PLATFORM_WIN32
+        self->fd = _fileno(stream);
+        self->tty = _isatty(self->fd);
+#else
+        self->fd = fileno(stream);
+        self->tty = isatty(self->fd);
+#endif
+        self->unbuffered = stream == stderr;
+    }
+    return self;
+}
+
+static i32 _print_vformat(FILE *stream, bool newline, const char *fmt, va_list args) {
+    _PrintBuffer *self = _print_buffer_get(stream);
+    if(!self) {
+        i32 ret = vfprintf(stream, fmt, args);
+        if(newline) {
+            fputc('\n', stream);
+        }
+        return ret;
+    }
+    va_list copy;
+    va_copy(copy, args);
+    i32 ret = vsnprintf(self->data + self->len, PRINT_BUFFER_SIZE - self->len, fmt, copy);
+    va_end(copy);
+    if(ret < 0) {
+        mutex_unlock(&self->lock);
+        return ret;
+    }
+    size_t len = (size_t)ret + newline;
+    //  vsnprintf needs room for the terminator as well
+    if(self->len + len >= PRINT_BUFFER_SIZE) {
+        _print_buffer_flush(self);
+        if(len >= PRINT_BUFFER_SIZE) {
+            char *heap = malloc(len + 1);
+            if(heap) {
+                vsnprintf(heap, len + 1, fmt, args);
+                if(newline) {
+                    heap[len - 1] = '\n';
+                }
+                fflush(stream);
+                _core_write_all(self->fd, heap, len);
+                free(heap);
+            }
+            mutex_unlock(&self->lock);
+            return ret;
+        }
+        vsnprintf(self->data, PRINT_BUFFER_SIZE, fmt, args);
+    }
+    size_t start = self->len;
+    if(newline) {
+        self->data[start + ret] = '\n';
+    }
+    self->len += len;
+#ifdef CORE_FLUSH_IO
+    bool flush = true;
+#else
+    bool flush = self->unbuffered || (self->tty && memchr(self->data + start, '\n', len));
+#endif
+    if(flush) {
+        _print_buffer_flush(self);
+    }
+    mutex_unlock(&self->lock);
+    return ret;
+}
+
+void print_flush(void) {
+    if(_print_buffer) {
+        mutex_lock(&_print_buffer->lock);
+        if(_print_buffer->stream) {
+            _print_buffer_flush(_print_buffer);
+        }
+        mutex_unlock(&_print_buffer->lock);
+    }
+}
+
+//  `file_close` has to write out pending output of every thread before the FILE goes away
+static void _print_release_stream(FILE *stream) {
+    if(stream == stdout || stream == stderr) {
+        _print_flush_all(stream);
+    }
+}
+
 i32 print(const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    i32 ret = vfprintf(stdout, fmt, args);
+    i32 ret = _print_vformat(stdout, false, fmt, args);
     va_end(args);
-#ifdef CORE_FLUSH_IO
-    fflush(stdout);
-#endif
     return ret;
 }
 
 i32 println(const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    i32 ret = vfprintf(stdout, fmt, args);
+    i32 ret = _print_vformat(stdout, true, fmt, args);
     va_end(args);
-    printf("\n");
-#ifdef CORE_FLUSH_IO
-    fflush(stdout);
-#endif
     return ret;
 }
 
 i32 fprint(FileHandle stream, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    i32 ret = vfprintf(file_raw(stream), fmt, args);
+    i32 ret = _print_vformat(file_raw(stream), false, fmt, args);
     va_end(args);
     return ret;
 }
@@ -1554,74 +6783,908 @@ i32 fprint(FileHandle stream, const char *fmt, ...) {
 i32 fprintln(FileHandle stream, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    i32 ret = vfprintf(file_raw(stream), fmt, args);
+    i32 ret = _print_vformat(file_raw(stream), true, fmt, args);
     va_end(args);
-    fprint(file_raw(stream), "\n");
     return ret;
 }
 
+//  ----------------------------------- //
+//           log-level-impl             //
+//  ----------------------------------- //
+typedef struct _LogModule {
+    char *name;
+    LogLevel level;
+}_LogModule;
+
+_Atomic u32 core_log_generation = 1;
+static _Atomic i32 _log_level = CORE_TRACE;
+static Vec(_LogModule) _log_modules = NULL;
+static mtx_t _log_modules_lock;
+static once_flag _log_modules_once = ONCE_FLAG_INIT;
+
+static void _log_modules_init(void) {
+    mtx_init(&_log_modules_lock, mtx_plain);
+}
+
+static bool _log_module_matches(const char *file, const char *module, size_t len) {
+    for(const char *found = strstr(file, module); found; found = strstr(found + 1, module)) {
+        char before = found == file ? '/' : found[-1];
+        char after = found[len];
+        bool starts = before == '/' || before == '\\';
+        bool ends = module[len - 1] == '/' || after == 0 || after == '/' || after == '\\' || after == '.';
+        if(starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void log_level_set(LogLevel level) {
+    atomic_store(&_log_level, level);
+    atomic_fetch_add_explicit(&core_log_generation, 1, memory_order_release);
+}
+
+LogLevel log_level_get(void) {
+    return atomic_load(&_log_level);
+}
+
+void log_level_set_module(const char *module, LogLevel level) {
+    call_once(&_log_modules_once, _log_modules_init);
+    mtx_lock(&_log_modules_lock);
+    if(!_log_modules) {
+        _log_modules = vec_new();
+    }
+    bool found = false;
+    vec_foreach(_log_modules, entry) {
+        if(strcmp(entry->name, module) == 0) {
+            entry->level = level;
+            found = true;
+        }
+    }
+    if(!found && module[0]) {
+        size_t len = strlen(module);
+        _LogModule entry = { .name = malloc(len + 1), .level = level };
+        memcpy(entry.name, module, len + 1);
+        vec_push(_log_modules, entry);
+    }
+    atomic_fetch_add_explicit(&core_log_generation, 1, memory_order_release);
+    mtx_unlock(&_log_modules_lock);
+}
+
+void log_level_clear_module(const char *module) {
+    call_once(&_log_modules_once, _log_modules_init);
+    mtx_lock(&_log_modules_lock);
+    for(size_t i = 0; _log_modules && i < vec_len(_log_modules); i++) {
+        if(strcmp(_log_modules[i].name, module) == 0) {
+            free(_log_modules[i].name);
+            _log_modules[i] = _log_modules[vec_len(_log_modules) - 1];
+            vec_len(_log_modules)--;
+            break;
+        }
+    }
+    atomic_fetch_add_explicit(&core_log_generation, 1, memory_order_release);
+    mtx_unlock(&_log_modules_lock);
+}
+
+bool core_log_resolve(LogLevelCache *cache, const char *file, LogLevel level) {
+    u32 generation = atomic_load_explicit(&core_log_generation, memory_order_acquire);
+    i32 threshold = atomic_load(&_log_level);
+    call_once(&_log_modules_once, _log_modules_init);
+    mtx_lock(&_log_modules_lock);
+    size_t best = 0;
+    for(size_t i = 0; _log_modules && i < vec_len(_log_modules); i++) {
+        size_t len = strlen(_log_modules[i].name);
+        if(len > best && _log_module_matches(file, _log_modules[i].name, len)) {
+            best = len;
+            threshold = _log_modules[i].level;
+        }
+    }
+    mtx_unlock(&_log_modules_lock);
+    atomic_store_explicit(cache, (u64)generation << 8 | (u64)(threshold & 0xFF), memory_order_relaxed);
+    return (i32)level >= threshold;
+}
+
+#define _LOG_FILE_CACHE_SIZE 64
+
+static thread_local struct {
+    const char *file;
+    LogLevelCache cache;
+} _log_file_cache[_LOG_FILE_CACHE_SIZE];
+
+bool core_log_enabled_file(const char *file, LogLevel level) {
+    size_t slot = (size_t)(((uintptr_t)file * 0x9E3779B97F4A7C15ull) >> 58) & (_LOG_FILE_CACHE_SIZE - 1);
+    if(_log_file_cache[slot].file != file) {
+        //  generation 0 never matches, the next check resolves the new file
+        _log_file_cache[slot].file = file;
+        atomic_store_explicit(&_log_file_cache[slot].cache, 0, memory_order_relaxed);
+    }
+    return core_log_enabled(&_log_file_cache[slot].cache, file, level);
+}
+
+static const char *const _log_level_names[] = {
+    [CORE_TRACE] = "TRACE",
+    [CORE_DEBUG] = "DEBUG",
+    [CORE_INFO] = "INFO",
+    [CORE_WARNING] = "WARNING",
+    [CORE_ERROR] = "ERROR",
+};
+
+//  formats the whole line so it can go out with a single write, returns `buffer`
+//  or a heap allocation if the message did not fit
+static char *_core_log_format(char *buffer, size_t cap, size_t *len, LogLevel level, const char *file, const char *fmt, va_list args) {
+    if((u32)level > CORE_ERROR) {
+        CORE_UNREACHABLE("core_log()");
+    }
+    i32 prefix = file
+        ? snprintf(buffer, cap, "[%s]:%s: ", _log_level_names[level], file)
+        : snprintf(buffer, cap, "[%s] ", _log_level_names[level]);
+    va_list copy;
+    va_copy(copy, args);
+    i32 body = (size_t)prefix < cap ? vsnprintf(buffer + prefix, cap - prefix, fmt, copy) : vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    *len = (size_t)prefix + (size_t)(body < 0 ? 0 : body) + 1;
+    if(*len > cap) {
+        buffer = malloc(*len + 1);
+        if(file) {
+            snprintf(buffer, *len + 1, "[%s]:%s: ", _log_level_names[level], file);
+        } else {
+            snprintf(buffer, *len + 1, "[%s] ", _log_level_names[level]);
+        }
+        vsnprintf(buffer + prefix, *len + 1 - prefix, fmt, args);
+    }
+    buffer[*len - 1] = '\n';
+    return buffer;
+}
+
+static bool _log_async_push(char *data, size_t len);
+
+static void _core_log_write(LogLevel level, const char *file, const char *fmt, va_list args) {
+    char buffer[1024];
+    size_t len;
+    char *line = _core_log_format(buffer, sizeof(buffer), &len, level, file, fmt, args);
+    if(!_log_async_push(line, len)) {
+        fwrite(line, 1, len, stderr);
+#ifdef CORE_FLUSH_IO
+        fflush(stderr);
+#endif
+    }
+    if(line != buffer) {
+        free(line);
+    }
+}
+
 void core_log(LogLevel level, const char *fmt, ...)
 {
-    switch (level) {
-    case CORE_TRACE:
-        fprintf(stderr, "[TRACE] ");
-        break;
-    case CORE_DEBUG:
-        fprintf(stderr, "[DEBUG] ");
-        break;
-    case CORE_INFO:
-        fprintf(stderr, "[INFO] ");
-        break;
-    case CORE_WARNING:
-        fprintf(stderr, "[WARNING] ");
-        break;
-    case CORE_ERROR:
-        fprintf(stderr, "[ERROR] ");
-        break;
-    default:
-        CORE_UNREACHABLE("core_log()");
+    va_list args;
+    va_start(args, fmt);
+    _core_log_write(level, NULL, fmt, args);
+    va_end(args);
+}
+
+void __core_log_file(LogLevel level, const char *file, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    _core_log_write(level, file, fmt, args);
+    va_end(args);
+}
+
+//  ----------------------------------- //
+//            log-async-impl            //
+//  ----------------------------------- //
+#define LOG_RECORD_SIZE(len) (((size_t)(len) + 4 + 7) & ~(size_t)7)
+#define LOG_RECORD_WRAP UINT32_MAX
+#define LOG_RECORD_BINARY 0x80000000u
+#define LOG_DEFERRED_MAX_LINE CORE_KB(4)
+
+//  single producer (the owning thread), single consumer (the writer), the
+//  records are `u32 len | flags, bytes` padded to 8, `LOG_RECORD_WRAP` skips to the start
+typedef struct _LogQueue {
+    _Atomic size_t head;
+    //  set while the owner is inside a push, stop waits for it to clear
+    _Atomic u32 busy;
+    char _pad0[64 - sizeof(size_t) - sizeof(u32)];
+    _Atomic size_t tail;
+    char _pad1[64 - sizeof(size_t)];
+    _Atomic bool abandoned;
+    //  writer only, set once an abandoned queue has been drained for the last time
+    bool dead;
+    size_t reserved;
+    size_t cap;
+    char *data;
+    struct _LogQueue *next;
+}_LogQueue;
+
+static struct {
+    _Atomic bool running;
+    //  threads registering a queue, stop waits for them
+    _Atomic u32 producers;
+    _Atomic u64 dropped;
+    //  bumped on every start so threads notice their queue is gone
+    _Atomic u64 epoch;
+    LogOverflow overflow;
+    size_t queue_size;
+    u32 flush_ms;
+    bool signal_handlers;
+    bool atexit_registered;
+    mtx_t lock;
+    cnd_t wake;
+    cnd_t flushed;
+    u64 flush_request;
+    u64 flush_done;
+    _LogQueue *queues;
+    FileWriter writer;
+    thrd_t thread;
+    tss_t key;
+}_log_async = {0};
+
+static thread_local _LogQueue *_log_queue = NULL;
+static thread_local u64 _log_queue_epoch = 0;
+
+static const i32 _log_crash_signals[] = {
+    SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+static void (*_log_crash_previous[CORE_ARRLEN(_log_crash_signals)])(i32);
+
+static void _log_queue_release(void *queue) {
+    //  a later destructor that logs registers a fresh queue instead of reusing this one
+    _log_queue = NULL;
+    atomic_store(&((_LogQueue *)queue)->abandoned, true);
+}
+
+//  NULL if the queue cannot be allocated, the caller then logs synchronously
+static _LogQueue *_log_queue_register(u64 epoch) {
+    _LogQueue *queue = calloc(1, sizeof(_LogQueue));
+    if(!queue) {
+        return NULL;
+    }
+    queue->cap = _log_async.queue_size;
+    queue->data = malloc(queue->cap);
+    if(!queue->data) {
+        free(queue);
+        return NULL;
+    }
+    atomic_store(&queue->busy, 1);
+    mtx_lock(&_log_async.lock);
+    queue->next = _log_async.queues;
+    _log_async.queues = queue;
+    tss_set(_log_async.key, queue);
+    mtx_unlock(&_log_async.lock);
+    _log_queue = queue;
+    _log_queue_epoch = epoch;
+    return queue;
+}
+
+//  returns the calling thread's queue marked busy, NULL if the backend is off
+static _LogQueue *_log_async_acquire(void) {
+    if(!atomic_load_explicit(&_log_async.running, memory_order_relaxed)) {
+        return NULL;
+    }
+    u64 epoch = atomic_load_explicit(&_log_async.epoch, memory_order_acquire);
+    _LogQueue *queue = _log_queue;
+    if(queue && _log_queue_epoch == epoch) {
+        atomic_store(&queue->busy, 1);
+        if(atomic_load(&_log_async.running)) {
+            return queue;
+        }
+        atomic_store_explicit(&queue->busy, 0, memory_order_release);
+        return NULL;
+    }
+    atomic_fetch_add(&_log_async.producers, 1);
+    queue = atomic_load(&_log_async.running) ? _log_queue_register(epoch) : NULL;
+    atomic_fetch_sub(&_log_async.producers, 1);
+    return queue;
+}
+
+static void _log_async_release(_LogQueue *queue) {
+    atomic_store_explicit(&queue->busy, 0, memory_order_release);
+}
+
+//  returns room for `len` bytes, NULL if the record was dropped or the backend stopped
+static char *_log_queue_reserve(_LogQueue *queue, size_t len, u32 flags) {
+    size_t size = LOG_RECORD_SIZE(len);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t offset = head & (queue->cap - 1);
+    size_t pad = queue->cap - offset < size ? queue->cap - offset : 0;
+    for(;;) {
+        size_t used = head - atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if(used + pad + size <= queue->cap) {
+            if(used + pad + size > queue->cap / 2) {
+                cnd_signal(&_log_async.wake);
+            }
+            break;
+        }
+        if(_log_async.overflow == LOG_OVERFLOW_DROP) {
+            atomic_fetch_add_explicit(&_log_async.dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+        if(!atomic_load_explicit(&_log_async.running, memory_order_relaxed)) {
+            return NULL;
+        }
+        cnd_signal(&_log_async.wake);
+        thrd_yield();
+    }
+    if(pad) {
+        u32 wrap = LOG_RECORD_WRAP;
+        memcpy(queue->data + offset, &wrap, 4);
+        head += pad;
+        offset = 0;
+    }
+    u32 header = (u32)len | flags;
+    memcpy(queue->data + offset, &header, 4);
+    queue->reserved = head + size;
+    return queue->data + offset + 4;
+}
+
+static void _log_queue_commit(_LogQueue *queue) {
+    atomic_store_explicit(&queue->head, queue->reserved, memory_order_release);
+}
+
+static bool _log_async_push(char *data, size_t len) {
+    _LogQueue *queue = _log_async_acquire();
+    if(!queue) {
+        return false;
+    }
+    if(len > queue->cap / 4) {
+        len = queue->cap / 4;
+        data[len - 1] = '\n';
+    }
+    char *record = _log_queue_reserve(queue, len, 0);
+    if(record) {
+        memcpy(record, data, len);
+        _log_queue_commit(queue);
+    }
+    //  a dropped record counts as handled, a stopped backend falls back to stderr
+    bool handled = record || atomic_load(&_log_async.running);
+    _log_async_release(queue);
+    return handled;
+}
+
+static size_t _log_deferred_decode(const char *record, char *out, size_t cap);
+
+static void _log_record_write(const char *data, size_t len, bool crash) {
+    if(crash) {
+        _core_write_all(_log_async.writer.fd, data, len);
+    } else {
+        file_writer_write_raw(&_log_async.writer, data, len);
+    }
+}
+
+//  writes out every complete record, returns whether anything was consumed
+static bool _log_queue_drain(_LogQueue *queue, bool crash) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if(tail == head) {
+        return false;
+    }
+    while(tail != head) {
+        size_t offset = tail & (queue->cap - 1);
+        u32 header;
+        memcpy(&header, queue->data + offset, 4);
+        if(header == LOG_RECORD_WRAP) {
+            tail += queue->cap - offset;
+            continue;
+        }
+        u32 len = header & ~LOG_RECORD_BINARY;
+        if(header & LOG_RECORD_BINARY) {
+            char line[LOG_DEFERRED_MAX_LINE];
+            _log_record_write(line, _log_deferred_decode(queue->data + offset + 4, line, sizeof(line)), crash);
+        } else {
+            _log_record_write(queue->data + offset + 4, len, crash);
+        }
+        tail += LOG_RECORD_SIZE(len);
+    }
+    atomic_store_explicit(&queue->tail, tail, memory_order_release);
+    return true;
+}
+
+//  frees the queues of exited threads once they are empty, must not be called with
+//  `lock` held, new queues only ever go to the front and only the writer unlinks
+//  them, so everything behind the head is walked without the lock
+static bool _log_async_drain_all(void) {
+    mtx_lock(&_log_async.lock);
+    _LogQueue *queues = _log_async.queues;
+    mtx_unlock(&_log_async.lock);
+    bool wrote = false;
+    bool reap = false;
+    for(_LogQueue *queue = queues; queue; queue = queue->next) {
+        bool abandoned = atomic_load(&queue->abandoned);
+        wrote |= _log_queue_drain(queue, false);
+        queue->dead = abandoned;
+        reap |= abandoned;
+    }
+    if(!reap) {
+        return wrote;
+    }
+    _LogQueue *dead = NULL;
+    mtx_lock(&_log_async.lock);
+    for(_LogQueue **link = &_log_async.queues; *link;) {
+        _LogQueue *queue = *link;
+        if(queue->dead) {
+            *link = queue->next;
+            queue->next = dead;
+            dead = queue;
+            continue;
+        }
+        link = &queue->next;
+    }
+    mtx_unlock(&_log_async.lock);
+    while(dead) {
+        _LogQueue *next = dead->next;
+        free(dead->data);
+        free(dead);
+        dead = next;
+    }
+    return wrote;
+}
+
+static i32 _log_async_main(void *arg) {
+    CORE_UNUSED(arg);
+    for(;;) {
+        mtx_lock(&_log_async.lock);
+        u64 request = _log_async.flush_request;
+        mtx_unlock(&_log_async.lock);
+        bool running = atomic_load(&_log_async.running);
+        if(_log_async_drain_all()) {
+            file_writer_flush(&_log_async.writer);
+        }
+        mtx_lock(&_log_async.lock);
+        if(_log_async.flush_done != request) {
+            _log_async.flush_done = request;
+            cnd_broadcast(&_log_async.flushed);
+        }
+        if(!running) {
+            mtx_unlock(&_log_async.lock);
+            break;
+        }
+        if(_log_async.flush_request == request) {
+            struct timespec deadline;
+            timespec_get(&deadline, TIME_UTC);
+            deadline.tv_nsec += (long)_log_async.flush_ms * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            cnd_timedwait(&_log_async.wake, &_log_async.lock, &deadline);
+        }
+        mtx_unlock(&_log_async.lock);
+    }
+    return 0;
+}
+
+//  best effort, the writer thread may be halfway through a batch
+static void _log_async_crash(i32 sig) {
+    if(atomic_exchange(&_log_async.running, false)) {
+        _core_write_all(_log_async.writer.fd, _log_async.writer.buffer, _log_async.writer.len);
+        for(_LogQueue *queue = _log_async.queues; queue; queue = queue->next) {
+            _log_queue_drain(queue, true);
+        }
+    }
+    for(size_t i = 0; i < CORE_ARRLEN(_log_crash_signals); i++) {
+        if(_log_crash_signals[i] == sig) {
+            signal(sig, _log_crash_previous[i] == SIG_ERR ? SIG_DFL : _log_crash_previous[i]);
+        }
+    }
+    raise(sig);
+}
+
+bool log_async_start_impl(OptLogAsyncArg arg) {
+    if(atomic_load(&_log_async.running)) {
+        return false;
+    }
+    size_t queue_size = CORE_KB(1);
+    while(queue_size < (arg.queue_size ? arg.queue_size : LOG_ASYNC_DEFAULT_QUEUE_SIZE)) {
+        queue_size *= 2;
+    }
+    _log_async.overflow = arg.overflow;
+    _log_async.queue_size = queue_size;
+    _log_async.flush_ms = arg.flush_ms ? arg.flush_ms : LOG_ASYNC_DEFAULT_FLUSH_MS;
+    _log_async.flush_request = 0;
+    _log_async.flush_done = 0;
+    _log_async.writer = file_writer_new(arg.file ? arg.file : stderr_get());
+    if(!_log_async.writer.buffer) {
+        return false;
+    }
+    if(mtx_init(&_log_async.lock, mtx_plain) != thrd_success) {
+        file_writer_deinit(&_log_async.writer);
+        return false;
+    }
+    cnd_init(&_log_async.wake);
+    cnd_init(&_log_async.flushed);
+    tss_create(&_log_async.key, _log_queue_release);
+    atomic_fetch_add(&_log_async.epoch, 1);
+    atomic_store(&_log_async.running, true);
+    if(thrd_create(&_log_async.thread, _log_async_main, NULL) != thrd_success) {
+        atomic_store(&_log_async.running, false);
+        tss_delete(_log_async.key);
+        cnd_destroy(&_log_async.wake);
+        cnd_destroy(&_log_async.flushed);
+        mtx_destroy(&_log_async.lock);
+        file_writer_deinit(&_log_async.writer);
+        return false;
+    }
+    _log_async.signal_handlers = arg.signal_handlers;
+    if(_log_async.signal_handlers) {
+        for(size_t i = 0; i < CORE_ARRLEN(_log_crash_signals); i++) {
+            _log_crash_previous[i] = signal(_log_crash_signals[i], _log_async_crash);
+        }
+    }
+    if(!_log_async.atexit_registered) {
+        atexit(log_async_stop);
+        _log_async.atexit_registered = true;
+    }
+    return true;
+}
+
+void log_async_stop(void) {
+    if(!atomic_exchange(&_log_async.running, false)) {
+        return;
+    }
+    mtx_lock(&_log_async.lock);
+    cnd_signal(&_log_async.wake);
+    mtx_unlock(&_log_async.lock);
+    while(atomic_load(&_log_async.producers) > 0) {
+        thrd_yield();
+    }
+    thrd_join(_log_async.thread, NULL);
+    if(_log_async.signal_handlers) {
+        for(size_t i = 0; i < CORE_ARRLEN(_log_crash_signals); i++) {
+            signal(_log_crash_signals[i], _log_crash_previous[i] == SIG_ERR ? SIG_DFL : _log_crash_previous[i]);
+        }
+    }
+    for(_LogQueue *queue = _log_async.queues; queue; queue = queue->next) {
+        while(atomic_load(&queue->busy)) {
+            thrd_yield();
+        }
+    }
+    //  picks up records pushed while the writer was already on its way out
+    _log_async_drain_all();
+    for(_LogQueue *queue = _log_async.queues; queue;) {
+        _LogQueue *next = queue->next;
+        free(queue->data);
+        free(queue);
+        queue = next;
+    }
+    _log_async.queues = NULL;
+    file_writer_deinit(&_log_async.writer);
+    tss_delete(_log_async.key);
+    cnd_destroy(&_log_async.wake);
+    cnd_destroy(&_log_async.flushed);
+    mtx_destroy(&_log_async.lock);
+}
+
+void log_async_flush(void) {
+    if(!atomic_load(&_log_async.running)) {
+        return;
+    }
+    mtx_lock(&_log_async.lock);
+    u64 request = ++_log_async.flush_request;
+    cnd_signal(&_log_async.wake);
+    while(_log_async.flush_done < request && atomic_load(&_log_async.running)) {
+        cnd_wait(&_log_async.flushed, &_log_async.lock);
+    }
+    mtx_unlock(&_log_async.lock);
+}
+
+u64 log_async_dropped(void) {
+    return atomic_load(&_log_async.dropped);
+}
+
+//  ----------------------------------- //
+//           log-deferred-impl          //
+//  ----------------------------------- //
+enum {
+    LOG_SITE_NEW,
+    LOG_SITE_PARSING,
+    LOG_SITE_READY,
+    //  the format uses something the deferred path cannot copy
+    LOG_SITE_FALLBACK,
+};
+
+static size_t _log_arg_sizes[] = {
+    [LOG_ARG_NONE] = 0,
+    [LOG_ARG_INT] = sizeof(int),
+    [LOG_ARG_LONG] = sizeof(long),
+    [LOG_ARG_LLONG] = sizeof(long long),
+    [LOG_ARG_INTMAX] = sizeof(intmax_t),
+    [LOG_ARG_SIZE] = sizeof(size_t),
+    [LOG_ARG_PTRDIFF] = sizeof(ptrdiff_t),
+    [LOG_ARG_DOUBLE] = sizeof(double),
+    [LOG_ARG_LDOUBLE] = sizeof(long double),
+    [LOG_ARG_PTR] = sizeof(void *),
+    [LOG_ARG_STRING] = sizeof(u32),
+};
+
+static char *_log_segment_text(const char *start, const char *end, bool literal) {
+    char *text = malloc(end - start + 1);
+    size_t len = 0;
+    for(const char *ptr = start; ptr < end; ptr++) {
+        text[len++] = *ptr;
+        //  literal segments are written as is, so `%%` is collapsed here
+        if(literal && ptr[0] == '%' && ptr + 1 < end && ptr[1] == '%') {
+            ptr++;
+        }
+    }
+    text[len] = 0;
+    return text;
+}
+
+static LogArgKind _log_arg_kind(const char *length, size_t length_len, char conversion) {
+    char l0 = length_len > 0 ? length[0] : 0;
+    bool twice = length_len == 2;
+    //  only `hh` and `ll` are two characters long
+    if(twice && (length[1] != l0 || (l0 != 'h' && l0 != 'l'))) {
+        return LOG_ARG_INVALID;
+    }
+    switch(conversion) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+            switch(l0) {
+                case 0: case 'h': return LOG_ARG_INT;
+                case 'l': return twice ? LOG_ARG_LLONG : LOG_ARG_LONG;
+                case 'j': return LOG_ARG_INTMAX;
+                case 'z': return LOG_ARG_SIZE;
+                case 't': return LOG_ARG_PTRDIFF;
+                default: return LOG_ARG_INVALID;
+            }
+        }
+        case 'c': return l0 == 0 ? LOG_ARG_INT : LOG_ARG_INVALID;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            return l0 == 'L' ? LOG_ARG_LDOUBLE : l0 == 0 || (l0 == 'l' && !twice) ? LOG_ARG_DOUBLE : LOG_ARG_INVALID;
+        }
+        case 's': return l0 == 0 ? LOG_ARG_STRING : LOG_ARG_INVALID;
+        case 'p': return l0 == 0 ? LOG_ARG_PTR : LOG_ARG_INVALID;
+        default: return LOG_ARG_INVALID;
+    }
+}
+
+//  splits `fmt` into pieces holding at most one conversion each
+static bool _log_site_parse(Vec(LogSegment) *segments, const char *fmt) {
+    const char *start = fmt;
+    const char *ptr = fmt;
+    while(*ptr) {
+        if(*ptr != '%') {
+            ptr++;
+            continue;
+        }
+        if(ptr[1] == '%') {
+            ptr += 2;
+            continue;
+        }
+        ptr++;
+        while(*ptr && strchr("-+ #0'", *ptr)) {
+            ptr++;
+        }
+        u8 stars = 0;
+        if(*ptr == '*') {
+            stars++;
+            ptr++;
+        }
+        while(isdigit((u8)*ptr)) {
+            ptr++;
+        }
+        bool precision_star = false;
+        i32 precision = -1;
+        if(*ptr == '.') {
+            ptr++;
+            precision = 0;
+            if(*ptr == '*') {
+                stars++;
+                precision_star = true;
+                ptr++;
+            }
+            for(; isdigit((u8)*ptr); ptr++) {
+                if(precision > (INT32_MAX - 9) / 10) {
+                    return false;
+                }
+                precision = precision * 10 + (*ptr - '0');
+            }
+        }
+        const char *length = ptr;
+        while(*ptr && strchr("hljztL", *ptr)) {
+            ptr++;
+        }
+        if(!*ptr || ptr - length > 2) {
+            return false;
+        }
+        LogArgKind kind = _log_arg_kind(length, ptr - length, *ptr);
+        if(kind == LOG_ARG_INVALID) {
+            return false;
+        }
+        ptr++;
+        LogSegment segment = {
+            .fmt = _log_segment_text(start, ptr, false),
+            .kind = kind,
+            .stars = stars,
+            .precision_star = precision_star,
+            .precision = precision,
+        };
+        vec_push(*segments, segment);
+        start = ptr;
+    }
+    if(ptr > start) {
+        LogSegment segment = { .fmt = _log_segment_text(start, ptr, true), .kind = LOG_ARG_NONE, .precision = -1 };
+        vec_push(*segments, segment);
     }
+    return true;
+}
 
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
-    va_end(args);
-    fprintf(stderr, "\n");
-#ifdef CORE_FLUSH_IO
-    fflush(stdout);
-#endif
+static u32 _log_site_register(LogSite *site, const char *fmt) {
+    u32 state = LOG_SITE_NEW;
+    if(!atomic_compare_exchange_strong(&site->state, &state, LOG_SITE_PARSING)) {
+        //  another thread is parsing, this call formats in place
+        return state;
+    }
+    Vec(LogSegment) segments = vec_new();
+    bool ok = _log_site_parse(&segments, fmt);
+    if(!ok) {
+        vec_foreach(segments, segment) {
+            free(segment->fmt);
+        }
+        vec_destroy(segments);
+        segments = NULL;
+    }
+    site->segments = segments;
+    state = ok ? LOG_SITE_READY : LOG_SITE_FALLBACK;
+    atomic_store_explicit(&site->state, state, memory_order_release);
+    return state;
+}
+
+//  bytes of a `%s` argument that get printed, with a precision the string does not
+//  have to be NUL terminated (`"%.*s"` with a `StringView`)
+static size_t _log_string_arg_len(LogSegment const *segment, const char *str, int star) {
+    i32 precision = segment->precision_star ? star : segment->precision;
+    return precision >= 0 ? strnlen(str, (size_t)precision) : strlen(str);
+}
+
+//  record layout: `LogSite *, u32 level`, then the raw arguments, strings as `u32 len` plus bytes
+static size_t _log_deferred_size(LogSite const *site, va_list args) {
+    size_t size = sizeof(LogSite *) + sizeof(u32);
+    vec_foreach(site->segments, segment) {
+        int star = -1;
+        for(u8 i = 0; i < segment->stars; i++) {
+            star = va_arg(args, int);
+        }
+        size += segment->stars * sizeof(int) + _log_arg_sizes[segment->kind];
+        switch(segment->kind) {
+            case LOG_ARG_NONE: break;
+            case LOG_ARG_INT: CORE_UNUSED(va_arg(args, int)); break;
+            case LOG_ARG_LONG: CORE_UNUSED(va_arg(args, long)); break;
+            case LOG_ARG_LLONG: CORE_UNUSED(va_arg(args, long long)); break;
+            case LOG_ARG_INTMAX: CORE_UNUSED(va_arg(args, intmax_t)); break;
+            case LOG_ARG_SIZE: CORE_UNUSED(va_arg(args, size_t)); break;
+            case LOG_ARG_PTRDIFF: CORE_UNUSED(va_arg(args, ptrdiff_t)); break;
+            case LOG_ARG_DOUBLE: CORE_UNUSED(va_arg(args, double)); break;
+            case LOG_ARG_LDOUBLE: CORE_UNUSED(va_arg(args, long double)); break;
+            case LOG_ARG_PTR: CORE_UNUSED(va_arg(args, void *)); break;
+            case LOG_ARG_STRING: {
+                const char *str = va_arg(args, const char *);
+                size += _log_string_arg_len(segment, str ? str : "(null)", star) + 1;
+            } break;
+            case LOG_ARG_INVALID: break;
+        }
+    }
+    return size;
+}
+
+#define _LOG_COPY_ARG(ty) do { ty value = va_arg(args, ty); memcpy(ptr, &value, sizeof(ty)); ptr += sizeof(ty); } while(0)
+
+static void _log_deferred_write(char *ptr, LogSite *site, LogLevel level, va_list args) {
+    u32 level_value = level;
+    memcpy(ptr, &site, sizeof(LogSite *));
+    memcpy(ptr + sizeof(LogSite *), &level_value, sizeof(u32));
+    ptr += sizeof(LogSite *) + sizeof(u32);
+    vec_foreach(site->segments, segment) {
+        int star = -1;
+        for(u8 i = 0; i < segment->stars; i++) {
+            star = va_arg(args, int);
+            memcpy(ptr, &star, sizeof(int));
+            ptr += sizeof(int);
+        }
+        switch(segment->kind) {
+            case LOG_ARG_NONE: break;
+            case LOG_ARG_INT: _LOG_COPY_ARG(int); break;
+            case LOG_ARG_LONG: _LOG_COPY_ARG(long); break;
+            case LOG_ARG_LLONG: _LOG_COPY_ARG(long long); break;
+            case LOG_ARG_INTMAX: _LOG_COPY_ARG(intmax_t); break;
+            case LOG_ARG_SIZE: _LOG_COPY_ARG(size_t); break;
+            case LOG_ARG_PTRDIFF: _LOG_COPY_ARG(ptrdiff_t); break;
+            case LOG_ARG_DOUBLE: _LOG_COPY_ARG(double); break;
+            case LOG_ARG_LDOUBLE: _LOG_COPY_ARG(long double); break;
+            case LOG_ARG_PTR: _LOG_COPY_ARG(void *); break;
+            case LOG_ARG_STRING: {
+                const char *str = va_arg(args, const char *);
+                str = str ? str : "(null)";
+                size_t str_len = _log_string_arg_len(segment, str, star);
+                u32 len = (u32)str_len + 1;
+                memcpy(ptr, &len, sizeof(u32));
+                memcpy(ptr + sizeof(u32), str, str_len);
+                ptr[sizeof(u32) + str_len] = '\0';
+                ptr += sizeof(u32) + len;
+            } break;
+            case LOG_ARG_INVALID: break;
+        }
+    }
 }
 
-void __core_log_file(LogLevel level, const char *file, const char *fmt, ...)
-{
-    switch (level) {
-    case CORE_TRACE:
-        fprintf(stderr, "[TRACE]:%s: ", file);
-        break;
-    case CORE_DEBUG:
-        fprintf(stderr, "[DEBUG]:%s: ", file);
-        break;
-    case CORE_INFO:
-        fprintf(stderr, "[INFO]:%s: ", file);
-        break;
-    case CORE_WARNING:
-        fprintf(stderr, "[WARNING]:%s: ", file);
-        break;
-    case CORE_ERROR:
-        fprintf(stderr, "[ERROR]:%s: ", file);
-        break;
-    default:
-        CORE_UNREACHABLE("core_log()");
+#define _LOG_READ_ARG(ty, name) ty name; memcpy(&name, ptr, sizeof(ty)); ptr += sizeof(ty)
+#define _LOG_FORMAT_ARG(value) \
+    (segment->stars == 0 ? snprintf(dst, room, segment->fmt, value) \
+    : segment->stars == 1 ? snprintf(dst, room, segment->fmt, stars[0], value) \
+    : snprintf(dst, room, segment->fmt, stars[0], stars[1], value))
+
+//  runs on the writer thread, one snprintf per segment
+static size_t _log_deferred_decode(const char *ptr, char *out, size_t cap) {
+    _LOG_READ_ARG(LogSite *, site);
+    _LOG_READ_ARG(u32, level);
+    size_t len = (size_t)snprintf(out, cap, "[%s] ", _log_level_names[level]);
+    vec_foreach(site->segments, segment) {
+        int stars[2] = {0};
+        for(u8 i = 0; i < segment->stars; i++) {
+            memcpy(&stars[i], ptr, sizeof(int));
+            ptr += sizeof(int);
+        }
+        char *dst = out + (len < cap ? len : cap);
+        size_t room = len < cap ? cap - len : 0;
+        i32 written = 0;
+        switch(segment->kind) {
+            case LOG_ARG_NONE: {
+                written = (i32)strlen(segment->fmt);
+                memcpy(dst, segment->fmt, (size_t)written < room ? (size_t)written : room);
+            } break;
+            case LOG_ARG_INT: { _LOG_READ_ARG(int, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_LONG: { _LOG_READ_ARG(long, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_LLONG: { _LOG_READ_ARG(long long, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_INTMAX: { _LOG_READ_ARG(intmax_t, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_SIZE: { _LOG_READ_ARG(size_t, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_PTRDIFF: { _LOG_READ_ARG(ptrdiff_t, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_DOUBLE: { _LOG_READ_ARG(double, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_LDOUBLE: { _LOG_READ_ARG(long double, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_PTR: { _LOG_READ_ARG(void *, value); written = _LOG_FORMAT_ARG(value); } break;
+            case LOG_ARG_STRING: {
+                _LOG_READ_ARG(u32, str_len);
+                const char *value = ptr;
+                ptr += str_len;
+                written = _LOG_FORMAT_ARG(value);
+            } break;
+            case LOG_ARG_INVALID: break;
+        }
+        len += written > 0 ? (size_t)written : 0;
+    }
+    if(len >= cap) {
+        len = cap - 1;
     }
+    out[len++] = '\n';
+    return len;
+}
 
+void core_log_deferred(LogSite *site, LogLevel level, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    u32 state = atomic_load_explicit(&site->state, memory_order_acquire);
+    if(state == LOG_SITE_NEW) {
+        state = _log_site_register(site, fmt);
+    }
+    _LogQueue *queue = state == LOG_SITE_READY && (u32)level <= CORE_ERROR ? _log_async_acquire() : NULL;
+    if(queue) {
+        va_list copy;
+        va_copy(copy, args);
+        size_t len = _log_deferred_size(site, copy);
+        va_end(copy);
+        char *record = len <= queue->cap / 4 ? _log_queue_reserve(queue, len, LOG_RECORD_BINARY) : NULL;
+        if(record) {
+            _log_deferred_write(record, site, level, args);
+            _log_queue_commit(queue);
+        }
+        bool handled = record || (len <= queue->cap / 4 && atomic_load(&_log_async.running));
+        _log_async_release(queue);
+        if(handled) {
+            va_end(args);
+            return;
+        }
+    }
+    _core_log_write(level, NULL, fmt, args);
     va_end(args);
-    fprintf(stderr, "\n");
-#ifdef CORE_FLUSH_IO
-    fflush(stdout);
-#endif
 }
 
 //  ----------------------------------- //
@@ -1654,7 +7717,7 @@ void allocation_print(Allocation *self) {
 
 #endif
 
-thread_local Context core_context = {0};
+thread_local Context _core_context = {0};
 
 String tmp_printf(const char *fmt, ...) {
     CORE_UNUSED(fmt);
@@ -1685,26 +7748,764 @@ StringView tmp_copy_str(String *self) {
 #    #error you need to call `context_init` manually on msvc
 #endif
 
-static void _core_context_init(void) {
-    #ifdef CORE_MEM_DEBUG
-        core_context.memory_stats.allocations = vec_new(.allocator = std_alloc);
-    #endif
+static tss_t _core_context_key;
+static once_flag _core_context_key_once = ONCE_FLAG_INIT;
+
+static void _core_context_thread_exit(void *context) {
+    CORE_UNUSED(context);
+    context_thread_deinit();
+}
+
+static void _core_context_key_init(void) {
+    tss_create(&_core_context_key, _core_context_thread_exit);
+}
+
+Context *_core_context_init_thread(void) {
+    Context *self = &_core_context;
+    self->initialized = true;
+    //  only a non NULL value makes the destructor run at thread exit
+    call_once(&_core_context_key_once, _core_context_key_init);
+    tss_set(_core_context_key, self);
+    return self;
 }
 
 void context_deinit(void)  {
-    ringbuffer_deinit(&core_context.ring_buffer);
+    if(!_core_context.initialized) {
+        return;
+    }
+    context_thread_deinit();
 #ifdef CORE_MEM_DEBUG
-    vec_foreach(core_context.memory_stats.allocations, alloc) {
-        allocation_print(alloc);
+    mutex_lock(&core_memory_stats.lock);
+    if(core_memory_stats.allocations) {
+        vec_foreach(core_memory_stats.allocations, alloc) {
+            allocation_print(alloc);
+        }
     }
+    mutex_unlock(&core_memory_stats.lock);
 #endif
 }
 
+//  the main thread exits through `exit`, which skips the tss destructors
 CORE_CONSTRUCTOR void context_init(void)  {
-    _core_context_init();
+    context_get();
     atexit(context_deinit);
 }
 
+void context_thread_init(void) {
+    context_get();
+}
+
+void context_thread_deinit(void) {
+    Context *self = &_core_context;
+    if(!self->initialized) {
+        return;
+    }
+    ringbuffer_deinit(&self->ring_buffer);
+    if(self->temp_arena.buffer) {
+        arena_dealloc(&self->temp_arena);
+    }
+    *self = (Context){0};
+}
+
+//  ----------------------------------- //
+//           thread-pool-impl           //
+//  ----------------------------------- //
+typedef struct _Task {
+    TaskFn fn;
+    void *arg;
+    TaskGroup *group;
+}_Task;
+
+//  Chase-Lev deque with a fixed ring, the owner pushes and pops at `bottom`,
+//  thieves take from `top`
+typedef struct _WorkDeque {
+    union { _Atomic i64 top; char _line0[CORE_CACHE_LINE]; };
+    union { _Atomic i64 bottom; char _line1[CORE_CACHE_LINE]; };
+    i64 cap;
+    _Task *tasks;
+}_WorkDeque;
+
+typedef struct _PoolWorker {
+    ThreadPool *pool;
+    u32 index;
+}_PoolWorker;
+
+struct ThreadPool {
+    //  workers that were started, there is a deque for every requested one
+    u32 count;
+    u32 deque_count;
+    _WorkDeque *deques;
+    _PoolWorker *workers;
+    thrd_t *threads;
+    //  tasks spawned from threads outside of the pool
+    MpmcQueue(_Task) inject;
+    _Atomic bool running;
+    //  sleeping workers and threads parked in `thread_pool_wait`, all wait on `wake`
+    _Atomic u32 sleepers;
+    _Atomic u32 waiters;
+    mtx_t lock;
+    cnd_t wake;
+    //  lock and condition variable were initialised
+    bool synced;
+    Allocator alloc;
+};
+
+static thread_local ThreadPool *_pool_current = NULL;
+static thread_local u32 _pool_index = 0;
+static thread_local u32 _pool_rng = 0;
+
+static bool _deque_push(_WorkDeque *self, _Task task) {
+    i64 bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed);
+    i64 top = atomic_load_explicit(&self->top, memory_order_acquire);
+    if(bottom - top >= self->cap) {
+        return false;
+    }
+    self->tasks[bottom & (self->cap - 1)] = task;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+static bool _deque_pop(_WorkDeque *self, _Task *task) {
+    i64 bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&self->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 top = atomic_load_explicit(&self->top, memory_order_relaxed);
+    if(top > bottom) {
+        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+    *task = self->tasks[bottom & (self->cap - 1)];
+    if(top == bottom) {
+        //  last element, race the thieves for it
+        bool won = atomic_compare_exchange_strong_explicit(&self->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+static bool _deque_steal(_WorkDeque *self, _Task *task) {
+    i64 top = atomic_load_explicit(&self->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    i64 bottom = atomic_load_explicit(&self->bottom, memory_order_acquire);
+    if(top >= bottom) {
+        return false;
+    }
+    *task = self->tasks[top & (self->cap - 1)];
+    return atomic_compare_exchange_strong_explicit(&self->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+static bool _pool_find_task(ThreadPool *self, _Task *task) {
+    bool worker = _pool_current == self;
+    if(worker && _deque_pop(&self->deques[_pool_index], task)) {
+        return true;
+    }
+    if(mpmc_queue_pop(self->inject, task)) {
+        return true;
+    }
+    _pool_rng = _pool_rng * 1664525 + 1013904223;
+    u32 start = (_pool_rng >> 16) % self->deque_count;
+    for(u32 i = 0; i < self->deque_count; i++) {
+        u32 victim = (start + i) % self->deque_count;
+        if(worker && victim == _pool_index) {
+            continue;
+        }
+        if(_deque_steal(&self->deques[victim], task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _pool_has_work(ThreadPool *self) {
+    if(mpmc_queue_len(self->inject) > 0) {
+        return true;
+    }
+    for(u32 i = 0; i < self->deque_count; i++) {
+        if(atomic_load(&self->deques[i].bottom) > atomic_load(&self->deques[i].top)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//  call after a seq_cst store that finishes a wait, either the waiter sees the
+//  store or this sees the waiter
+static void _pool_wake_waiters(ThreadPool *self) {
+    if(atomic_load(&self->waiters) > 0) {
+        mtx_lock(&self->lock);
+        cnd_broadcast(&self->wake);
+        mtx_unlock(&self->lock);
+    }
+}
+
+static void _pool_run(ThreadPool *self, _Task *task) {
+    task->fn(task->arg);
+    //  the group may be gone once its count hits zero, so waiters are counted on the pool
+    if(task->group && atomic_fetch_sub(&task->group->pending, 1) == 1) {
+        _pool_wake_waiters(self);
+    }
+}
+
+static i32 _pool_worker_main(void *arg) {
+    _PoolWorker *worker = arg;
+    ThreadPool *self = worker->pool;
+    context_thread_init();
+    _pool_current = self;
+    _pool_index = worker->index;
+    _pool_rng = worker->index + 1;
+    u32 idle = 0;
+    while(atomic_load_explicit(&self->running, memory_order_acquire)) {
+        _Task task;
+        if(_pool_find_task(self, &task)) {
+            _pool_run(self, &task);
+            idle = 0;
+            continue;
+        }
+        if(++idle < 64) {
+            thrd_yield();
+            continue;
+        }
+        //  the seq_cst increment pairs with the fence in `thread_pool_spawn`, either
+        //  the spawner sees a sleeper or the sleeper sees the new task
+        mtx_lock(&self->lock);
+        atomic_fetch_add(&self->sleepers, 1);
+        if(atomic_load(&self->running) && !_pool_has_work(self)) {
+            cnd_wait(&self->wake, &self->lock);
+        }
+        atomic_fetch_sub(&self->sleepers, 1);
+        mtx_unlock(&self->lock);
+        idle = 0;
+    }
+    _pool_current = NULL;
+    context_thread_deinit();
+    return 0;
+}
+
+ThreadPool *thread_pool_new_impl(OptThreadPoolArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    u32 count = arg.threads ? arg.threads : _core_cpu_count();
+    size_t deque_size = 2;
+    while(deque_size < (arg.deque_size ? arg.deque_size : THREAD_POOL_DEFAULT_DEQUE_SIZE)) {
+        deque_size *= 2;
+    }
+    ThreadPool *self = allocator_alloc(&alloc, sizeof(ThreadPool));
+    if(!self) {
+        return NULL;
+    }
+    *self = (ThreadPool){
+        .deques = allocator_alloc(&alloc, count * sizeof(_WorkDeque)),
+        .workers = allocator_alloc(&alloc, count * sizeof(_PoolWorker)),
+        .threads = allocator_alloc(&alloc, count * sizeof(thrd_t)),
+        .inject = mpmc_queue_new(_Task, deque_size, .allocator = alloc),
+        .alloc = alloc,
+    };
+    if(!self->deques || !self->workers || !self->threads || !self->inject) {
+        thread_pool_destroy(self);
+        return NULL;
+    }
+    for(u32 i = 0; i < count; i++) {
+        memset(&self->deques[i], 0, sizeof(_WorkDeque));
+        self->deques[i].cap = (i64)deque_size;
+        self->deques[i].tasks = allocator_alloc(&alloc, deque_size * sizeof(_Task));
+        self->deque_count++;
+        if(!self->deques[i].tasks) {
+            thread_pool_destroy(self);
+            return NULL;
+        }
+        self->workers[i] = (_PoolWorker){ .pool = self, .index = i };
+    }
+    if(mtx_init(&self->lock, mtx_plain) != thrd_success) {
+        thread_pool_destroy(self);
+        return NULL;
+    }
+    if(cnd_init(&self->wake) != thrd_success) {
+        mtx_destroy(&self->lock);
+        thread_pool_destroy(self);
+        return NULL;
+    }
+    self->synced = true;
+    atomic_store(&self->running, true);
+    //  workers only look at `deque_count`, the deques of threads that failed to
+    //  start stay empty
+    for(u32 i = 0; i < count; i++) {
+        if(thrd_create(&self->threads[i], _pool_worker_main, &self->workers[i]) != thrd_success) {
+            break;
+        }
+        self->count++;
+    }
+    if(self->count == 0) {
+        thread_pool_destroy(self);
+        return NULL;
+    }
+    return self;
+}
+
+void thread_pool_destroy(ThreadPool *self) {
+    if(self->synced) {
+        mtx_lock(&self->lock);
+        atomic_store(&self->running, false);
+        cnd_broadcast(&self->wake);
+        mtx_unlock(&self->lock);
+        for(u32 i = 0; i < self->count; i++) {
+            thrd_join(self->threads[i], NULL);
+        }
+        _Task task;
+        while(_pool_find_task(self, &task)) {
+            _pool_run(self, &task);
+        }
+        mtx_destroy(&self->lock);
+        cnd_destroy(&self->wake);
+    }
+    Allocator alloc = self->alloc;
+    for(u32 i = 0; i < self->deque_count; i++) {
+        if(self->deques[i].tasks) {
+            allocator_free(&alloc, self->deques[i].tasks);
+        }
+    }
+    if(self->inject) {
+        mpmc_queue_destroy(self->inject);
+    }
+    if(self->deques) {
+        allocator_free(&alloc, self->deques);
+    }
+    if(self->workers) {
+        allocator_free(&alloc, self->workers);
+    }
+    if(self->threads) {
+        allocator_free(&alloc, self->threads);
+    }
+    allocator_free(&alloc, self);
+}
+
+static ThreadPool *_pool_global = NULL;
+static once_flag _pool_global_once = ONCE_FLAG_INIT;
+
+static void _pool_global_destroy(void) {
+    if(_pool_global) {
+        thread_pool_destroy(_pool_global);
+    }
+}
+
+static void _pool_global_init(void) {
+    _pool_global = thread_pool_new();
+    atexit(_pool_global_destroy);
+}
+
+ThreadPool *thread_pool_global(void) {
+    call_once(&_pool_global_once, _pool_global_init);
+    return _pool_global;
+}
+
+u32 thread_pool_threads(ThreadPool *self) {
+    self = self ? self : thread_pool_global();
+    return self ? self->count : 0;
+}
+
+void thread_pool_spawn(ThreadPool *self, TaskGroup *group, TaskFn fn, void *arg) {
+    self = self ? self : thread_pool_global();
+    if(!self) {
+        fn(arg);
+        return;
+    }
+    _Task task = { .fn = fn, .arg = arg, .group = group };
+    if(group) {
+        atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+    }
+    bool queued = _pool_current == self
+        ? _deque_push(&self->deques[_pool_index], task)
+        : mpmc_queue_push(self->inject, task);
+    if(!queued) {
+        _pool_run(self, &task);
+        return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&self->sleepers, memory_order_relaxed) > 0) {
+        mtx_lock(&self->lock);
+        cnd_signal(&self->wake);
+        mtx_unlock(&self->lock);
+    }
+}
+
+void thread_pool_wait(ThreadPool *self, TaskGroup *group) {
+    self = self ? self : thread_pool_global();
+    if(!self) {
+        //  every task already ran inside `thread_pool_spawn`
+        return;
+    }
+    u32 idle = 0;
+    while(atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+        _Task task;
+        if(_pool_find_task(self, &task)) {
+            _pool_run(self, &task);
+            idle = 0;
+            continue;
+        }
+        if(++idle < 64) {
+            thrd_yield();
+            continue;
+        }
+        //  the remaining tasks run elsewhere, sleep like an idle worker until the
+        //  group finishes or a new task shows up that this thread can help with
+        mtx_lock(&self->lock);
+        atomic_fetch_add(&self->waiters, 1);
+        atomic_fetch_add(&self->sleepers, 1);
+        if(atomic_load(&group->pending) > 0 && !_pool_has_work(self)) {
+            cnd_wait(&self->wake, &self->lock);
+        }
+        atomic_fetch_sub(&self->sleepers, 1);
+        atomic_fetch_sub(&self->waiters, 1);
+        mtx_unlock(&self->lock);
+        idle = 0;
+    }
+}
+
+typedef struct _ParallelFor {
+    ThreadPool *pool;
+    TaskGroup group;
+    ParallelForFn fn;
+    void *user_data;
+    size_t grain;
+    struct _ParallelNode *nodes;
+    _Atomic size_t next_node;
+}_ParallelFor;
+
+typedef struct _ParallelNode {
+    _ParallelFor *job;
+    size_t begin;
+    size_t end;
+}_ParallelNode;
+
+static void _parallel_for_task(void *arg) {
+    _ParallelNode *node = arg;
+    _ParallelFor *job = node->job;
+    size_t begin = node->begin;
+    size_t end = node->end;
+    //  keep the left half, hand the right one to whoever steals it
+    while(end - begin > job->grain) {
+        size_t mid = begin + (end - begin) / 2;
+        _ParallelNode *right = &job->nodes[atomic_fetch_add_explicit(&job->next_node, 1, memory_order_relaxed)];
+        *right = (_ParallelNode){ .job = job, .begin = mid, .end = end };
+        thread_pool_spawn(job->pool, &job->group, _parallel_for_task, right);
+        end = mid;
+    }
+    job->fn(begin, end, job->user_data);
+}
+
+void parallel_for_impl(ThreadPool *pool, size_t begin, size_t end, ParallelForFn fn, void *user_data, OptParallelArg arg) {
+    if(begin >= end) {
+        return;
+    }
+    pool = pool ? pool : thread_pool_global();
+    if(!pool) {
+        fn(begin, end, user_data);
+        return;
+    }
+    size_t len = end - begin;
+    size_t grain = arg.grain ? arg.grain : len / (pool->count * 8);
+    grain = grain ? grain : 1;
+    //  halving leaves at most two leaves per grain, every spawn adds one leaf
+    size_t node_count = 2 * (len / grain) + 2;
+    _ParallelFor job = {
+        .pool = pool,
+        .fn = fn,
+        .user_data = user_data,
+        .grain = grain,
+        .nodes = allocator_alloc(&pool->alloc, node_count * sizeof(_ParallelNode)),
+    };
+    if(!job.nodes) {
+        fn(begin, end, user_data);
+        return;
+    }
+    _ParallelNode root = { .job = &job, .begin = begin, .end = end };
+    _parallel_for_task(&root);
+    thread_pool_wait(pool, &job.group);
+    allocator_free(&pool->alloc, job.nodes);
+}
+
+typedef struct _ParallelEach {
+    char *data;
+    size_t elem_size;
+    ParallelEachFn fn;
+    void *user_data;
+}_ParallelEach;
+
+static void _parallel_each_range(size_t begin, size_t end, void *arg) {
+    _ParallelEach *each = arg;
+    for(size_t i = begin; i < end; i++) {
+        each->fn(each->data + i * each->elem_size, i, each->user_data);
+    }
+}
+
+void parallel_for_each_impl(ThreadPool *pool, void *data, size_t len, size_t elem_size, ParallelEachFn fn, void *user_data, OptParallelArg arg) {
+    _ParallelEach each = { .data = data, .elem_size = elem_size, .fn = fn, .user_data = user_data };
+    parallel_for_impl(pool, 0, len, _parallel_each_range, &each, arg);
+}
+
+typedef struct _ParallelReduce {
+    size_t begin;
+    size_t end;
+    size_t grain;
+    char *accs;
+    size_t result_size;
+    ParallelReduceFn fn;
+    void *user_data;
+}_ParallelReduce;
+
+static void _parallel_reduce_chunks(size_t first, size_t last, void *arg) {
+    _ParallelReduce *reduce = arg;
+    for(size_t chunk = first; chunk < last; chunk++) {
+        size_t begin = reduce->begin + chunk * reduce->grain;
+        size_t end = begin + reduce->grain < reduce->end ? begin + reduce->grain : reduce->end;
+        reduce->fn(begin, end, reduce->accs + chunk * reduce->result_size, reduce->user_data);
+    }
+}
+
+void parallel_reduce_impl(ThreadPool *pool, size_t begin, size_t end, void *result, size_t result_size, ParallelReduceFn fn, ParallelCombineFn combine, void *user_data, OptParallelArg arg) {
+    if(begin >= end) {
+        return;
+    }
+    pool = pool ? pool : thread_pool_global();
+    if(!pool) {
+        //  `*result` holds the identity, so folding straight into it is the same
+        fn(begin, end, result, user_data);
+        return;
+    }
+    size_t len = end - begin;
+    size_t grain = arg.grain ? arg.grain : len / (pool->count * 4);
+    grain = grain ? grain : 1;
+    size_t chunks = (len + grain - 1) / grain;
+    _ParallelReduce reduce = {
+        .begin = begin,
+        .end = end,
+        .grain = grain,
+        .accs = allocator_alloc(&pool->alloc, chunks * result_size),
+        .result_size = result_size,
+        .fn = fn,
+        .user_data = user_data,
+    };
+    if(!reduce.accs) {
+        fn(begin, end, result, user_data);
+        return;
+    }
+    for(size_t i = 0; i < chunks; i++) {
+        memcpy(reduce.accs + i * result_size, result, result_size);
+    }
+    parallel_for_impl(pool, 0, chunks, _parallel_reduce_chunks, &reduce, (OptParallelArg){ .grain = 1 });
+    for(size_t i = 0; i < chunks; i++) {
+        combine(result, reduce.accs + i * result_size, user_data);
+    }
+    allocator_free(&pool->alloc, reduce.accs);
+}
+
+//  ----------------------------------- //
+//               job-impl               //
+//  ----------------------------------- //
+typedef struct _JobEdge {
+    Job *job;
+    struct _JobEdge *next;
+}_JobEdge;
+
+//  marks the dependents list of a finished job, nothing can be added after that
+#define _JOB_EDGES_CLOSED ((_JobEdge *)1)
+
+struct Job {
+    JobFn fn;
+    void *user_data;
+    ThreadPool *pool;
+    void *result;
+    Vec(Job *) deps;
+    //  unfinished dependencies, plus one until the job is submitted
+    _Atomic u32 pending;
+    //  one for the handle and one while the job is in flight
+    _Atomic u32 refs;
+    _Atomic bool done;
+    _Atomic(_JobEdge *) dependents;
+    Allocator alloc;
+};
+
+static ThreadPool *_pool_global_io = NULL;
+static once_flag _pool_global_io_once = ONCE_FLAG_INIT;
+
+static void _pool_global_io_destroy(void) {
+    if(_pool_global_io) {
+        thread_pool_destroy(_pool_global_io);
+    }
+}
+
+static void _pool_global_io_init(void) {
+    u32 count = _core_cpu_count() * 2;
+    _pool_global_io = thread_pool_new(.threads = count < 4 ? 4 : count);
+    atexit(_pool_global_io_destroy);
+}
+
+ThreadPool *thread_pool_global_io(void) {
+    call_once(&_pool_global_io_once, _pool_global_io_init);
+    return _pool_global_io;
+}
+
+Job *job_new_impl(JobFn fn, void *user_data, OptJobArg arg) {
+    Allocator alloc = ALLOC_ARG_OR_DEF(arg);
+    ThreadPool *pool = arg.pool;
+    if(!pool) {
+        pool = arg.flags & JOB_IO ? thread_pool_global_io() : thread_pool_global();
+    }
+    Job *self = allocator_alloc(&alloc, sizeof(Job));
+    if(!self) {
+        return NULL;
+    }
+    *self = (Job){
+        .fn = fn,
+        .user_data = user_data,
+        .pool = pool,
+        .deps = vec_new(.allocator = alloc),
+        .alloc = alloc,
+    };
+    atomic_init(&self->pending, 1);
+    atomic_init(&self->refs, 1);
+    atomic_init(&self->done, false);
+    atomic_init(&self->dependents, NULL);
+    return self;
+}
+
+void job_release(Job *self) {
+    if(atomic_fetch_sub_explicit(&self->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    vec_foreach(self->deps, dep) {
+        job_release(*dep);
+    }
+    vec_destroy(self->deps);
+    Allocator alloc = self->alloc;
+    allocator_free(&alloc, self);
+}
+
+static void _job_schedule(Job *self);
+
+static void _job_run(void *arg) {
+    Job *self = arg;
+    if(self->fn) {
+        size_t count = vec_len(self->deps);
+        void **results = count ? allocator_alloc(&self->alloc, count * sizeof(void *)) : NULL;
+        for(size_t i = 0; i < count; i++) {
+            results[i] = self->deps[i]->result;
+        }
+        self->result = self->fn(results, count, self->user_data);
+        allocator_free(&self->alloc, results);
+    }
+    atomic_store(&self->done, true);
+    if(self->pool) {
+        _pool_wake_waiters(self->pool);
+    }
+    _JobEdge *edge = atomic_exchange_explicit(&self->dependents, _JOB_EDGES_CLOSED, memory_order_acq_rel);
+    while(edge) {
+        _JobEdge *next = edge->next;
+        if(atomic_fetch_sub_explicit(&edge->job->pending, 1, memory_order_acq_rel) == 1) {
+            _job_schedule(edge->job);
+        }
+        allocator_free(&self->alloc, edge);
+        edge = next;
+    }
+    job_release(self);
+}
+
+static void _job_schedule(Job *self) {
+    thread_pool_spawn(self->pool, NULL, _job_run, self);
+}
+
+bool job_depends_on(Job *self, Job *dep) {
+    _JobEdge *edge = allocator_alloc(&dep->alloc, sizeof(_JobEdge));
+    if(!edge) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&dep->refs, 1, memory_order_relaxed);
+    vec_push(self->deps, dep);
+    edge->job = self;
+    atomic_fetch_add_explicit(&self->pending, 1, memory_order_relaxed);
+    _JobEdge *head = atomic_load_explicit(&dep->dependents, memory_order_acquire);
+    do {
+        if(head == _JOB_EDGES_CLOSED) {
+            //  already finished, its result is ready
+            atomic_fetch_sub_explicit(&self->pending, 1, memory_order_relaxed);
+            allocator_free(&dep->alloc, edge);
+            return true;
+        }
+        edge->next = head;
+    } while(!atomic_compare_exchange_weak_explicit(&dep->dependents, &head, edge, memory_order_acq_rel, memory_order_acquire));
+    return true;
+}
+
+void job_submit(Job *self) {
+    atomic_fetch_add_explicit(&self->refs, 1, memory_order_relaxed);
+    if(atomic_fetch_sub_explicit(&self->pending, 1, memory_order_acq_rel) == 1) {
+        _job_schedule(self);
+    }
+}
+
+Job *job_then_impl(Job *self, JobFn fn, void *user_data, OptJobArg arg) {
+    if(!arg.allocator.alloc) {
+        arg.allocator = self->alloc;
+    }
+    Job *next = job_new_impl(fn, user_data, arg);
+    if(!next) {
+        return NULL;
+    }
+    if(!job_depends_on(next, self)) {
+        job_release(next);
+        return NULL;
+    }
+    job_submit(next);
+    return next;
+}
+
+bool job_is_done(Job *self) {
+    return atomic_load_explicit(&self->done, memory_order_acquire);
+}
+
+void *job_wait(Job *self) {
+    ThreadPool *pool = self->pool;
+    if(!pool) {
+        //  without a pool every job ran inside `job_submit`, only unsubmitted
+        //  dependencies can still hold it back
+        while(!job_is_done(self)) {
+            thrd_yield();
+        }
+        return self->result;
+    }
+    u32 idle = 0;
+    while(!job_is_done(self)) {
+        _Task task;
+        if(_pool_find_task(pool, &task)) {
+            _pool_run(pool, &task);
+            idle = 0;
+            continue;
+        }
+        if(pool != _pool_global && _pool_global && _pool_find_task(_pool_global, &task)) {
+            _pool_run(_pool_global, &task);
+            idle = 0;
+            continue;
+        }
+        //  a worker of another pool keeps polling, its own pool may need it to make progress
+        if(++idle < 64 || (_pool_current && _pool_current != pool)) {
+            thrd_yield();
+            continue;
+        }
+        //  same as `thread_pool_wait`, woken when the job finishes or `pool` gets new work
+        mtx_lock(&pool->lock);
+        atomic_fetch_add(&pool->waiters, 1);
+        atomic_fetch_add(&pool->sleepers, 1);
+        if(!atomic_load(&self->done) && !_pool_has_work(pool)) {
+            cnd_wait(&pool->wake, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        atomic_fetch_sub(&pool->waiters, 1);
+        mtx_unlock(&pool->lock);
+        idle = 0;
+    }
+    return self->result;
+}
+
 //  ----------------------------------- //
 //              bitmap-impl             //
 //  ----------------------------------- //
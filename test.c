@@ -53,16 +53,71 @@ void *newarena_alloc(NewArena *arena, size_t size) {
     CORE_CONCAT(Vector2, suffix) CORE_CONCAT(Vector2, suffix) ##_new(typ x, typ y);*/
 
 static void test(void);
+static void test_utf8(void);
+static void test_file_mode(void);
+static void test_file_reader(void);
+static void test_async_io(void);
+static void test_file_copy(void);
+static void test_log_fast(void);
+static void test_print_threads(void);
+static void test_queue(void);
+static void test_thread_pool(void);
+static void test_job(void);
+static void test_fiber(void);
+static void test_sync(void);
+static void test_ringbuffer(void);
+static void test_magic_ring(void);
+static void test_small_vec(void);
+static void test_vec_empty(void);
+static void test_soa(void);
+static void test_file_writer(void);
+static void test_dir_walk(void);
+static void test_chunks(void);
+static void test_file_watcher(void);
+static void test_append_log(void);
+static void test_log_async(void);
+static void test_log_level(void);
+static void test_context(void);
 
 int main(void) {
     test();
+    test_utf8();
+    test_file_mode();
+    test_file_reader();
+    test_async_io();
+    test_file_copy();
+    test_log_fast();
+    test_print_threads();
+    test_queue();
+    test_thread_pool();
+    test_job();
+    test_fiber();
+    test_sync();
+    test_ringbuffer();
+    test_magic_ring();
+    test_small_vec();
+    test_vec_empty();
+    test_soa();
+    test_file_writer();
+    test_dir_walk();
+    test_chunks();
+    test_file_watcher();
+    test_append_log();
+    test_log_async();
+    test_log_level();
+    test_context();
 
     ringbuffer_print_stats(&core_context.ring_buffer);
     arena_print_stats(&core_context.temp_arena);
 #ifdef CORE_MEM_DEBUG
-    vec_foreach(core_context.memory_stats.allocations, alloc) {
+    mutex_lock(&core_memory_stats.lock);
+    vec_foreach(core_memory_stats.allocations, alloc) {
+        if(alloc->freed_at.line) {
+            continue;
+        }
         println("%s:%zu: addr = %p, size = %zu", alloc->file.data, alloc->line, alloc->addr, alloc->size);
     }
+    mutex_unlock(&core_memory_stats.lock);
 #endif
     return 0;
 }
@@ -83,3 +138,1984 @@ static void test(void) {
 
     arena_print_stats(&arena);
 }
+
+static u64 test_rng = 0x9E3779B97F4A7C15ull;
+
+static u32 test_rand(void) {
+    test_rng ^= test_rng << 13;
+    test_rng ^= test_rng >> 7;
+    test_rng ^= test_rng << 17;
+    return (u32)(test_rng >> 32);
+}
+
+static bool test_utf8_check(const char *data, size_t len) {
+    StringView view = { .len = len, .data = data };
+    bool valid = _utf8_validate_scalar(data, len);
+#ifdef CORE_AVX2
+    CORE_ASSERT(_utf8_validate_avx2(data, len) == valid);
+#endif
+    CORE_ASSERT(utf8_validate(view) == valid);
+    if(valid) {
+        Vec(u32) wide = utf8_to_utf32(view);
+        CORE_ASSERT(vec_len(wide) == utf8_count(view));
+        Vec(char) narrow = utf32_to_utf8(wide, vec_len(wide));
+        CORE_ASSERT(vec_len(narrow) == len && memcmp(narrow, data, len) == 0);
+        vec_destroy(narrow);
+        vec_destroy(wide);
+    }
+    return valid;
+}
+
+static void test_utf8(void) {
+    struct { const char *data; bool valid; } cases[] = {
+        { "\xE2\x82\xAC", true },
+        { "\xF0\x9F\x98\x80", true },
+        { "\xC0\xAF", false },
+        { "\xE0\x80\xAF", false },
+        { "\xED\xA0\x80", false },
+        { "\xF4\x90\x80\x80", false },
+        { "\xF5\x80\x80\x80", false },
+        { "\xE2\x82", false },
+        { "\x80", false },
+        { "\xC2\xC2\x80", false },
+    };
+    char buffer[512];
+    for(size_t i = 0; i < CORE_ARRLEN(cases); i++) {
+        size_t len = strlen(cases[i].data);
+        //  also place every case across the 32 byte block boundary
+        for(size_t offset = 0; offset < 40; offset++) {
+            memset(buffer, 'a', offset);
+            memcpy(buffer + offset, cases[i].data, len);
+            CORE_ASSERT(test_utf8_check(buffer, offset + len) == cases[i].valid);
+        }
+    }
+
+    size_t valid = 0;
+    for(size_t round = 0; round < 20000; round++) {
+        size_t len = 0;
+        while(len + 4 <= sizeof(buffer)) {
+            u32 r = test_rand();
+            u32 cp = 0;
+            switch(r % 4) {
+                case 0: cp = r % 0x80; break;
+                case 1: cp = 0x80 + r % 0x780; break;
+                case 2: cp = 0x800 + r % 0xF800; break;
+                case 3: cp = 0x10000 + r % 0x100000; break;
+            }
+            len += utf8_encode(cp, buffer + len);
+        }
+        if(round % 3 == 1) {
+            buffer[test_rand() % len] = (char)test_rand();
+        }else if(round % 3 == 2) {
+            for(size_t i = 0; i < len; i++) {
+                buffer[i] = (char)test_rand();
+            }
+        }
+        //  truncating may cut a sequence in half
+        len -= test_rand() % 8;
+        valid += test_utf8_check(buffer, len);
+    }
+    CORE_ASSERT(valid > 0 && valid < 20000);
+    println("utf8: ok");
+}
+
+static void test_file_mode(void) {
+    struct { FileMode_ mode; const char *str; } cases[] = {
+        { FILE_READ, "r" },
+        { FILE_WRITE, "w" },
+        { FILE_APPEND, "a" },
+        { FILE_READ | FILE_WRITE, "r+" },
+        { FILE_READ | FILE_WRITE | FILE_TRUNCATE, "w+" },
+        { FILE_READ | FILE_APPEND, "a+" },
+        { FILE_WRITE | FILE_PLUS | FILE_BIN, "w+b" },
+    };
+    for(size_t i = 0; i < CORE_ARRLEN(cases); i++) {
+        String str = mode_to_string(cases[i].mode);
+        CORE_ASSERT(strcmp(string_cstr(&str), cases[i].str) == 0);
+    }
+    println("file mode: ok");
+}
+
+static void test_file_reader_lines(const char *content, const char **lines, size_t count) {
+    const char *path = "test_file_reader.txt";
+    FileHandle out = file_open(path, FILE_WRITE | FILE_BIN);
+    file_write_raw(out, content, strlen(content));
+    file_close(out);
+    //  small buffers so lines and "\r\n" pairs straddle refills
+    for(size_t buffer_size = 1; buffer_size <= 8; buffer_size++) {
+        FileHandle in = file_open(path, FILE_READ | FILE_BIN);
+        FileReader reader = file_reader_new(in, .buffer_size = buffer_size);
+        StringView line;
+        size_t i = 0;
+        while(file_reader_next_line(&reader, &line)) {
+            CORE_ASSERT(i < count);
+            CORE_ASSERT(line.len == strlen(lines[i]) && memcmp(line.data, lines[i], line.len) == 0);
+            i++;
+        }
+        CORE_ASSERT(i == count && !reader.error);
+        file_reader_deinit(&reader);
+        file_close(in);
+    }
+    remove(path);
+}
+
+static void test_file_reader(void) {
+    const char *crlf[] = { "one", "", "three", "four" };
+    test_file_reader_lines("one\r\n\r\nthree\r\nfour\r\n", crlf, CORE_ARRLEN(crlf));
+    const char *unterminated[] = { "a", "bc", "last line" };
+    test_file_reader_lines("a\nbc\r\nlast line", unterminated, CORE_ARRLEN(unterminated));
+    const char *blank[] = { "", "" };
+    test_file_reader_lines("\n\n", blank, CORE_ARRLEN(blank));
+    test_file_reader_lines("", NULL, 0);
+
+    const char *path = "test_file_reader.txt";
+    FileHandle out = file_open(path, FILE_WRITE | FILE_BIN);
+    file_write_raw(out, "0123456789", 10);
+    file_close(out);
+    FileHandle in = file_open(path, FILE_READ | FILE_BIN);
+    FileReader reader = file_reader_new(in, .buffer_size = 3);
+    Slice(char) chunk;
+    size_t total = 0;
+    while(file_reader_next_chunk(&reader, 4, &chunk)) {
+        CORE_ASSERT(chunk.len == (total < 8 ? 4 : 2));
+        CORE_ASSERT(memcmp(chunk.data, "0123456789" + total, chunk.len) == 0);
+        total += chunk.len;
+    }
+    CORE_ASSERT(total == 10);
+    file_reader_deinit(&reader);
+    file_close(in);
+    remove(path);
+    println("file reader: ok");
+}
+
+#ifdef PLATFORM_POSIX
+static void test_async_io_callback(AsyncCompletion *completion) {
+    (*(size_t *)completion->user_data)++;
+}
+
+static void test_async_io_run(bool no_uring) {
+    const char *path = "test_async_io.bin";
+    i32 fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    CORE_ASSERT(fd >= 0);
+    AsyncIO *io = async_io_new(.no_uring = no_uring, .workers = 1, .queue_depth = 64);
+    CORE_ASSERT(io);
+    char bytes[48];
+    AsyncRequest requests[48];
+    size_t callbacks = 0;
+    for(size_t i = 0; i < CORE_ARRLEN(requests); i++) {
+        bytes[i] = (char)('0' + i);
+        requests[i] = (AsyncRequest){
+            .kind = ASYNC_OP_WRITE,
+            .fd = fd,
+            .buffer = &bytes[i],
+            .len = 1,
+            .offset = i,
+            //  every third request completes through its callback instead of `out`
+            .callback = i % 3 == 0 ? test_async_io_callback : NULL,
+            .user_data = i % 3 == 0 ? (void *)&callbacks : (void *)&requests[i],
+        };
+    }
+    size_t submitted = async_io_submit(io, requests, CORE_ARRLEN(requests));
+    CORE_ASSERT(submitted == CORE_ARRLEN(requests));
+    size_t stored = 0;
+    AsyncCompletion out[8];
+    while(async_io_in_flight(io) > 0) {
+        size_t count = async_io_wait(io, out, CORE_ARRLEN(out), 1);
+        CORE_ASSERT(count <= CORE_ARRLEN(out));
+        for(size_t i = 0; i < count; i++) {
+            CORE_ASSERT(out[i].request->callback == NULL && out[i].user_data == out[i].request);
+            CORE_ASSERT(out[i].result == 1);
+            stored++;
+        }
+    }
+    CORE_ASSERT(stored == 32 && callbacks == 16);
+    char back[48];
+    i64 got = pread(fd, back, sizeof(back), 0);
+    CORE_ASSERT(got == sizeof(back) && memcmp(back, bytes, sizeof(back)) == 0);
+    async_io_destroy(io);
+
+    //  the worker fallback runs requests in submission order
+    if(no_uring) {
+        io = async_io_new(.no_uring = true, .workers = 1);
+        ftruncate(fd, 0);
+        for(size_t i = 0; i < CORE_ARRLEN(requests); i++) {
+            requests[i].offset = ASYNC_OFFSET_CURRENT;
+            requests[i].callback = NULL;
+        }
+        lseek(fd, 0, SEEK_SET);
+        size_t queued = async_io_submit(io, requests, CORE_ARRLEN(requests));
+        while(async_io_in_flight(io) > 0) {
+            async_io_wait(io, out, CORE_ARRLEN(out), 1);
+        }
+        got = pread(fd, back, queued, 0);
+        CORE_ASSERT(got == (i64)queued && memcmp(back, bytes, queued) == 0);
+        async_io_destroy(io);
+    }
+    close(fd);
+    remove(path);
+}
+
+static void test_async_io(void) {
+    test_async_io_run(true);
+    test_async_io_run(false);
+    println("async io: ok");
+}
+#else
+static void test_async_io(void) {}
+#endif
+
+static void test_file_copy(void) {
+    char data[CORE_KB(16)];
+    for(size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)test_rand();
+    }
+    const char *src_path = "test_file_copy_src.bin";
+    const char *dst_path = "test_file_copy_dst.bin";
+    FileHandle src = file_open(src_path, FILE_WRITE | FILE_BIN);
+    file_write_raw(src, data, sizeof(data));
+    file_close(src);
+
+    //  regular to regular continues from the current positions
+    src = file_open(src_path, FILE_READ | FILE_BIN);
+    FileHandle dst = file_open(dst_path, FILE_WRITE | FILE_BIN);
+    char head[100];
+    size_t skipped = fread(head, 1, sizeof(head), src->fd);
+    CORE_ASSERT(skipped == sizeof(head));
+    i64 copied = file_copy(dst, src);
+    CORE_ASSERT(copied == sizeof(data) - sizeof(head));
+    CORE_ASSERT(ftell(src->fd) == sizeof(data) && ftell(dst->fd) == sizeof(data) - sizeof(head));
+    file_close(dst);
+    file_close(src);
+    String copy = file_read_to_string(dst_path);
+    CORE_ASSERT(string_len(&copy) == sizeof(data) - sizeof(head) && memcmp(string_cstr(&copy), data + sizeof(head), sizeof(data) - sizeof(head)) == 0);
+    string_destroy(&copy);
+
+#ifdef PLATFORM_POSIX
+    //  a pipe has no offset to query
+    i32 fds[2];
+    i32 piped = pipe(fds);
+    CORE_ASSERT(piped == 0);
+    i64 written = write(fds[1], data, sizeof(data));
+    CORE_ASSERT(written == sizeof(data));
+    close(fds[1]);
+    File pipe_in = { .fd = fdopen(fds[0], "rb") };
+    dst = file_open(dst_path, FILE_WRITE | FILE_BIN);
+    copied = file_copy(dst, &pipe_in);
+    CORE_ASSERT(copied == sizeof(data));
+    CORE_ASSERT(ftell(dst->fd) == sizeof(data));
+    fclose(pipe_in.fd);
+    file_close(dst);
+    copy = file_read_to_string(dst_path);
+    CORE_ASSERT(string_len(&copy) == sizeof(data) && memcmp(string_cstr(&copy), data, sizeof(data)) == 0);
+    string_destroy(&copy);
+
+    piped = pipe(fds);
+    CORE_ASSERT(piped == 0);
+    File pipe_out = { .fd = fdopen(fds[1], "wb") };
+    src = file_open(src_path, FILE_READ | FILE_BIN);
+    copied = file_copy(&pipe_out, src);
+    CORE_ASSERT(copied == sizeof(data));
+    CORE_ASSERT(ftell(src->fd) == sizeof(data));
+    fclose(pipe_out.fd);
+    file_close(src);
+    char back[sizeof(data)];
+    size_t got = 0;
+    for(i64 n; got < sizeof(back) && (n = read(fds[0], back + got, sizeof(back) - got)) > 0; got += n);
+    close(fds[0]);
+    CORE_ASSERT(got == sizeof(data) && memcmp(back, data, sizeof(data)) == 0);
+#endif
+    remove(src_path);
+    remove(dst_path);
+    println("file copy: ok");
+}
+
+static void test_log_fast(void) {
+    CORE_ASSERT(_log_arg_kind("ll", 2, 'd') == LOG_ARG_LLONG);
+    CORE_ASSERT(_log_arg_kind("hh", 2, 'u') == LOG_ARG_INT);
+    CORE_ASSERT(_log_arg_kind("lz", 2, 'u') == LOG_ARG_INVALID);
+    CORE_ASSERT(_log_arg_kind("zz", 2, 'u') == LOG_ARG_INVALID);
+    CORE_ASSERT(_log_arg_kind("ll", 2, 'f') == LOG_ARG_INVALID);
+
+    const char *path = "test_log_fast.log";
+    FileHandle file = file_open(path, FILE_WRITE | FILE_BIN);
+    bool started = log_async_start(.file = file);
+    CORE_ASSERT(started);
+    //  views into a buffer without a NUL terminator, only `len` bytes may be read
+    char *data = malloc(5);
+    memcpy(data, "hello", 5);
+    StringView view = { .len = 4, .data = data };
+    log_fast(CORE_INFO, "view %.*s|", (int)view.len, view.data);
+    log_fast(CORE_INFO, "fixed %.3s|%5.2s|", data, data);
+    log_fast(CORE_INFO, "plain %s %d", "str", 7);
+    log_async_stop();
+    file_close(file);
+    free(data);
+
+    String text = file_read_to_string(path);
+    CORE_ASSERT(strcmp(string_cstr(&text), "[INFO] view hell|\n[INFO] fixed hel|   he|\n[INFO] plain str 7\n") == 0);
+    string_destroy(&text);
+    remove(path);
+    println("log fast: ok");
+}
+
+#ifdef PLATFORM_POSIX
+typedef struct TestPrintShared {
+    FileHandle file;
+    Event printed;
+    Event release;
+}TestPrintShared;
+
+static i32 test_print_worker(void *arg) {
+    TestPrintShared *shared = arg;
+    print("from worker\n");
+    fprintln(shared->file, "fprint from worker");
+    event_set(&shared->printed);
+    //  stays alive with its stdout buffer still full
+    event_wait(&shared->release);
+    return 0;
+}
+
+static void test_print_threads(void) {
+    const char *out_path = "test_print_stdout.txt";
+    const char *file_path = "test_print_file.txt";
+    print_flush();
+    fflush(stdout);
+    i32 saved = dup(1);
+    i32 out = open(out_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    dup2(out, 1);
+    close(out);
+
+    TestPrintShared shared = { .file = file_open(file_path, FILE_WRITE) };
+    thrd_t thread;
+    thrd_create(&thread, test_print_worker, &shared);
+    event_wait(&shared.printed);
+    //  closing the file from another thread must not leave the worker pointing at it
+    file_close(shared.file);
+    //  what `exit` runs, drains the buffers of all threads
+    _print_exit();
+    event_set(&shared.release);
+    thrd_join(thread, NULL);
+
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    String text = file_read_to_string(out_path);
+    CORE_ASSERT(strcmp(string_cstr(&text), "from worker\n") == 0);
+    string_destroy(&text);
+    text = file_read_to_string(file_path);
+    CORE_ASSERT(strcmp(string_cstr(&text), "fprint from worker\n") == 0);
+    string_destroy(&text);
+    remove(out_path);
+    remove(file_path);
+    println("print threads: ok");
+}
+#else
+static void test_print_threads(void) {}
+#endif
+
+#define TEST_QUEUE_ITEMS 100000
+#define TEST_QUEUE_THREADS 4
+
+typedef struct TestQueueShared {
+    SpscQueue(u64) spsc;
+    MpmcQueue(u64) mpmc;
+    _Atomic size_t next_producer;
+    _Atomic size_t next_consumer;
+    _Atomic u64 popped;
+    _Atomic u64 sum;
+}TestQueueShared;
+
+static i32 test_queue_spsc_producer(void *arg) {
+    TestQueueShared *shared = arg;
+    u64 batch[7];
+    for(u64 i = 0; i < TEST_QUEUE_ITEMS;) {
+        //  alternate single pushes and batches so runs wrap around the end
+        if(i % 2 == 0) {
+            while(!spsc_queue_push(shared->spsc, i)) {
+                thrd_yield();
+            }
+            i++;
+        }else {
+            size_t count = 0;
+            for(; count < CORE_ARRLEN(batch) && i + count < TEST_QUEUE_ITEMS; count++) {
+                batch[count] = i + count;
+            }
+            size_t pushed = 0;
+            while((pushed += spsc_queue_push_batch(shared->spsc, batch + pushed, count - pushed)) < count) {
+                thrd_yield();
+            }
+            i += count;
+        }
+    }
+    return 0;
+}
+
+static i32 test_queue_mpmc_producer(void *arg) {
+    TestQueueShared *shared = arg;
+    u64 producer = atomic_fetch_add(&shared->next_producer, 1);
+    for(u64 i = 0; i < TEST_QUEUE_ITEMS; i++) {
+        while(!mpmc_queue_push(shared->mpmc, producer << 32 | i)) {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+static i32 test_queue_mpmc_consumer(void *arg) {
+    TestQueueShared *shared = arg;
+    //  every consumer sees the items of one producer in the order they were pushed
+    u64 last[TEST_QUEUE_THREADS];
+    for(size_t i = 0; i < TEST_QUEUE_THREADS; i++) {
+        last[i] = UINT64_MAX;
+    }
+    u64 out[5];
+    while(atomic_load(&shared->popped) < TEST_QUEUE_THREADS * TEST_QUEUE_ITEMS) {
+        size_t count = mpmc_queue_pop_batch(shared->mpmc, out, CORE_ARRLEN(out));
+        if(count == 0) {
+            thrd_yield();
+            continue;
+        }
+        for(size_t i = 0; i < count; i++) {
+            u64 producer = out[i] >> 32, value = out[i] & 0xFFFFFFFF;
+            CORE_ASSERT(producer < TEST_QUEUE_THREADS);
+            CORE_ASSERT(last[producer] == UINT64_MAX || value > last[producer]);
+            last[producer] = value;
+            atomic_fetch_add(&shared->sum, value);
+        }
+        atomic_fetch_add(&shared->popped, count);
+    }
+    return 0;
+}
+
+static void test_queue(void) {
+    //  capacity rounds up to a power of two and is a hard limit
+    SpscQueue(u64) spsc = spsc_queue_new(u64, 5);
+    CORE_ASSERT(spsc_queue_cap(spsc) == 8);
+    bool ok;
+    for(u64 i = 0; i < 8; i++) {
+        ok = spsc_queue_push(spsc, i);
+        CORE_ASSERT(ok);
+    }
+    ok = spsc_queue_push(spsc, 8);
+    CORE_ASSERT(!ok && spsc_queue_len(spsc) == 8);
+    u64 value;
+    for(u64 i = 0; i < 3; i++) {
+        ok = spsc_queue_pop(spsc, &value);
+        CORE_ASSERT(ok && value == i);
+    }
+    u64 batch[6] = { 8, 9, 10, 11, 12, 13 };
+    size_t moved = spsc_queue_push_batch(spsc, batch, CORE_ARRLEN(batch));
+    CORE_ASSERT(moved == 3);
+    u64 out[16];
+    moved = spsc_queue_pop_batch(spsc, out, CORE_ARRLEN(out));
+    CORE_ASSERT(moved == 8);
+    for(u64 i = 0; i < 8; i++) {
+        CORE_ASSERT(out[i] == i + 3);
+    }
+    ok = spsc_queue_pop(spsc, &value);
+    CORE_ASSERT(!ok && spsc_queue_len(spsc) == 0);
+    spsc_queue_destroy(spsc);
+
+    MpmcQueue(u64) mpmc = mpmc_queue_new(u64, 4);
+    CORE_ASSERT(mpmc_queue_cap(mpmc) == 4);
+    moved = mpmc_queue_push_batch(mpmc, batch, CORE_ARRLEN(batch));
+    CORE_ASSERT(moved == 4);
+    ok = mpmc_queue_push(mpmc, 99);
+    CORE_ASSERT(!ok && mpmc_queue_len(mpmc) == 4);
+    ok = mpmc_queue_pop(mpmc, &value);
+    CORE_ASSERT(ok && value == 8);
+    ok = mpmc_queue_pop(mpmc, &value);
+    CORE_ASSERT(ok && value == 9);
+    moved = mpmc_queue_push_batch(mpmc, batch + 4, 2);
+    CORE_ASSERT(moved == 2);
+    moved = mpmc_queue_pop_batch(mpmc, out, CORE_ARRLEN(out));
+    CORE_ASSERT(moved == 4);
+    CORE_ASSERT(out[0] == 10 && out[1] == 11 && out[2] == 12 && out[3] == 13);
+    ok = mpmc_queue_pop(mpmc, &value);
+    CORE_ASSERT(!ok && mpmc_queue_len(mpmc) == 0);
+    mpmc_queue_destroy(mpmc);
+
+    //  a small queue under contention wraps many times
+    TestQueueShared shared = { .spsc = spsc_queue_new(u64, 16), .mpmc = mpmc_queue_new(u64, 16) };
+    thrd_t threads[TEST_QUEUE_THREADS * 2];
+    thrd_create(&threads[0], test_queue_spsc_producer, &shared);
+    for(u64 i = 0; i < TEST_QUEUE_ITEMS;) {
+        size_t count = spsc_queue_pop_batch(shared.spsc, out, 1 + i % CORE_ARRLEN(out));
+        if(count == 0) {
+            thrd_yield();
+        }
+        for(size_t j = 0; j < count; j++) {
+            CORE_ASSERT(out[j] == i + j);
+        }
+        i += count;
+    }
+    thrd_join(threads[0], NULL);
+    CORE_ASSERT(spsc_queue_len(shared.spsc) == 0);
+    spsc_queue_destroy(shared.spsc);
+
+    for(size_t i = 0; i < TEST_QUEUE_THREADS; i++) {
+        thrd_create(&threads[i], test_queue_mpmc_producer, &shared);
+        thrd_create(&threads[TEST_QUEUE_THREADS + i], test_queue_mpmc_consumer, &shared);
+    }
+    for(size_t i = 0; i < CORE_ARRLEN(threads); i++) {
+        thrd_join(threads[i], NULL);
+    }
+    u64 expected = (u64)TEST_QUEUE_THREADS * TEST_QUEUE_ITEMS * (TEST_QUEUE_ITEMS - 1) / 2;
+    CORE_ASSERT(shared.popped == TEST_QUEUE_THREADS * TEST_QUEUE_ITEMS && shared.sum == expected);
+    CORE_ASSERT(mpmc_queue_len(shared.mpmc) == 0);
+    mpmc_queue_destroy(shared.mpmc);
+    println("queue: ok");
+}
+
+typedef struct TestPoolShared {
+    ThreadPool *pool;
+    TaskGroup group;
+    _Atomic size_t count;
+}TestPoolShared;
+
+static void test_pool_count(void *arg) {
+    atomic_fetch_add(&((TestPoolShared *)arg)->count, 1);
+}
+
+static void test_pool_fan_out(void *arg) {
+    //  spawned on a worker, more children than its deque holds
+    TestPoolShared *shared = arg;
+    for(size_t i = 0; i < 40; i++) {
+        thread_pool_spawn(shared->pool, &shared->group, test_pool_count, shared);
+    }
+    test_pool_count(shared);
+}
+
+static void test_pool_slow(void *arg) {
+    thrd_sleep(&(struct timespec){ .tv_nsec = 50 * 1000 * 1000 }, NULL);
+    test_pool_count(arg);
+}
+
+static void test_pool_for(size_t begin, size_t end, void *user_data) {
+    for(size_t i = begin; i < end; i++) {
+        atomic_fetch_add((_Atomic u64 *)user_data, i);
+    }
+}
+
+static void test_pool_reduce(size_t begin, size_t end, void *acc, void *user_data) {
+    CORE_UNUSED(user_data);
+    for(size_t i = begin; i < end; i++) {
+        *(u64 *)acc += i;
+    }
+}
+
+static void test_pool_combine(void *acc, const void *other, void *user_data) {
+    CORE_UNUSED(user_data);
+    *(u64 *)acc += *(const u64 *)other;
+}
+
+//  hands out memory until `fail` is set
+typedef struct TestFailAlloc {
+    bool fail;
+}TestFailAlloc;
+
+static void *test_fail_alloc(void *self, size_t size) {
+    return ((TestFailAlloc *)self)->fail ? NULL : malloc(size);
+}
+
+static void *test_fail_realloc(void *self, void *mem, size_t size) {
+    return ((TestFailAlloc *)self)->fail ? NULL : realloc(mem, size);
+}
+
+static void test_fail_free(void *self, void *mem) {
+    CORE_UNUSED(self);
+    free(mem);
+}
+
+static void test_thread_pool(void) {
+    TestPoolShared shared = { .pool = thread_pool_new(.threads = 3, .deque_size = 16) };
+    CORE_ASSERT(shared.pool && thread_pool_threads(shared.pool) == 3);
+
+    //  more tasks than the inject queue holds, the overflow runs inline
+    for(size_t i = 0; i < 1000; i++) {
+        thread_pool_spawn(shared.pool, &shared.group, test_pool_count, &shared);
+    }
+    thread_pool_wait(shared.pool, &shared.group);
+    CORE_ASSERT(shared.count == 1000 && shared.group.pending == 0);
+
+    shared.count = 0;
+    for(size_t i = 0; i < 50; i++) {
+        thread_pool_spawn(shared.pool, &shared.group, test_pool_fan_out, &shared);
+    }
+    thread_pool_wait(shared.pool, &shared.group);
+    CORE_ASSERT(shared.count == 50 * 41);
+
+    //  nothing left to help with, the waiting thread sleeps until the slow tasks finish
+    shared.count = 0;
+    for(size_t i = 0; i < 3; i++) {
+        thread_pool_spawn(shared.pool, &shared.group, test_pool_slow, &shared);
+    }
+    thread_pool_wait(shared.pool, &shared.group);
+    CORE_ASSERT(shared.count == 3);
+
+    const size_t n = 100000;
+    _Atomic u64 sum = 0;
+    parallel_for(shared.pool, 0, n, test_pool_for, (void *)&sum, .grain = 100);
+    CORE_ASSERT(sum == (u64)n * (n - 1) / 2);
+    u64 reduced = 0;
+    parallel_reduce(shared.pool, 0, n, &reduced, test_pool_reduce, test_pool_combine, NULL, .grain = 100);
+    CORE_ASSERT(reduced == (u64)n * (n - 1) / 2);
+    thread_pool_destroy(shared.pool);
+
+    //  no memory for the splits, both loops still cover the whole range on the caller
+    TestFailAlloc failing = {0};
+    Allocator alloc = { .self = &failing, .alloc = test_fail_alloc, .realloc = test_fail_realloc, .free = test_fail_free };
+    ThreadPool *pool = thread_pool_new(.threads = 2, .allocator = alloc);
+    CORE_ASSERT(pool);
+    failing.fail = true;
+    sum = 0;
+    parallel_for(pool, 0, n, test_pool_for, (void *)&sum, .grain = 100);
+    CORE_ASSERT(sum == (u64)n * (n - 1) / 2);
+    reduced = 0;
+    parallel_reduce(pool, 0, n, &reduced, test_pool_reduce, test_pool_combine, NULL, .grain = 100);
+    CORE_ASSERT(reduced == (u64)n * (n - 1) / 2);
+    failing.fail = false;
+    thread_pool_destroy(pool);
+    println("thread pool: ok");
+}
+
+static void *test_job_value(void **deps, size_t count, void *user_data) {
+    CORE_UNUSED(deps);
+    CORE_ASSERT(count == 0);
+    return user_data;
+}
+
+//  adds up its dependencies in order, weighted by position, plus `user_data`
+static void *test_job_sum(void **deps, size_t count, void *user_data) {
+    size_t sum = (size_t)user_data;
+    for(size_t i = 0; i < count; i++) {
+        sum += (i + 1) * (size_t)deps[i];
+    }
+    return (void *)sum;
+}
+
+static void *test_job_blocking(void **deps, size_t count, void *user_data) {
+    CORE_UNUSED(deps);
+    CORE_UNUSED(count);
+    thrd_sleep(&(struct timespec){ .tv_nsec = 50 * 1000 * 1000 }, NULL);
+    return user_data;
+}
+
+static void *test_job_count(void **deps, size_t count, void *user_data) {
+    CORE_UNUSED(deps);
+    CORE_UNUSED(count);
+    atomic_fetch_add((_Atomic size_t *)user_data, 1);
+    return NULL;
+}
+
+static void test_job(void) {
+    ThreadPool *pool = thread_pool_new(.threads = 2);
+
+    //  diamond, `d` sees the results of `b` and `c` in the order they were added
+    Job *a = job_new(test_job_value, (void *)1, .pool = pool);
+    Job *b = job_new(test_job_sum, (void *)10, .pool = pool);
+    Job *c = job_new(test_job_sum, (void *)100, .pool = pool);
+    Job *d = job_new(test_job_sum, NULL, .pool = pool);
+    job_depends_on(b, a);
+    job_depends_on(c, a);
+    job_depends_on(d, b);
+    job_depends_on(d, c);
+    job_submit(d);
+    job_submit(c);
+    job_submit(b);
+    job_submit(a);
+    size_t result = (size_t)job_wait(d);
+    CORE_ASSERT(result == 11 + 2 * 101);
+    CORE_ASSERT(job_is_done(a) && job_is_done(b) && job_is_done(c));
+    //  depending on a finished job still hands over its result
+    Job *late = job_new(test_job_sum, NULL, .pool = pool);
+    job_depends_on(late, d);
+    job_submit(late);
+    result = (size_t)job_wait(late);
+    CORE_ASSERT(result == 213);
+    job_release(late);
+    job_release(d);
+    job_release(c);
+    job_release(b);
+    job_release(a);
+
+    //  a long chain, every step adds one
+    Job *chain = job_new(test_job_value, (void *)0, .pool = pool);
+    job_submit(chain);
+    Job *last = chain;
+    for(size_t i = 0; i < 100; i++) {
+        Job *next = job_then(last, test_job_sum, (void *)1, .pool = pool);
+        job_release(last);
+        last = next;
+    }
+    result = (size_t)job_wait(last);
+    CORE_ASSERT(result == 100);
+    job_release(last);
+
+    //  fan in through a join without a function
+    _Atomic size_t counted = 0;
+    Job *join = job_new(NULL, NULL, .pool = pool);
+    for(size_t i = 0; i < 200; i++) {
+        Job *job = job_new(test_job_count, (void *)&counted, .pool = pool);
+        job_depends_on(join, job);
+        job_submit(job);
+        job_release(job);
+    }
+    job_submit(join);
+    void *joined = job_wait(join);
+    CORE_ASSERT(joined == NULL && counted == 200);
+    job_release(join);
+
+    //  the waiting thread has nothing to run while the io job blocks
+    Job *io = job_new(test_job_blocking, (void *)7, .flags = JOB_IO);
+    Job *after = job_then(io, test_job_sum, (void *)1, .pool = pool);
+    job_submit(io);
+    result = (size_t)job_wait(after);
+    CORE_ASSERT(result == 8);
+    job_release(after);
+    job_release(io);
+
+    //  allocation failures are reported instead of crashing
+    TestFailAlloc failing = {0};
+    Allocator alloc = { .self = &failing, .alloc = test_fail_alloc, .realloc = test_fail_realloc, .free = test_fail_free };
+    Job *dep = job_new(test_job_value, (void *)5, .pool = pool, .allocator = alloc);
+    Job *job = job_new(test_job_sum, (void *)1, .pool = pool);
+    CORE_ASSERT(dep && job);
+    failing.fail = true;
+    Job *missing = job_new(test_job_value, NULL, .pool = pool, .allocator = alloc);
+    bool linked = job_depends_on(job, dep);
+    Job *then = job_then(dep, test_job_sum, NULL, .pool = pool, .allocator = alloc);
+    CORE_ASSERT(missing == NULL && !linked && then == NULL);
+    failing.fail = false;
+    //  the failed edge left `job` without dependencies
+    job_submit(job);
+    result = (size_t)job_wait(job);
+    CORE_ASSERT(result == 1);
+    job_submit(dep);
+    result = (size_t)job_wait(dep);
+    CORE_ASSERT(result == 5);
+    job_release(job);
+    job_release(dep);
+
+    thread_pool_destroy(pool);
+    println("job: ok");
+}
+
+#ifdef PLATFORM_POSIX
+static void test_fiber_main(void *arg) {
+    for(size_t i = 0; i < 10; i++) {
+        //  formatting doubles needs the stack alignment of a regular call
+        char text[32];
+        snprintf(text, sizeof(text), "%.2f", (f64)i * 0.5);
+        CORE_ASSERT(strtod(text, NULL) == (f64)i * 0.5);
+        atomic_fetch_add((_Atomic size_t *)arg, 1);
+        fiber_yield();
+    }
+}
+
+static void test_fiber(void) {
+    FiberScheduler *sched = fiber_scheduler_new(.threads = 2, .stack_size = CORE_KB(64));
+    CORE_ASSERT(sched);
+    _Atomic size_t steps = 0;
+    for(size_t i = 0; i < 100; i++) {
+        bool spawned = fiber_spawn(sched, test_fiber_main, (void *)&steps);
+        CORE_ASSERT(spawned);
+    }
+    fiber_scheduler_wait(sched);
+    CORE_ASSERT(steps == 1000);
+    fiber_scheduler_destroy(sched);
+    println("fiber: ok");
+}
+#else
+static void test_fiber(void) {}
+#endif
+
+#define TEST_SYNC_THREADS 4
+#define TEST_SYNC_ROUNDS 20000
+
+typedef struct TestSyncShared {
+    Mutex mutex;
+    SpinLock spin;
+    RwLock rwlock;
+    Semaphore semaphore;
+    Barrier barrier;
+    Once once;
+    _Atomic u32 next_id;
+    //  plain fields, only touched under the locks
+    size_t mutex_counter;
+    size_t spin_counter;
+    size_t left;
+    size_t right;
+    _Atomic u32 inside;
+    _Atomic u32 max_inside;
+    _Atomic u32 leaders;
+    _Atomic u32 once_calls;
+    u32 slots[TEST_SYNC_THREADS];
+}TestSyncShared;
+
+static void test_sync_once(void *arg) {
+    atomic_fetch_add(&((TestSyncShared *)arg)->once_calls, 1);
+}
+
+static i32 test_sync_worker(void *arg) {
+    TestSyncShared *shared = arg;
+    u32 id = atomic_fetch_add(&shared->next_id, 1);
+    once_call(&shared->once, test_sync_once, shared);
+
+    for(size_t i = 0; i < TEST_SYNC_ROUNDS; i++) {
+        mutex_lock(&shared->mutex);
+        shared->mutex_counter++;
+        mutex_unlock(&shared->mutex);
+        spin_lock(&shared->spin);
+        shared->spin_counter++;
+        spin_unlock(&shared->spin);
+    }
+
+    //  half the threads write both fields, the others must never see them differ
+    for(size_t i = 0; i < TEST_SYNC_ROUNDS / 4; i++) {
+        if(id % 2 == 0) {
+            rwlock_write_lock(&shared->rwlock);
+            shared->left++;
+            shared->right++;
+            rwlock_write_unlock(&shared->rwlock);
+        }else {
+            rwlock_read_lock(&shared->rwlock);
+            CORE_ASSERT(shared->left == shared->right);
+            rwlock_read_unlock(&shared->rwlock);
+        }
+    }
+
+    //  at most two threads inside at a time
+    for(size_t i = 0; i < 200; i++) {
+        semaphore_wait(&shared->semaphore);
+        u32 inside = atomic_fetch_add(&shared->inside, 1) + 1;
+        u32 max = atomic_load(&shared->max_inside);
+        while(inside > max && !atomic_compare_exchange_weak(&shared->max_inside, &max, inside));
+        if(i % 16 == 0) {
+            thrd_yield();
+        }
+        atomic_fetch_sub(&shared->inside, 1);
+        semaphore_post(&shared->semaphore, 1);
+    }
+
+    //  every thread sees the writes of all others from the same round
+    for(u32 round = 1; round <= 100; round++) {
+        shared->slots[id] = round;
+        atomic_fetch_add(&shared->leaders, barrier_wait(&shared->barrier));
+        for(size_t i = 0; i < TEST_SYNC_THREADS; i++) {
+            CORE_ASSERT(shared->slots[i] == round);
+        }
+        atomic_fetch_add(&shared->leaders, barrier_wait(&shared->barrier));
+    }
+    return 0;
+}
+
+static void test_sync(void) {
+    TestSyncShared shared = { .barrier = barrier_new(TEST_SYNC_THREADS) };
+    semaphore_post(&shared.semaphore, 2);
+    thrd_t threads[TEST_SYNC_THREADS];
+    for(size_t i = 0; i < TEST_SYNC_THREADS; i++) {
+        thrd_create(&threads[i], test_sync_worker, &shared);
+    }
+    for(size_t i = 0; i < TEST_SYNC_THREADS; i++) {
+        thrd_join(threads[i], NULL);
+    }
+    CORE_ASSERT(shared.once_calls == 1);
+    CORE_ASSERT(shared.mutex_counter == TEST_SYNC_THREADS * TEST_SYNC_ROUNDS);
+    CORE_ASSERT(shared.spin_counter == TEST_SYNC_THREADS * TEST_SYNC_ROUNDS);
+    CORE_ASSERT(shared.left == TEST_SYNC_THREADS / 2 * (TEST_SYNC_ROUNDS / 4) && shared.left == shared.right);
+    CORE_ASSERT(shared.max_inside >= 1 && shared.max_inside <= 2 && shared.inside == 0);
+    CORE_ASSERT(shared.leaders == 200);
+
+    //  the lock states block each other
+    bool first = mutex_try_lock(&shared.mutex);
+    bool second = mutex_try_lock(&shared.mutex);
+    CORE_ASSERT(first && !second);
+    mutex_unlock(&shared.mutex);
+    first = rwlock_try_read_lock(&shared.rwlock);
+    second = rwlock_try_read_lock(&shared.rwlock);
+    CORE_ASSERT(first && second);
+    bool third = rwlock_try_write_lock(&shared.rwlock);
+    CORE_ASSERT(!third);
+    rwlock_read_unlock(&shared.rwlock);
+    rwlock_read_unlock(&shared.rwlock);
+    first = rwlock_try_write_lock(&shared.rwlock);
+    second = rwlock_try_read_lock(&shared.rwlock);
+    CORE_ASSERT(first && !second);
+    rwlock_write_unlock(&shared.rwlock);
+    first = semaphore_try_wait(&shared.semaphore);
+    second = semaphore_try_wait(&shared.semaphore);
+    third = semaphore_try_wait(&shared.semaphore);
+    CORE_ASSERT(first && second && !third);
+    println("sync: ok");
+}
+
+static void test_ringbuffer(void) {
+    //  100 byte allocations take 128 bytes with their header, 8 per lap
+    RingBuffer ring = ringbuffer_init(.size = 1024);
+    u8 *blocks[8];
+    for(size_t i = 0; i < CORE_ARRLEN(blocks); i++) {
+        blocks[i] = ringbuffer_alloc(&ring, 100);
+        memset(blocks[i], (int)i, 100);
+    }
+    CORE_ASSERT(ring.lap == 0 && ring.write_pos == 1024);
+    for(size_t i = 0; i < CORE_ARRLEN(blocks); i++) {
+        CORE_ASSERT(ringbuffer_is_live(&ring, blocks[i]));
+        for(size_t j = 0; j < 100; j++) {
+            CORE_ASSERT(blocks[i][j] == i);
+        }
+    }
+
+    //  wraps, the new block covers the header of the second one
+    u8 *wide = ringbuffer_alloc(&ring, 200);
+    memset(wide, 0xFF, 200);
+    CORE_ASSERT(ring.lap == 1 && wide == blocks[0]);
+    CORE_ASSERT(!ringbuffer_is_live(&ring, blocks[1]));
+    //  not reached by the writer yet
+    for(size_t i = 2; i < CORE_ARRLEN(blocks); i++) {
+        CORE_ASSERT(ringbuffer_is_live(&ring, blocks[i]));
+        CORE_ASSERT(blocks[i][0] == i && blocks[i][99] == i);
+    }
+
+    //  the last block keeps its header through the next lap but is a full ring behind
+    for(size_t i = 0; i < 5; i++) {
+        ringbuffer_alloc(&ring, 100);
+    }
+    CORE_ASSERT(ring.write_pos == 224 + 5 * 128 && ringbuffer_is_live(&ring, blocks[7]));
+    void *wrapped = ringbuffer_alloc(&ring, 240);
+    CORE_ASSERT(wrapped && ring.lap == 2 && ring.write_pos == 256);
+    CORE_ASSERT(!ringbuffer_is_live(&ring, blocks[7]));
+    CORE_ASSERT(!ringbuffer_is_live(&ring, NULL));
+
+    //  heap blocks live for two laps
+    u8 *large = ringbuffer_alloc(&ring, 600);
+    memset(large, 1, 600);
+    CORE_ASSERT(ringbuffer_is_live(&ring, large));
+    for(size_t i = 0; i < 4; i++) {
+        ringbuffer_alloc(&ring, 240);
+    }
+    CORE_ASSERT(ring.lap == 3 && ringbuffer_is_live(&ring, large) && large[599] == 1);
+    for(size_t i = 0; i < 4; i++) {
+        ringbuffer_alloc(&ring, 240);
+    }
+    CORE_ASSERT(ring.lap == 4 && !ringbuffer_is_live(&ring, large));
+    ringbuffer_deinit(&ring);
+    println("ringbuffer: ok");
+}
+
+#ifdef PLATFORM_POSIX
+#define TEST_MAGIC_RING_BYTES CORE_MB(4)
+
+static u8 test_magic_ring_byte(size_t i) {
+    return (u8)(i * 31 + (i >> 8));
+}
+
+static i32 test_magic_ring_producer(void *arg) {
+    MagicRing *ring = arg;
+    size_t written = 0, step = 1;
+    while(written < TEST_MAGIC_RING_BYTES) {
+        //  odd sized writes straight into the mapping, so regions cross the wrap
+        Slice(char) region = magic_ring_write_slice(ring);
+        size_t count = region.len < step ? region.len : step;
+        count = count < TEST_MAGIC_RING_BYTES - written ? count : TEST_MAGIC_RING_BYTES - written;
+        if(count == 0) {
+            thrd_yield();
+            continue;
+        }
+        u8 *data = region.data;
+        for(size_t i = 0; i < count; i++) {
+            data[i] = test_magic_ring_byte(written + i);
+        }
+        magic_ring_commit(ring, count);
+        written += count;
+        step = step * 7 % 5003 + 1;
+    }
+    return 0;
+}
+
+static void test_magic_ring(void) {
+    MagicRing ring = magic_ring_new(1);
+    size_t cap = ring.cap;
+    CORE_ASSERT(ring.data && cap == (size_t)sysconf(_SC_PAGESIZE));
+
+    char *bytes = malloc(cap);
+    for(size_t i = 0; i < cap; i++) {
+        bytes[i] = (char)test_magic_ring_byte(i);
+    }
+    size_t moved = magic_ring_write(&ring, bytes, cap - 100);
+    CORE_ASSERT(moved == cap - 100);
+    char *out = malloc(cap);
+    moved = magic_ring_read(&ring, out, cap - 200);
+    CORE_ASSERT(moved == cap - 200);
+    //  the free region runs over the end of the first mapping
+    Slice(char) region = magic_ring_write_slice(&ring);
+    CORE_ASSERT(region.data == ring.data + cap - 100 && region.len == cap - 100);
+    memcpy(region.data, bytes, 300);
+    magic_ring_commit(&ring, 300);
+    //  and shows up at the start of the storage through the second one
+    CORE_ASSERT(memcmp(ring.data, bytes + 100, 200) == 0);
+    region = magic_ring_read_slice(&ring);
+    CORE_ASSERT(region.data == ring.data + cap - 200 && region.len == 400);
+    CORE_ASSERT(memcmp(region.data, bytes + cap - 200, 100) == 0 && memcmp((char *)region.data + 100, bytes, 300) == 0);
+    magic_ring_consume(&ring, 400);
+
+    //  full and empty
+    moved = magic_ring_write(&ring, bytes, cap);
+    CORE_ASSERT(moved == cap && magic_ring_space(&ring) == 0);
+    moved = magic_ring_write(&ring, bytes, 1);
+    CORE_ASSERT(moved == 0);
+    moved = magic_ring_read(&ring, out, cap + 1);
+    CORE_ASSERT(moved == cap && memcmp(out, bytes, cap) == 0);
+    moved = magic_ring_read(&ring, out, 1);
+    CORE_ASSERT(moved == 0 && magic_ring_len(&ring) == 0);
+    free(out);
+    free(bytes);
+
+    thrd_t producer;
+    thrd_create(&producer, test_magic_ring_producer, &ring);
+    size_t read = 0;
+    while(read < TEST_MAGIC_RING_BYTES) {
+        region = magic_ring_read_slice(&ring);
+        if(region.len == 0) {
+            thrd_yield();
+            continue;
+        }
+        u8 *data = region.data;
+        for(size_t i = 0; i < region.len; i++) {
+            CORE_ASSERT(data[i] == test_magic_ring_byte(read + i));
+        }
+        magic_ring_consume(&ring, region.len);
+        read += region.len;
+    }
+    thrd_join(producer, NULL);
+    CORE_ASSERT(read == TEST_MAGIC_RING_BYTES && magic_ring_len(&ring) == 0);
+    magic_ring_destroy(&ring);
+    println("magic ring: ok");
+}
+#else
+static void test_magic_ring(void) {}
+#endif
+
+SMALL_VEC_DEFINE(TestSmallInts, i32, 4)
+
+typedef struct TestSmallHolder {
+    TestSmallInts values;
+}TestSmallHolder;
+
+static i32 test_small_vec_sum(TestSmallInts *values) {
+    i32 sum = 0;
+    small_vec_foreach(values, item) {
+        sum += *item;
+    }
+    return sum;
+}
+
+static void test_small_vec(void) {
+    TestSmallHolder holder = {0};
+    TestSmallInts local = {0};
+    for(i32 i = 0; i < 3; i++) {
+        small_vec_push(&holder.values, i);
+        small_vec_push(&local, i * 10);
+    }
+    CORE_ASSERT(small_vec_is_inline(&holder.values) && small_vec_cap(&holder.values) == 4);
+    //  both are the same named type
+    CORE_ASSERT(test_small_vec_sum(&holder.values) == 3 && test_small_vec_sum(&local) == 30);
+    for(i32 i = 3; i < 10; i++) {
+        small_vec_push(&holder.values, i);
+    }
+    CORE_ASSERT(!small_vec_is_inline(&holder.values) && small_vec_len(&holder.values) == 10);
+    small_vec_iter(&holder.values, i) {
+        CORE_ASSERT(small_vec_at(&holder.values, i) == (i32)i);
+    }
+    i32 popped = small_vec_pop(&holder.values);
+    CORE_ASSERT(popped == 9 && test_small_vec_sum(&holder.values) == 36);
+    small_vec_destroy(&holder.values);
+
+    //  a failed spill or grow drops the element and keeps what was there
+    TestFailAlloc failing = { .fail = true };
+    Allocator alloc = { .self = &failing, .alloc = test_fail_alloc, .realloc = test_fail_realloc, .free = test_fail_free };
+    TestSmallInts values;
+    small_vec_init(&values, .allocator = alloc);
+    bool pushed = true;
+    for(i32 i = 0; i < 4; i++) {
+        pushed &= small_vec_push(&values, i);
+    }
+    CORE_ASSERT(pushed);
+    pushed = small_vec_push(&values, 4);
+    CORE_ASSERT(!pushed && small_vec_is_inline(&values) && small_vec_len(&values) == 4);
+    CORE_ASSERT(test_small_vec_sum(&values) == 6);
+    failing.fail = false;
+    pushed = true;
+    for(i32 i = 4; (size_t)i < small_vec_cap(&values) || small_vec_is_inline(&values); i++) {
+        pushed &= small_vec_push(&values, i);
+    }
+    size_t cap = small_vec_cap(&values);
+    CORE_ASSERT(pushed && small_vec_len(&values) == cap);
+    failing.fail = true;
+    pushed = small_vec_push(&values, -1);
+    CORE_ASSERT(!pushed && small_vec_len(&values) == cap && small_vec_cap(&values) == cap);
+    CORE_ASSERT(test_small_vec_sum(&values) == (i32)(cap * (cap - 1) / 2));
+    small_vec_destroy(&values);
+    println("small vec: ok");
+}
+
+static i32 test_vec_empty_worker(void *arg) {
+    CORE_UNUSED(arg);
+    //  every thread starts from the shared header, none of this may write to it
+    for(i32 round = 0; round < 1000; round++) {
+        Vec(i32) vec = vec_new();
+        vec_clear(vec);
+        bool removed = vec_remove(vec, 0);
+        CORE_ASSERT(!removed);
+        vec_push(vec, round);
+        i32 popped = vec_pop(vec);
+        CORE_ASSERT(popped == round && vec_len(vec) == 0);
+        vec_destroy(vec);
+    }
+    return 0;
+}
+
+static void test_vec_empty(void) {
+    Vec(i32) a = vec_new();
+    Vec(i32) b = vec_new();
+    CORE_ASSERT(vec_len(a) == 0 && vec_cap(a) == 0);
+    vec_clear(a);
+    bool first = vec_remove(a, 0);
+    bool second = vec_remove(a, 1);
+    CORE_ASSERT(!first && !second);
+    vec_destroy(a);
+    CORE_ASSERT(vec_len(b) == 0 && vec_cap(b) == 0);
+
+    for(i32 i = 0; i < 5; i++) {
+        vec_push(b, i);
+    }
+    CORE_ASSERT(vec_cap(b) == DEFAULT_INITIAL_VECTOR_SIZE);
+    first = vec_remove(b, 5);
+    CORE_ASSERT(!first);
+    first = vec_remove(b, 4);
+    second = vec_remove(b, 0);
+    bool third = vec_remove(b, 1);
+    CORE_ASSERT(first && second && third);
+    CORE_ASSERT(vec_len(b) == 2 && b[0] == 1 && b[1] == 3);
+    i32 top = vec_pop(b);
+    i32 bottom = vec_pop(b);
+    CORE_ASSERT(top == 3 && bottom == 1 && vec_len(b) == 0);
+    first = vec_remove(b, 0);
+    CORE_ASSERT(!first);
+    vec_destroy(b);
+
+    //  empty vecs with their own allocator have a header of their own
+    Arena arena = arena_new(CORE_KB(1));
+    Vec(i32) c = vec_new(.allocator = arena_allocator(&arena));
+    vec_clear(c);
+    first = vec_remove(c, 0);
+    CORE_ASSERT(!first);
+    vec_push(c, 7);
+    first = vec_remove(c, 0);
+    CORE_ASSERT(first && vec_len(c) == 0);
+    arena_dealloc(&arena);
+
+    thrd_t threads[4];
+    for(size_t i = 0; i < CORE_ARRLEN(threads); i++) {
+        thrd_create(&threads[i], test_vec_empty_worker, NULL);
+    }
+    for(size_t i = 0; i < CORE_ARRLEN(threads); i++) {
+        thrd_join(threads[i], NULL);
+    }
+    Vec(i32) d = vec_new();
+    CORE_ASSERT(vec_len(d) == 0 && vec_cap(d) == 0);
+    vec_destroy(d);
+    println("vec empty: ok");
+}
+
+#define TEST_SOA_FIELDS(X) X(u8, tag) X(u32, id) X(f64, value)
+SOA_DEFINE(TestSoa, test_soa, TEST_SOA_FIELDS)
+
+//  every row still belongs together and the ids are in the order of `model`
+static void test_soa_check(TestSoa *table, Vec(u32) model) {
+    CORE_ASSERT(soa_len(table) == vec_len(model));
+    for(size_t i = 0; i < soa_len(table); i++) {
+        TestSoaRow row = test_soa_get(table, i);
+        CORE_ASSERT(row.id == model[i] && row.tag == (u8)row.id && row.value == row.id * 0.5);
+    }
+}
+
+static void test_soa(void) {
+    TestSoa table = soa_new(TestSoa);
+    Vec(u32) model = vec_new();
+    for(u32 i = 0; i < 300; i++) {
+        size_t index = test_soa_push(&table, (TestSoaRow){ .tag = (u8)i, .id = i, .value = i * 0.5 });
+        CORE_ASSERT(index == i);
+        vec_push(model, i);
+    }
+    CORE_ASSERT((ptr_t)table.tag % SOA_COLUMN_ALIGN == 0 && (ptr_t)table.id % SOA_COLUMN_ALIGN == 0);
+    CORE_ASSERT((ptr_t)table.value % SOA_COLUMN_ALIGN == 0);
+    test_soa_check(&table, model);
+
+    bool removed = test_soa_remove(&table, 300);
+    bool swapped = test_soa_swap_remove(&table, 300);
+    CORE_ASSERT(!removed && !swapped);
+    //  first, last and random rows, alternating between both kinds of removal
+    removed = test_soa_remove(&table, 0);
+    bool mirrored = vec_remove(model, 0);
+    CORE_ASSERT(removed && mirrored);
+    swapped = test_soa_swap_remove(&table, 0);
+    CORE_ASSERT(swapped);
+    model[0] = vec_pop(model);
+    removed = test_soa_remove(&table, soa_len(&table) - 1);
+    mirrored = vec_remove(model, vec_len(model) - 1);
+    CORE_ASSERT(removed && mirrored);
+    swapped = test_soa_swap_remove(&table, soa_len(&table) - 1);
+    CORE_ASSERT(swapped);
+    vec_pop(model);
+    test_soa_check(&table, model);
+    while(soa_len(&table) > 0) {
+        size_t index = test_rand() % soa_len(&table);
+        if(test_rand() % 2) {
+            removed = test_soa_remove(&table, index);
+            mirrored = vec_remove(model, index);
+            CORE_ASSERT(removed && mirrored);
+        }else {
+            swapped = test_soa_swap_remove(&table, index);
+            CORE_ASSERT(swapped);
+            u32 last = vec_pop(model);
+            if(index < vec_len(model)) {
+                model[index] = last;
+            }
+        }
+        test_soa_check(&table, model);
+    }
+    removed = test_soa_remove(&table, 0);
+    swapped = test_soa_swap_remove(&table, 0);
+    CORE_ASSERT(!removed && !swapped);
+    test_soa_destroy(&table);
+    vec_destroy(model);
+    println("soa: ok");
+}
+
+static void test_file_writer(void) {
+    const char *path = "test_file_writer.txt";
+    FileHandle file = file_open(path, FILE_WRITE | FILE_BIN);
+    FileWriter writer = file_writer_new(file, .buffer_size = 16);
+    CORE_ASSERT(!writer.error);
+
+    char large[100];
+    for(size_t i = 0; i < sizeof(large); i++) {
+        large[i] = (char)('a' + i % 26);
+    }
+    i64 counts[6];
+    counts[0] = file_writer_write_raw(&writer, "hello", 5);
+    counts[1] = file_writer_printf(&writer, "%d-%s", 42, "ab");
+    //  no longer fits, the buffer is flushed and the data copied in
+    counts[2] = file_writer_write(&writer, sv("0123456789"));
+    //  larger than the buffer, goes out through `writev` together with the buffered bytes
+    counts[3] = file_writer_write_raw(&writer, large, sizeof(large));
+    //  formatted output larger than the buffer
+    counts[4] = file_writer_printf(&writer, "%.*s|%d", 30, large, 7);
+    counts[5] = file_writer_printf(&writer, "%s", "");
+    CORE_ASSERT(counts[0] == 5 && counts[1] == 5 && counts[2] == 10 && counts[3] == 100);
+    CORE_ASSERT(counts[4] == 32 && counts[5] == 0);
+    bool flushed = file_writer_flush(&writer);
+    bool synced = file_writer_sync(&writer);
+    CORE_ASSERT(flushed && synced && writer.written == 152 && writer.len == 0);
+    bool deinit = file_writer_deinit(&writer);
+    CORE_ASSERT(deinit);
+    file_close(file);
+
+    char expected[152];
+    memcpy(expected, "hello42-ab0123456789", 20);
+    memcpy(expected + 20, large, sizeof(large));
+    memcpy(expected + 120, large, 30);
+    memcpy(expected + 150, "|7", 2);
+    String text = file_read_to_string(path);
+    CORE_ASSERT(string_len(&text) == sizeof(expected) && memcmp(string_cstr(&text), expected, sizeof(expected)) == 0);
+    string_destroy(&text);
+
+    //  a read-only handle fails on the first write that reaches the file and stays failed
+    file = file_open(path, FILE_READ | FILE_BIN);
+    bool raw = file_write_raw(file, "x", 1);
+    CORE_ASSERT(!raw);
+    writer = file_writer_new(file, .buffer_size = 16);
+    counts[0] = file_writer_write_raw(&writer, "buffered", 8);
+    flushed = file_writer_flush(&writer);
+    counts[1] = file_writer_write_raw(&writer, "more", 4);
+    synced = file_writer_sync(&writer);
+    CORE_ASSERT(counts[0] == 8 && !flushed && counts[1] == -1 && !synced && writer.error);
+    counts[2] = file_writer_write_raw(&writer, large, sizeof(large));
+    counts[3] = file_writer_printf(&writer, "%d", 1);
+    CORE_ASSERT(counts[2] == -1 && counts[3] == -1);
+    deinit = file_writer_deinit(&writer);
+    CORE_ASSERT(!deinit);
+    file_close(file);
+    remove(path);
+    println("file writer: ok");
+}
+
+#ifdef PLATFORM_POSIX
+static void test_dir_touch(const char *path) {
+    FileHandle file = file_open(path, FILE_WRITE | FILE_BIN);
+    file_write_raw(file, path, strlen(path));
+    file_close(file);
+}
+
+static size_t test_dir_walk_count(DirWalk *walk, const char *path, DirEntryKind kind) {
+    size_t count = 0;
+    vec_foreach(walk->entries, entry) {
+        if(string_view_cmp(entry->path, string_view_from(path)) && entry->kind == kind) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void test_dir_walk(void) {
+    CORE_ASSERT(glob_match(sv("*.json"), sv("b.json")));
+    CORE_ASSERT(!glob_match(sv("*.json"), sv("b.jsonx")));
+    CORE_ASSERT(glob_match(sv("?.txt"), sv("a.txt")));
+    CORE_ASSERT(!glob_match(sv("?.txt"), sv("ab.txt")));
+    CORE_ASSERT(!glob_match(sv("?.txt"), sv(".txt")));
+    //  names never contain `/`, so `**` is just `*`
+    CORE_ASSERT(glob_match(sv("**.json"), sv("x.y.json")));
+    CORE_ASSERT(glob_match(sv("a**"), sv("a")));
+    CORE_ASSERT(glob_match(sv("**"), sv("")));
+    CORE_ASSERT(glob_match(sv("*a*b?"), sv("xxaxxbz")));
+    CORE_ASSERT(!glob_match(sv("*a*b?"), sv("xxaxxb")));
+    CORE_ASSERT(glob_match(sv("[a-c]*"), sv("b.json")));
+    CORE_ASSERT(!glob_match(sv("[!a-c]*"), sv("b.json")));
+
+    const char *dirs[] = { "test_dir_walk", "test_dir_walk/sub", "test_dir_walk/sub/deep", "test_dir_walk/.hdir" };
+    const char *files[] = {
+        "test_dir_walk/a.txt", "test_dir_walk/b.json", "test_dir_walk/.hidden",
+        "test_dir_walk/sub/c.json", "test_dir_walk/sub/deep/d.txt", "test_dir_walk/sub/deep/e.json",
+        "test_dir_walk/.hdir/f.json",
+    };
+    for(size_t i = 0; i < CORE_ARRLEN(dirs); i++) {
+        mkdir(dirs[i], 0755);
+    }
+    for(size_t i = 0; i < CORE_ARRLEN(files); i++) {
+        test_dir_touch(files[i]);
+    }
+    i32 linked = symlink("sub", "test_dir_walk/link");
+    linked |= symlink("a.txt", "test_dir_walk/flink");
+    CORE_ASSERT(linked == 0);
+
+    //  one level, hidden entries included and symlinks reported as such
+    Arena arena = arena_new(0);
+    DirIter iter;
+    bool opened = dir_iter_open(&iter, "test_dir_walk", &arena);
+    CORE_ASSERT(opened);
+    size_t seen = 0;
+    DirEntry entry;
+    while(dir_iter_next(&iter, &entry)) {
+        if(entry.kind == DIR_ENTRY_UNKNOWN) {
+            dir_iter_stat(&iter, &entry);
+        }
+        bool dir = string_view_cmp(entry.name, sv("sub")) || string_view_cmp(entry.name, sv(".hdir"));
+        bool link = string_view_cmp(entry.name, sv("link")) || string_view_cmp(entry.name, sv("flink"));
+        CORE_ASSERT(entry.kind == (dir ? DIR_ENTRY_DIR : link ? DIR_ENTRY_SYMLINK : DIR_ENTRY_FILE));
+        CORE_ASSERT(entry.path.len == entry.name.len + strlen("test_dir_walk/"));
+        seen++;
+    }
+    dir_iter_close(&iter);
+    arena_dealloc(&arena);
+    CORE_ASSERT(seen == 7);
+
+    for(u32 threads = 1; threads <= 4; threads += 3) {
+        //  symlinked directories are reported, not followed
+        DirWalk walk = dir_walk("test_dir_walk/", .threads = threads);
+        CORE_ASSERT(vec_len(walk.entries) == CORE_ARRLEN(files) + 2);
+        for(size_t i = 0; i < CORE_ARRLEN(files); i++) {
+            CORE_ASSERT(test_dir_walk_count(&walk, files[i], DIR_ENTRY_FILE) == 1);
+        }
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/link", DIR_ENTRY_SYMLINK) == 1);
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/flink", DIR_ENTRY_SYMLINK) == 1);
+        dir_walk_free(&walk);
+
+        walk = dir_walk("test_dir_walk", .threads = threads, .extension = ".json");
+        CORE_ASSERT(vec_len(walk.entries) == 4);
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/.hdir/f.json", DIR_ENTRY_FILE) == 1);
+        dir_walk_free(&walk);
+
+        walk = dir_walk("test_dir_walk", .threads = threads, .pattern = "?.txt", .stat = true);
+        CORE_ASSERT(vec_len(walk.entries) == 2);
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/sub/deep/d.txt", DIR_ENTRY_FILE) == 1);
+        vec_foreach(walk.entries, found) {
+            CORE_ASSERT(found->size == (u64)found->path.len);
+        }
+        dir_walk_free(&walk);
+
+        walk = dir_walk("test_dir_walk", .threads = threads, .include_dirs = true, .max_depth = 2);
+        CORE_ASSERT(vec_len(walk.entries) == 10);
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/sub/deep", DIR_ENTRY_DIR) == 1);
+        CORE_ASSERT(test_dir_walk_count(&walk, "test_dir_walk/sub/deep/d.txt", DIR_ENTRY_FILE) == 0);
+        dir_walk_free(&walk);
+    }
+
+    //  more paths than one worker arena holds
+    char path[256];
+    mkdir("test_dir_walk/many", 0755);
+    for(u32 i = 0; i < 600; i++) {
+        snprintf(path, sizeof(path), "test_dir_walk/many/%04u_%0100u", i, 0u);
+        test_dir_touch(path);
+    }
+    DirWalk walk = dir_walk("test_dir_walk/many", .threads = 1);
+    CORE_ASSERT(vec_len(walk.entries) == 600 && vec_len(walk.arenas) > 1);
+    for(u32 i = 0; i < 600; i++) {
+        snprintf(path, sizeof(path), "test_dir_walk/many/%04u_%0100u", i, 0u);
+        CORE_ASSERT(test_dir_walk_count(&walk, path, DIR_ENTRY_FILE) == 1);
+    }
+    dir_walk_free(&walk);
+    for(u32 i = 0; i < 600; i++) {
+        snprintf(path, sizeof(path), "test_dir_walk/many/%04u_%0100u", i, 0u);
+        remove(path);
+    }
+    remove("test_dir_walk/many");
+
+    remove("test_dir_walk/link");
+    remove("test_dir_walk/flink");
+    for(size_t i = 0; i < CORE_ARRLEN(files); i++) {
+        remove(files[i]);
+    }
+    for(size_t i = CORE_ARRLEN(dirs); i > 0; i--) {
+        remove(dirs[i - 1]);
+    }
+    println("dir walk: ok");
+}
+#else
+static void test_dir_walk(void) {}
+#endif
+
+typedef struct TestChunkResult {
+    size_t offset;
+    size_t len;
+    size_t lines;
+}TestChunkResult;
+
+typedef struct TestChunkState {
+    const char *base;
+    size_t merged;
+    size_t offset;
+    size_t lines;
+    bool in_order;
+}TestChunkState;
+
+static void *test_chunk_process(StringView chunk, Arena *scratch, void *user_data) {
+    TestChunkState *state = user_data;
+    TestChunkResult *result = arena_alloc(scratch, sizeof(TestChunkResult));
+    *result = (TestChunkResult){ .offset = (size_t)(chunk.data - state->base), .len = chunk.len };
+    for(size_t i = 0; i < chunk.len; i++) {
+        result->lines += chunk.data[i] == '\n';
+    }
+    return result;
+}
+
+static void test_chunk_merge(void *result, size_t index, void *user_data) {
+    TestChunkState *state = user_data;
+    TestChunkResult *chunk = result;
+    if(index != state->merged || chunk->offset != state->offset) {
+        state->in_order = false;
+    }
+    state->merged++;
+    state->offset += chunk->len;
+    state->lines += chunk->lines;
+}
+
+static void test_chunks_check(StringView input, size_t count) {
+    Vec(StringView) chunks = string_view_split_chunks(input, count, '\n');
+    CORE_ASSERT(vec_len(chunks) <= count);
+    const char *next = input.data;
+    for(size_t i = 0; i < vec_len(chunks); i++) {
+        CORE_ASSERT(chunks[i].len > 0);
+        CORE_ASSERT(chunks[i].data == next);
+        CORE_ASSERT(i + 1 == vec_len(chunks) || chunks[i].data[chunks[i].len - 1] == '\n');
+        next += chunks[i].len;
+    }
+    CORE_ASSERT(next == input.data + input.len);
+    vec_destroy(chunks);
+}
+
+static void test_chunks(void) {
+    char input[CORE_KB(16)];
+    size_t len = 0;
+    size_t lines = 0;
+    while(len + 32 < sizeof(input)) {
+        len += (size_t)snprintf(input + len, sizeof(input) - len, "line %u %.*s\n", (u32)lines, (i32)(test_rand() % 16), "xxxxxxxxxxxxxxxx");
+        lines++;
+    }
+    memcpy(input + len, "tail", 4);
+    len += 4;
+    StringView view = string_view_new(input, len);
+    size_t counts[] = { 1, 3, 7, 64, len + 10 };
+    for(size_t i = 0; i < CORE_ARRLEN(counts); i++) {
+        test_chunks_check(view, counts[i]);
+    }
+
+    //  more chunks than bytes
+    Vec(StringView) chunks = string_view_split_chunks(sv("a\nb\n"), 10, '\n');
+    CORE_ASSERT(vec_len(chunks) == 2);
+    CORE_ASSERT(string_view_cmp(chunks[0], sv("a\n")) && string_view_cmp(chunks[1], sv("b\n")));
+    vec_destroy(chunks);
+    //  no delimiter leaves a single chunk
+    chunks = string_view_split_chunks(sv("abcdef"), 3, '\n');
+    CORE_ASSERT(vec_len(chunks) == 1 && chunks[0].len == 6);
+    vec_destroy(chunks);
+    chunks = string_view_split_chunks(sv(""), 3, '\n');
+    CORE_ASSERT(vec_len(chunks) == 0);
+    vec_destroy(chunks);
+    chunks = string_view_split_chunks(sv("a;b;c"), 3, ';');
+    CORE_ASSERT(vec_len(chunks) == 3 && string_view_cmp(chunks[2], sv("c")));
+    vec_destroy(chunks);
+
+    for(u32 threads = 1; threads <= 4; threads++) {
+        TestChunkState state = { .base = input, .in_order = true };
+        bool processed = string_view_process_chunks(view, test_chunk_process, test_chunk_merge, &state, .threads = threads, .chunks = 37);
+        CORE_ASSERT(processed && state.in_order);
+        CORE_ASSERT(state.offset == len && state.lines == lines && state.merged <= 37);
+    }
+    println("chunks: ok");
+}
+
+#ifdef __linux__
+static FileWatchEvent const *test_watch_find(FileWatchEvent const *events, size_t count, const char *path) {
+    FileWatchEvent const *found = NULL;
+    for(size_t i = 0; i < count; i++) {
+        if(string_view_cmp(events[i].path, string_view_from(path))) {
+            CORE_ASSERT(found == NULL);
+            found = &events[i];
+        }
+    }
+    return found;
+}
+
+typedef struct TestWatchState {
+    size_t batches;
+    bool deleted;
+}TestWatchState;
+
+static void test_watch_callback(FileWatchEvent const *events, size_t count, void *user_data) {
+    TestWatchState *state = user_data;
+    FileWatchEvent const *event = test_watch_find(events, count, "test_file_watcher/a.txt");
+    state->batches++;
+    state->deleted |= event && FLAG_HAS(event->kinds, FILE_WATCH_DELETED);
+}
+
+static void test_file_watcher(void) {
+    mkdir("test_file_watcher", 0755);
+    FileWatcher watcher = file_watcher_new(.coalesce_ms = 20);
+    i32 wd = file_watcher_add(&watcher, "test_file_watcher/");
+    CORE_ASSERT(wd >= 0);
+
+    //  a burst of writes to the same paths comes back as one event per path
+    for(u32 i = 0; i < 3; i++) {
+        test_dir_touch("test_file_watcher/a.txt");
+        test_dir_touch("test_file_watcher/b.txt");
+    }
+    bool delivered = file_watcher_wait_events(&watcher);
+    CORE_ASSERT(delivered && vec_len(watcher.events) == 2);
+    FileWatchEvent const *a = test_watch_find(watcher.events, vec_len(watcher.events), "test_file_watcher/a.txt");
+    FileWatchEvent const *b = test_watch_find(watcher.events, vec_len(watcher.events), "test_file_watcher/b.txt");
+    CORE_ASSERT(a && a->watch == wd && string_view_cmp(a->name, sv("a.txt")));
+    CORE_ASSERT(a->kinds == (FILE_WATCH_CREATED | FILE_WATCH_MODIFIED));
+    CORE_ASSERT(b && b->kinds == (FILE_WATCH_CREATED | FILE_WATCH_MODIFIED));
+    //  nothing new, nothing delivered
+    delivered = file_watcher_poll_events(&watcher);
+    CORE_ASSERT(!delivered);
+
+    //  removing the watch drops its entry once IN_IGNORED is read
+    bool removed = file_watcher_remove(&watcher, wd);
+    CORE_ASSERT(removed);
+    for(u32 i = 0; i < 100 && vec_len(watcher.watches) > 0; i++) {
+        file_watcher_poll_events(&watcher);
+        thrd_sleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+    CORE_ASSERT(vec_len(watcher.watches) == 0);
+    file_watcher_deinit(&watcher);
+
+    TestWatchState state = {0};
+    watcher = file_watcher_new(.coalesce_ms = 5, .callback = test_watch_callback, .user_data = &state);
+    wd = file_watcher_add(&watcher, "test_file_watcher");
+    CORE_ASSERT(wd >= 0);
+    remove("test_file_watcher/a.txt");
+    delivered = file_watcher_wait_events(&watcher);
+    CORE_ASSERT(delivered && state.batches == 1 && state.deleted);
+    file_watcher_deinit(&watcher);
+
+    remove("test_file_watcher/b.txt");
+    remove("test_file_watcher");
+    println("file watcher: ok");
+}
+#else
+static void test_file_watcher(void) {}
+#endif
+
+#ifdef PLATFORM_POSIX
+static void test_append_log_record(char *record, u32 index, u32 len) {
+    for(u32 i = 0; i < len; i++) {
+        record[i] = (char)(index * 31 + i);
+    }
+}
+
+//  returns how many records matched `test_append_log_record` in order
+static u64 test_append_log_check(AppendLog const *log, u32 len) {
+    char expected[256];
+    AppendLogIter iter = append_log_iter(log);
+    Slice(char) record;
+    u64 count = 0;
+    while(append_log_next(&iter, &record)) {
+        u32 record_len = len ? len : (u32)(count % 200);
+        test_append_log_record(expected, (u32)count, record_len);
+        if(record.len != record_len || memcmp(record.data, expected, record_len) != 0) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+static void test_append_log(void) {
+    const char *path = "test_append_log.bin";
+    char record[256];
+    remove(path);
+
+    //  round trip across a reopen, growing past the first mapping
+    AppendLog log = append_log_open(path);
+    CORE_ASSERT(log.file.data && log.count == 0);
+    char *before = log.file.data;
+#if defined(__linux__) && defined(MAP_FIXED_NOREPLACE)
+    //  occupy the pages right behind the mapping so growing has to move it
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *blocker = mmap(log.file.data + log.file.cap, page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+#endif
+    u32 count = 0;
+    while(log.file.len <= MAPPED_FILE_MIN_SIZE * 2) {
+        test_append_log_record(record, count, count % 200);
+        bool appended = append_log_append(&log, record, count % 200);
+        CORE_ASSERT(appended);
+        count++;
+    }
+    CORE_ASSERT(log.count == count && log.file.cap > MAPPED_FILE_MIN_SIZE);
+#if defined(__linux__) && defined(MAP_FIXED_NOREPLACE)
+    CORE_ASSERT(log.file.data != before);
+    if(blocker != MAP_FAILED) {
+        munmap(blocker, page);
+    }
+#endif
+    (void)before;
+    CORE_ASSERT(test_append_log_check(&log, 0) == count);
+    append_log_close(&log);
+    log = append_log_open(path);
+    CORE_ASSERT(log.count == count && test_append_log_check(&log, 0) == count);
+    append_log_close(&log);
+    remove(path);
+
+    //  a flipped payload byte drops that record and everything after it
+    log = append_log_open(path);
+    for(u32 i = 0; i < 5; i++) {
+        test_append_log_record(record, i, 16);
+        append_log_append(&log, record, 16);
+    }
+    append_log_close(&log);
+    MappedFile file = mapped_file_open(path);
+    file.data[8 + 24 * 4 + 8 + 3] ^= 1;
+    mapped_file_close(&file);
+    log = append_log_open(path);
+    CORE_ASSERT(log.count == 4 && test_append_log_check(&log, 16) == 4);
+    append_log_close(&log);
+
+    file = mapped_file_open(path);
+    file.data[8 + 24 * 2 + 8 + 3] ^= 1;
+    mapped_file_close(&file);
+    log = append_log_open(path);
+    CORE_ASSERT(log.count == 2);
+    //  the dropped records are gone for good, not revived behind a new one even
+    //  if the process dies before the file is truncated back
+    test_append_log_record(record, 2, 16);
+    append_log_append(&log, record, 16);
+    append_log_sync(&log);
+    munmap(log.file.data, log.file.cap);
+    close(log.file.fd);
+    log = append_log_open(path);
+    CORE_ASSERT(log.count == 3 && test_append_log_check(&log, 16) == 3);
+    append_log_close(&log);
+    remove(path);
+
+    //  anything else is rejected and left as it was
+    FileHandle other = file_open(path, FILE_WRITE | FILE_BIN);
+    file_write_raw(other, "hello world", 11);
+    file_close(other);
+    log = append_log_open(path);
+    CORE_ASSERT(log.file.data == NULL);
+    append_log_close(&log);
+    other = file_open(path, FILE_READ | FILE_BIN);
+    FileMapping mapping = file_map(other);
+    CORE_ASSERT(mapping.size == 11 && memcmp(mapping.data, "hello world", 11) == 0);
+    file_unmap(&mapping);
+    file_close(other);
+    remove(path);
+    println("append log: ok");
+}
+#else
+static void test_append_log(void) {}
+#endif
+
+//  number of `[INFO] record <i>` lines in order from 0, -1 if anything else is in the file
+#ifdef PLATFORM_POSIX
+static i64 test_log_async_records(const char *path) {
+    String text = file_read_to_string(path);
+    const char *ptr = string_cstr(&text);
+    i64 count = 0;
+    char line[64];
+    while(*ptr) {
+        i32 len = snprintf(line, sizeof(line), "[INFO] record %lld\n", (long long)count);
+        if(strncmp(ptr, line, (size_t)len) != 0) {
+            count = -1;
+            break;
+        }
+        ptr += len;
+        count++;
+    }
+    string_destroy(&text);
+    return count;
+}
+
+typedef struct TestLogPipe {
+    i32 fd;
+    size_t bytes;
+    u64 lines;
+}TestLogPipe;
+
+static i32 test_log_pipe_reader(void *arg) {
+    TestLogPipe *pipe = arg;
+    char buffer[4096];
+    for(ssize_t n; (n = read(pipe->fd, buffer, sizeof(buffer))) > 0;) {
+        pipe->bytes += (size_t)n;
+        for(ssize_t i = 0; i < n; i++) {
+            pipe->lines += buffer[i] == '\n';
+        }
+    }
+    return 0;
+}
+
+static tss_t test_log_exit_key;
+
+static void test_log_exit_destructor(void *value) {
+    //  may run after the logger released this thread's queue
+    core_log(CORE_INFO, "record %u", (u32)(uintptr_t)value);
+}
+
+static i32 test_log_exit_worker(void *arg) {
+    core_log(CORE_INFO, "record %u", 0u);
+    tss_set(test_log_exit_key, (void *)(uintptr_t)1);
+    CORE_UNUSED(arg);
+    return 0;
+}
+
+static void test_log_async(void) {
+    const char *path = "test_log_async.log";
+
+    //  the writer is stuck on a full pipe, so the small queue overflows and every
+    //  record that does not fit is counted
+    i32 fds[2];
+    i32 piped = pipe(fds);
+    CORE_ASSERT(piped == 0);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    char fill[512];
+    memset(fill, 'x', sizeof(fill));
+    size_t filled = 0;
+    for(ssize_t n; (n = write(fds[1], fill, sizeof(fill))) > 0; filled += (size_t)n);
+    fcntl(fds[1], F_SETFL, 0);
+    File pipe_out = { .fd = fdopen(fds[1], "wb") };
+    u64 dropped = log_async_dropped();
+    bool started = log_async_start(.file = &pipe_out, .queue_size = CORE_KB(1), .overflow = LOG_OVERFLOW_DROP, .flush_ms = 1000);
+    CORE_ASSERT(started);
+    for(u32 i = 0; i < 500; i++) {
+        core_log(CORE_INFO, "record %u", i);
+    }
+    TestLogPipe reader = { .fd = fds[0] };
+    thrd_t reader_thread;
+    thrd_create(&reader_thread, test_log_pipe_reader, &reader);
+    log_async_stop();
+    fclose(pipe_out.fd);
+    thrd_join(reader_thread, NULL);
+    close(fds[0]);
+    dropped = log_async_dropped() - dropped;
+    CORE_ASSERT(reader.bytes > filled && dropped > 0 && reader.lines + dropped == 500);
+
+    //  blocking loses nothing and keeps the order
+    FileHandle file = file_open(path, FILE_WRITE | FILE_BIN);
+    dropped = log_async_dropped();
+    started = log_async_start(.file = file, .queue_size = CORE_KB(1), .overflow = LOG_OVERFLOW_BLOCK, .flush_ms = 1000);
+    CORE_ASSERT(started);
+    for(u32 i = 0; i < 2000; i++) {
+        core_log(CORE_INFO, "record %u", i);
+    }
+    log_async_stop();
+    file_close(file);
+    i64 records = test_log_async_records(path);
+    CORE_ASSERT(records == 2000 && log_async_dropped() == dropped);
+
+    //  flush writes everything out while the writer would still be batching
+    file = file_open(path, FILE_WRITE | FILE_BIN);
+    started = log_async_start(.file = file, .flush_ms = 60000);
+    CORE_ASSERT(started);
+    for(u32 i = 0; i < 10; i++) {
+        core_log(CORE_INFO, "record %u", i);
+    }
+    log_async_flush();
+    records = test_log_async_records(path);
+    CORE_ASSERT(records == 10);
+
+    //  a thread logging from its exit destructors, before or after its queue is released
+    tss_create(&test_log_exit_key, test_log_exit_destructor);
+    thrd_t thread;
+    thrd_create(&thread, test_log_exit_worker, NULL);
+    thrd_join(thread, NULL);
+    log_async_flush();
+    log_async_stop();
+    tss_delete(test_log_exit_key);
+    file_close(file);
+    //  the two records sit in different queues and may come out in either order
+    String exited = file_read_to_string(path);
+    const char *tail = strstr(string_cstr(&exited), "[INFO] record 9\n");
+    CORE_ASSERT(tail && strlen(tail) == 3 * strlen("[INFO] record 0\n"));
+    CORE_ASSERT(strstr(tail, "[INFO] record 0\n") && strstr(tail, "[INFO] record 1\n"));
+    string_destroy(&exited);
+    remove(path);
+    println("log async: ok");
+}
+#else
+static void test_log_async(void) {}
+#endif
+
+static i32 test_log_counted(i32 *count) {
+    return ++*count;
+}
+
+static void test_log_level(void) {
+    const char *path = "test_log_level.log";
+    FileHandle file = file_open(path, FILE_WRITE | FILE_BIN);
+    bool started = log_async_start(.file = file);
+    CORE_ASSERT(started);
+    LogLevel saved = log_level_get();
+
+    //  filtered calls never evaluate their arguments
+    log_level_set(CORE_WARNING);
+    CORE_ASSERT(log_level_get() == CORE_WARNING);
+    i32 evaluated = 0;
+    log(CORE_INFO, "skipped %d", test_log_counted(&evaluated));
+    log_file(CORE_DEBUG, "skipped %d", test_log_counted(&evaluated));
+    CORE_ASSERT(evaluated == 0);
+    log(CORE_WARNING, "kept %d", test_log_counted(&evaluated));
+    CORE_ASSERT(evaluated == 1);
+    //  still an expression
+    i32 value = (log(CORE_ERROR, "comma %d", 2), 3);
+    CORE_ASSERT(value == 3);
+
+    //  a module override for this file beats the global threshold both ways
+    log_level_set_module("test.c", CORE_TRACE);
+    log(CORE_DEBUG, "module %d", 1);
+    log_level_set(CORE_TRACE);
+    log_level_set_module("test.c", CORE_ERROR);
+    log(CORE_WARNING, "module %d", 2);
+    log_level_set_module("other/test.c", CORE_TRACE);
+    log(CORE_WARNING, "module %d", 3);
+    log_level_clear_module("test.c");
+    log_level_clear_module("other/test.c");
+    log(CORE_DEBUG, "module %d", 4);
+
+    //  compiled out below `CORE_LOG_MIN_LEVEL` whatever the runtime level is
+#undef CORE_LOG_MIN_LEVEL
+#define CORE_LOG_MIN_LEVEL CORE_ERROR
+    log(CORE_WARNING, "compiled out %d", test_log_counted(&evaluated));
+    CORE_ASSERT(evaluated == 1);
+#undef CORE_LOG_MIN_LEVEL
+#define CORE_LOG_MIN_LEVEL CORE_TRACE
+
+    //  a changed level invalidates every cached lookup
+    LogLevelCache cache = 0;
+    bool enabled = core_log_enabled(&cache, "src/net.c", CORE_INFO);
+    u32 generation = (u32)(atomic_load(&cache) >> 8);
+    CORE_ASSERT(enabled && generation == atomic_load(&core_log_generation));
+    log_level_set(CORE_ERROR);
+    CORE_ASSERT(atomic_load(&core_log_generation) != generation);
+    enabled = core_log_enabled(&cache, "src/net.c", CORE_INFO);
+    CORE_ASSERT(!enabled && (u32)(atomic_load(&cache) >> 8) == atomic_load(&core_log_generation));
+    log_level_set_module("net", CORE_DEBUG);
+    enabled = core_log_enabled(&cache, "src/net.c", CORE_INFO);
+    CORE_ASSERT(enabled);
+    log_level_clear_module("net");
+
+    log_level_set(saved);
+    log_async_stop();
+    file_close(file);
+    String text = file_read_to_string(path);
+    CORE_ASSERT(strcmp(string_cstr(&text), "[WARNING] kept 1\n[ERROR] comma 2\n[DEBUG] module 1\n[DEBUG] module 4\n") == 0);
+    string_destroy(&text);
+    remove(path);
+    println("log level: ok");
+}
+
+typedef struct TestContextShared {
+    bool initialized_before;
+    bool initialized_after;
+    bool formatted;
+    void *ring;
+    void *block;
+}TestContextShared;
+
+static i32 test_context_worker(void *arg) {
+    TestContextShared *shared = arg;
+    shared->initialized_before = _core_context.initialized;
+    String text = tmp_printf("thread %d", 7);
+    StringView copy = tmp_copy(sv("a copy in the scratch ring"));
+    shared->formatted = strcmp(string_cstr(&text), "thread 7") == 0 && strcmp(copy.data, "a copy in the scratch ring") == 0;
+    shared->initialized_after = _core_context.initialized;
+    shared->ring = _core_context.ring_buffer.base;
+    //  freed by the main thread
+    shared->block = allocator_alloc(&default_allocator, 32);
+    return 0;
+}
+
+#ifdef CORE_MEM_DEBUG
+//  whether the newest record of `addr` was freed, false if there is none
+static bool test_context_freed(void *addr) {
+    bool freed = false;
+    mutex_lock(&core_memory_stats.lock);
+    for(size_t i = vec_len(core_memory_stats.allocations); i > 0; i--) {
+        if(core_memory_stats.allocations[i - 1].addr == addr) {
+            freed = core_memory_stats.allocations[i - 1].freed_at.line != 0;
+            break;
+        }
+    }
+    mutex_unlock(&core_memory_stats.lock);
+    return freed;
+}
+#endif
+
+static void test_context(void) {
+    //  a thread that never called `context_thread_init` gets its context on first use
+    //  and loses it when it exits
+    TestContextShared shared = {0};
+    thrd_t thread;
+    thrd_create(&thread, test_context_worker, &shared);
+    thrd_join(thread, NULL);
+    CORE_ASSERT(!shared.initialized_before && shared.initialized_after && shared.formatted);
+    CORE_ASSERT(shared.ring && shared.block);
+#ifdef CORE_MEM_DEBUG
+    CORE_ASSERT(test_context_freed(shared.ring));
+    CORE_ASSERT(!test_context_freed(shared.block));
+#endif
+    allocator_free(&default_allocator, shared.block);
+#ifdef CORE_MEM_DEBUG
+    CORE_ASSERT(test_context_freed(shared.block));
+#endif
+
+    //  tearing down early is fine, the next use starts over
+    String before = tmp_printf("%s", "main");
+    CORE_ASSERT(strcmp(string_cstr(&before), "main") == 0);
+    context_thread_deinit();
+    CORE_ASSERT(!_core_context.initialized && _core_context.ring_buffer.base == NULL);
+    String after = tmp_printf("%s", "again");
+    CORE_ASSERT(strcmp(string_cstr(&after), "again") == 0 && _core_context.initialized);
+    println("context: ok");
+}